@@ -0,0 +1,665 @@
+#include "APU.h"
+
+#include "Timeline.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+// https://www.nesdev.org/wiki/APU_Length_Counter
+constexpr uint8_t LengthTable[32] = {
+    10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+    12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+};
+
+// In output order
+constexpr uint8_t DutyTable[4][8] = {
+    { 0, 1, 0, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 1, 1, 0, 0, 0 },
+    { 1, 0, 0, 1, 1, 1, 1, 1 }
+};
+
+// Sequencer steps from each position until the duty output flips
+constexpr auto DutyRuns = [] {
+    std::array<std::array<uint8_t, 8>, 4> runs{};
+    for (size_t duty = 0; duty < 4; ++duty) {
+        for (size_t step = 0; step < 8; ++step) {
+            uint8_t run = 1;
+            while (DutyTable[duty][(step + run) & 7] == DutyTable[duty][step]) {
+                run++;
+            }
+            runs[duty][step] = run;
+        }
+    }
+    return runs;
+}();
+
+constexpr uint8_t TriangleSequence[32] = {
+    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+
+// NTSC, in CPU cycles
+constexpr uint16_t NoisePeriods[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068
+};
+
+// NTSC, in CPU cycles
+constexpr uint16_t DMCPeriods[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54
+};
+
+// Steps of the given period needed to reach until from next, at least 0
+uint64_t StepsUntil(uint64_t next, uint64_t until, uint64_t period) {
+    return next < until ? (until - next + period - 1) / period : 0;
+}
+
+} // namespace
+
+APU::APU(Cartridge& cartridge, InterruptLines& interrupts) : cartridge(cartridge), interrupts(interrupts) {
+    SPDLOG_INFO("APU created, but not initialized");
+}
+
+APU::~APU() {
+    SPDLOG_INFO("APU destroyed");
+}
+
+// https://www.nesdev.org/wiki/CPU_power_up_state
+void APU::PowerOn() {
+    SPDLOG_INFO("APU setting power on state");
+
+    pulse1 = Pulse(Channel_Pulse1);
+    pulse2 = Pulse(Channel_Pulse2);
+    triangle = Triangle{};
+    noise = Noise{};
+    noise.period = NoisePeriods[0];
+    dmc = DMC{};
+    dmc.period = DMCPeriods[0];
+
+    cycle = target = 0;
+    stallCycles = 0;
+    frameMode = 0;
+    frameIRQInhibit = false;
+    frameIRQFlag = false;
+    frameStep = 0;
+    frameSequenceStart = 0;
+    UpdateSchedule();
+    interrupts.SetIRQ(InterruptLines::IRQSource_APU, GetIRQCycle());
+
+    std::ranges::fill(levels, 0);
+    pulseIndex = tndIndex = 0;
+    output = 0.0f;
+    resampler.Reset(0);
+}
+
+void APU::Reset() {
+    SPDLOG_INFO("APU resetting");
+
+    Write(APUAddr_STATUS, 0x00);
+    Write(APUAddr_FRAME, static_cast<uint8_t>((frameMode << 7) | (frameIRQInhibit ? 0x40 : 0x00)));
+}
+
+void APU::Tick(size_t cycles) {
+    target += cycles;
+    if (target < nextEvent) {
+        return;
+    }
+
+    // Samples go out with the frame counter, a few times per frame
+    const bool frameEvent = target >= NextFrameEvent();
+    Run(target);
+    if (frameEvent) {
+        DeliverSamples();
+    }
+}
+
+Scheduler::Task APU::Process(const Scheduler& scheduler) {
+    while (true) {
+        // Frame counter steps and DMC fetches run on time, a fetch steals cycles from the
+        // instruction it lands in. Channels wait for the CPU to touch the APU.
+        Tick(scheduler.Now() - target);
+        co_await Scheduler::Yield{ nextEvent };
+    }
+}
+
+uint8_t APU::Read(uint16_t address) {
+    if (address != APUAddr_STATUS) {
+        return 0;
+    }
+
+    Run(target);
+    uint8_t value = Peek(address);
+    frameIRQFlag = false;
+    interrupts.SetIRQ(InterruptLines::IRQSource_APU, GetIRQCycle());
+    return value;
+}
+
+uint8_t APU::Peek(uint16_t address) const {
+    if (address != APUAddr_STATUS) {
+        return 0;
+    }
+    return (pulse1.length ? 0x01 : 0)
+        | (pulse2.length ? 0x02 : 0)
+        | (triangle.length ? 0x04 : 0)
+        | (noise.length ? 0x08 : 0)
+        | (dmc.bytesRemaining ? 0x10 : 0)
+        | (frameIRQFlag ? 0x40 : 0)
+        | (dmc.irqFlag ? 0x80 : 0);
+}
+
+void APU::Write(uint16_t address, uint8_t value) {
+    Run(target);
+
+    switch (address) {
+    case APUAddr_SQ1_VOL:
+    case APUAddr_SQ1_SWEEP:
+    case APUAddr_SQ1_LO:
+    case APUAddr_SQ1_HI:
+        pulse1.Write(address & 0b11, value);
+        break;
+
+    case APUAddr_SQ2_VOL:
+    case APUAddr_SQ2_SWEEP:
+    case APUAddr_SQ2_LO:
+    case APUAddr_SQ2_HI:
+        pulse2.Write(address & 0b11, value);
+        break;
+
+    case APUAddr_TRI_LINEAR:
+    case APUAddr_TRI_LO:
+    case APUAddr_TRI_HI:
+        triangle.Write(address & 0b11, value);
+        break;
+
+    case APUAddr_NOISE_VOL:
+    case APUAddr_NOISE_LO:
+    case APUAddr_NOISE_HI:
+        noise.Write(address & 0b11, value);
+        break;
+
+    case APUAddr_DMC_FREQ:
+    case APUAddr_DMC_RAW:
+    case APUAddr_DMC_START:
+    case APUAddr_DMC_LEN:
+        dmc.Write(address & 0b11, value);
+        break;
+
+    // https://www.nesdev.org/wiki/APU#Status_($4015)
+    case APUAddr_STATUS:
+        pulse1.enabled = value & 0x01;
+        pulse2.enabled = value & 0x02;
+        triangle.enabled = value & 0x04;
+        noise.enabled = value & 0x08;
+        if (!pulse1.enabled) pulse1.length = 0;
+        if (!pulse2.enabled) pulse2.length = 0;
+        if (!triangle.enabled) triangle.length = 0;
+        if (!noise.enabled) noise.length = 0;
+
+        if (!(value & 0x10)) {
+            dmc.bytesRemaining = 0;
+        } else if (!dmc.bytesRemaining) {
+            dmc.Restart();
+            dmc.FillSampleBuffer(cartridge, cycle, DMCLoadStall);
+            stallCycles += std::exchange(dmc.stallCycles, 0);
+        }
+        dmc.irqFlag = false;
+        break;
+
+    // https://www.nesdev.org/wiki/APU_Frame_Counter
+    case APUAddr_FRAME:
+        frameMode = value >> 7;
+        frameIRQInhibit = value & 0x40;
+        if (frameIRQInhibit) {
+            frameIRQFlag = false;
+        }
+        // The sequencer restarts 3 or 4 cycles after the write
+        frameSequenceStart = cycle + ((cycle & 1) ? 4 : 3);
+        frameStep = 0;
+        if (frameMode == 1) {
+            ClockQuarterFrame();
+            ClockHalfFrame();
+        }
+        break;
+
+    default:
+        // $4009 and $400D are unused
+        break;
+    }
+
+    UpdateLevels();
+    UpdateSchedule();
+    interrupts.SetIRQ(InterruptLines::IRQSource_APU, GetIRQCycle());
+}
+
+uint64_t APU::GetIRQCycle() const {
+    uint64_t irq = UINT64_MAX;
+    if (frameIRQFlag) {
+        irq = frameIRQCycle;
+    } else if (frameMode == 0 && !frameIRQInhibit) {
+        irq = frameSequenceStart + FrameStepCycles[0][3];
+    }
+    return std::min(irq, dmc.irqFlag ? dmc.irqCycle : dmc.NextIRQ());
+}
+
+void APU::Run(uint64_t until) {
+    TimelineScope scope("APU batch");
+    while (cycle < until) {
+        const uint64_t frameEvent = NextFrameEvent();
+        const uint64_t next = std::min(until, frameEvent);
+        RunChannels(next);
+        cycle = next;
+        if (cycle == frameEvent) {
+            ClockFrameCounter();
+        }
+    }
+    stallCycles += std::exchange(dmc.stallCycles, 0);
+    UpdateSchedule();
+}
+
+void APU::RunChannels(uint64_t until) {
+    // Every channel's changes come out sorted by time, merge them into one timeline
+    changes.clear();
+    pulse1.Run(until, changes);
+    auto merged = changes.size();
+    pulse2.Run(until, changes);
+    std::inplace_merge(changes.begin(), changes.begin() + merged, changes.end());
+    merged = changes.size();
+    triangle.Run(until, changes);
+    std::inplace_merge(changes.begin(), changes.begin() + merged, changes.end());
+    merged = changes.size();
+    noise.Run(until, changes);
+    std::inplace_merge(changes.begin(), changes.begin() + merged, changes.end());
+    merged = changes.size();
+    dmc.Run(until, changes, cartridge);
+    std::inplace_merge(changes.begin(), changes.begin() + merged, changes.end());
+
+    MixChanges(changes);
+}
+
+void APU::ClockFrameCounter() {
+    ClockQuarterFrame();
+    if (frameStep & 1) {
+        ClockHalfFrame();
+    }
+    if (frameStep == 3 && frameMode == 0 && !frameIRQInhibit && !frameIRQFlag) {
+        frameIRQFlag = true;
+        frameIRQCycle = cycle;
+    }
+
+    frameStep++;
+    if (frameStep == 4) {
+        frameStep = 0;
+        frameSequenceStart += FrameStepCycles[frameMode][3] + 1;
+    }
+
+    UpdateLevels();
+}
+
+void APU::ClockQuarterFrame() {
+    pulse1.envelope.Clock();
+    pulse2.envelope.Clock();
+    noise.envelope.Clock();
+    triangle.ClockLinear();
+}
+
+void APU::ClockHalfFrame() {
+    pulse1.ClockSweepAndLength();
+    pulse2.ClockSweepAndLength();
+    if (!triangle.control && triangle.length) {
+        triangle.length--;
+    }
+    if (!noise.envelope.loop && noise.length) {
+        noise.length--;
+    }
+}
+
+void APU::UpdateLevels() {
+    changes.clear();
+    auto update = [&](Channel channel, uint8_t& level, uint8_t current) {
+        if (current != level) {
+            level = current;
+            changes.push_back({ cycle, channel, current });
+        }
+    };
+    update(Channel_Pulse1, pulse1.level, pulse1.Output());
+    update(Channel_Pulse2, pulse2.level, pulse2.Output());
+    update(Channel_Triangle, triangle.level, triangle.Output());
+    update(Channel_Noise, noise.level, noise.Output());
+    update(Channel_DMC, dmc.level, dmc.Output());
+    MixChanges(changes);
+}
+
+void APU::MixChanges(std::span<const LevelChange> levelChanges) {
+    // Each change only moves one table index, the mix is two loads
+    for (const LevelChange& change : levelChanges) {
+        int delta = (change.level - levels[change.channel]) * MixWeights[change.channel];
+        levels[change.channel] = change.level;
+        if (change.channel <= Channel_Pulse2) {
+            pulseIndex = static_cast<uint8_t>(pulseIndex + delta);
+        } else {
+            tndIndex = static_cast<uint8_t>(tndIndex + delta);
+        }
+
+        float mixed = PulseTable[pulseIndex] + TNDTable[tndIndex];
+        if (mixed != output) {
+            resampler.AddDelta(change.time, mixed - output);
+            output = mixed;
+        }
+    }
+}
+
+void APU::DeliverSamples() {
+    TimelineScope scope("APU samples");
+    resampler.EndFrame(cycle);
+    if (!resampler.GetSampleCount()) {
+        return;
+    }
+    resampler.TakeSamples(samples);
+    if (sampleCallback) {
+        sampleCallback(samples);
+    }
+}
+
+void APU::Envelope::Write(uint8_t value) {
+    loop = value & 0x20;
+    constant = value & 0x10;
+    period = value & 0x0F;
+}
+
+void APU::Envelope::Clock() {
+    if (start) {
+        start = false;
+        decay = 15;
+        divider = period;
+    } else if (divider) {
+        divider--;
+    } else {
+        divider = period;
+        if (decay) {
+            decay--;
+        } else if (loop) {
+            decay = 15;
+        }
+    }
+}
+
+uint16_t APU::Pulse::SweepTarget() const {
+    int change = period >> sweepShift;
+    if (sweepNegate) {
+        // Pulse 1 negates with ones' complement
+        change = -change - (channel == Channel_Pulse1 ? 1 : 0);
+    }
+    return static_cast<uint16_t>(std::max(0, period + change));
+}
+
+uint8_t APU::Pulse::Output() const {
+    return (length && !IsMuted() && DutyTable[duty][sequence]) ? envelope.Volume() : 0;
+}
+
+void APU::Pulse::Write(uint16_t reg, uint8_t value) {
+    switch (reg) {
+    case 0:
+        duty = value >> 6;
+        envelope.Write(value);
+        break;
+    case 1:
+        sweepEnabled = value & 0x80;
+        sweepPeriod = (value >> 4) & 0b111;
+        sweepNegate = value & 0x08;
+        sweepShift = value & 0b111;
+        sweepReload = true;
+        break;
+    case 2:
+        period = (period & 0x0700) | value;
+        break;
+    case 3:
+        period = (period & 0x00FF) | ((value & 0b111) << 8);
+        if (enabled) {
+            length = LengthTable[value >> 3];
+        }
+        sequence = 0;
+        envelope.start = true;
+        break;
+    }
+}
+
+void APU::Pulse::ClockSweepAndLength() {
+    if (!sweepDivider && sweepEnabled && sweepShift && !IsMuted()) {
+        period = SweepTarget();
+    }
+    if (!sweepDivider || sweepReload) {
+        sweepDivider = sweepPeriod;
+        sweepReload = false;
+    } else {
+        sweepDivider--;
+    }
+
+    if (!envelope.loop && length) {
+        length--;
+    }
+}
+
+void APU::Pulse::Run(uint64_t until, Changes& changes) {
+    // The timer counts APU cycles, two CPU cycles each
+    const uint64_t clocks = (period + 1) * 2;
+    const uint8_t volume = envelope.Volume();
+
+    // Audible pulses jump from one duty flip to the next, silent ones skip the whole batch
+    if (length && !IsMuted() && volume) {
+        while (true) {
+            uint8_t run = DutyRuns[duty][sequence];
+            uint64_t flip = nextClock + (run - 1) * clocks;
+            if (flip >= until) {
+                break;
+            }
+            sequence = (sequence + run) & 7;
+            nextClock = flip + clocks;
+            level = DutyTable[duty][sequence] ? volume : 0;
+            changes.push_back({ flip, channel, level });
+        }
+    }
+
+    auto steps = StepsUntil(nextClock, until, clocks);
+    sequence = (sequence + steps) & 7;
+    nextClock += steps * clocks;
+}
+
+uint8_t APU::Triangle::Output() const {
+    return TriangleSequence[sequence];
+}
+
+void APU::Triangle::Write(uint16_t reg, uint8_t value) {
+    switch (reg) {
+    case 0:
+        control = value & 0x80;
+        linearPeriod = value & 0x7F;
+        break;
+    case 2:
+        period = (period & 0x0700) | value;
+        break;
+    case 3:
+        period = (period & 0x00FF) | ((value & 0b111) << 8);
+        if (enabled) {
+            length = LengthTable[value >> 3];
+        }
+        linearReload = true;
+        break;
+    }
+}
+
+void APU::Triangle::ClockLinear() {
+    if (linearReload) {
+        linearCounter = linearPeriod;
+    } else if (linearCounter) {
+        linearCounter--;
+    }
+    if (!control) {
+        linearReload = false;
+    }
+}
+
+void APU::Triangle::Run(uint64_t until, Changes& changes) {
+    const uint64_t clocks = period + 1;
+
+    // A halted sequencer holds its level while the timer keeps running
+    if (!IsStepping()) {
+        nextClock += StepsUntil(nextClock, until, clocks) * clocks;
+        return;
+    }
+
+    for (; nextClock < until; nextClock += clocks) {
+        sequence = (sequence + 1) & 31;
+        // The waveform repeats 0 and 15 at its turning points
+        if (TriangleSequence[sequence] != level) {
+            level = TriangleSequence[sequence];
+            changes.push_back({ nextClock, Channel_Triangle, level });
+        }
+    }
+}
+
+uint8_t APU::Noise::Output() const {
+    return (length && !(shiftRegister & 1)) ? envelope.Volume() : 0;
+}
+
+void APU::Noise::Write(uint16_t reg, uint8_t value) {
+    switch (reg) {
+    case 0:
+        envelope.Write(value);
+        break;
+    case 2:
+        shortMode = value & 0x80;
+        period = NoisePeriods[value & 0x0F];
+        break;
+    case 3:
+        if (enabled) {
+            length = LengthTable[value >> 3];
+        }
+        envelope.start = true;
+        break;
+    }
+}
+
+void APU::Noise::Run(uint64_t until, Changes& changes) {
+    const int tap = shortMode ? 6 : 1;
+    const uint8_t volume = length ? envelope.Volume() : 0;
+
+    // The shift register keeps running while silent, but there is nothing to report
+    if (!volume) {
+        for (; nextClock < until; nextClock += period) {
+            uint16_t feedback = (shiftRegister ^ (shiftRegister >> tap)) & 1;
+            shiftRegister = (shiftRegister >> 1) | (feedback << 14);
+        }
+        return;
+    }
+
+    for (; nextClock < until; nextClock += period) {
+        uint16_t feedback = (shiftRegister ^ (shiftRegister >> tap)) & 1;
+        shiftRegister = (shiftRegister >> 1) | (feedback << 14);
+        uint8_t current = (shiftRegister & 1) ? 0 : volume;
+        if (current != level) {
+            level = current;
+            changes.push_back({ nextClock, Channel_Noise, level });
+        }
+    }
+}
+
+void APU::DMC::Write(uint16_t reg, uint8_t value) {
+    switch (reg) {
+    case 0:
+        irqEnabled = value & 0x80;
+        if (!irqEnabled) {
+            irqFlag = false;
+        }
+        loop = value & 0x40;
+        period = DMCPeriods[value & 0x0F];
+        break;
+    case 1:
+        outputLevel = value & 0x7F;
+        break;
+    case 2:
+        sampleAddress = 0xC000 + value * 64;
+        break;
+    case 3:
+        sampleLength = value * 16 + 1;
+        break;
+    }
+}
+
+void APU::DMC::Restart() {
+    currentAddress = sampleAddress;
+    bytesRemaining = sampleLength;
+}
+
+uint64_t APU::DMC::NextFetch() const {
+    // The buffer is refilled as soon as it empties, so it is only empty with nothing left
+    if (!sampleBuffer || !bytesRemaining) {
+        return UINT64_MAX;
+    }
+    return nextClock + (bitsRemaining - 1) * period;
+}
+
+uint64_t APU::DMC::NextIRQ() const {
+    if (!irqEnabled || loop || !bytesRemaining || !sampleBuffer) {
+        return UINT64_MAX;
+    }
+    // One byte per 8 output clocks after the next fetch
+    return NextFetch() + (bytesRemaining - 1) * 8 * period;
+}
+
+void APU::DMC::FillSampleBuffer(Cartridge& cartridge, uint64_t time, size_t stall) {
+    if (sampleBuffer || !bytesRemaining) {
+        return;
+    }
+
+    sampleBuffer = cartridge.Read(currentAddress);
+    stallCycles += stall;
+    currentAddress = currentAddress == 0xFFFF ? 0x8000 : currentAddress + 1;
+    if (--bytesRemaining == 0) {
+        if (loop) {
+            Restart();
+        } else if (irqEnabled && !irqFlag) {
+            irqFlag = true;
+            irqCycle = time;
+        }
+    }
+}
+
+void APU::DMC::Run(uint64_t until, Changes& changes, Cartridge& cartridge) {
+    // Nothing left to play, only the bit counter moves
+    if (silence && !sampleBuffer) {
+        auto steps = StepsUntil(nextClock, until, period);
+        bitsRemaining = static_cast<uint8_t>((bitsRemaining + 7 - steps % 8) % 8 + 1);
+        nextClock += steps * period;
+        return;
+    }
+
+    for (; nextClock < until; nextClock += period) {
+        if (!silence) {
+            if (shiftRegister & 1) {
+                if (outputLevel <= 125) {
+                    outputLevel += 2;
+                }
+            } else if (outputLevel >= 2) {
+                outputLevel -= 2;
+            }
+        }
+        shiftRegister >>= 1;
+
+        if (--bitsRemaining == 0) {
+            bitsRemaining = 8;
+            silence = !sampleBuffer;
+            if (sampleBuffer) {
+                shiftRegister = *sampleBuffer;
+                sampleBuffer.reset();
+                FillSampleBuffer(cartridge, nextClock, DMCReloadStall);
+            }
+        }
+
+        if (outputLevel != level) {
+            level = outputLevel;
+            changes.push_back({ nextClock, Channel_DMC, level });
+        }
+    }
+}
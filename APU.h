@@ -1,16 +1,58 @@
+#pragma once
+
+#include "pch.h"
+
+#include "Cartridge.h"
+#include "Interrupts.h"
+#include "Resampler.h"
+#include "Scheduler.h"
+
+#include <array>
+#include <functional>
+#include <optional>
+#include <span>
+#include <utility>
+
+// NES APU with two pulse channels, triangle, noise and DMC.
+//
+// Nothing runs per cycle. Tick only advances the clock, the channels catch up in one batch
+// when a register is accessed or a scheduled event is due: a frame counter step or a DMC
+// sample fetch, which steals CPU cycles. Within a batch each channel
+// jumps from one change of its output level to the next, silent channels skip the whole
+// batch at once, and only the level changes are mixed and resampled.
+// https://www.nesdev.org/wiki/APU
 class APU {
 public:
-    APU();
+    APU(Cartridge& cartridge, InterruptLines& interrupts);
     ~APU();
 
     void PowerOn();
     void Reset();
 
-    void Step();
+    // Advance the APU clock by the given number of CPU cycles
+    void Tick(size_t cycles);
+    // The APU as a coroutine of the scheduler, it keeps up with the master clock by itself
+    Scheduler::Task Process(const Scheduler& scheduler);
 
     uint8_t Read(uint16_t address);
+    // Read without clearing the frame interrupt, for tracing
+    uint8_t Peek(uint16_t address) const;
     void Write(uint16_t address, uint8_t value);
 
+    // The IRQ line is the frame and DMC interrupt flags combined. Returns the CPU cycle from
+    // which it is asserted, or is scheduled to be, UINT64_MAX if never. Only APU register
+    // accesses change it, each of them passes it on to the interrupt lines.
+    uint64_t GetIRQCycle() const;
+
+    // CPU cycles stolen by DMC sample fetches since the last call
+    size_t TakeStallCycles() { return std::exchange(stallCycles, 0); }
+
+    // Called on the emulation thread with new 16-bit mono samples, about four times per frame
+    using SampleCallback = std::function<void(std::span<const int16_t>)>;
+    void SetSampleCallback(SampleCallback callback) { sampleCallback = std::move(callback); }
+    void SetSampleRate(double sampleRate) { resampler.SetSampleRate(sampleRate); }
+    void SetRateAdjust(double factor) { resampler.SetRateAdjust(factor); }
+
     enum APUAddr : Addr {
         APUAddr_SQ1_VOL = 0x4000,
         APUAddr_SQ1_SWEEP = 0x4001,
@@ -34,4 +76,229 @@ public:
         APUAddr_FRAME = 0x4017
     };
 
-};
\ No newline at end of file
+private:
+    enum Channel : uint8_t {
+        Channel_Pulse1,
+        Channel_Pulse2,
+        Channel_Triangle,
+        Channel_Noise,
+        Channel_DMC,
+        Channel_Count
+    };
+
+    // A channel's output level changed at the given CPU cycle
+    struct LevelChange {
+        uint64_t time;
+        Channel channel;
+        uint8_t level;
+
+        bool operator<(const LevelChange& other) const { return time < other.time; }
+    };
+    using Changes = std::vector<LevelChange>;
+
+    // https://www.nesdev.org/wiki/APU_Envelope
+    struct Envelope {
+        bool start = false;
+        bool loop = false;     // Also halts the length counter
+        bool constant = false;
+        uint8_t period = 0;    // Also the constant volume
+        uint8_t divider = 0;
+        uint8_t decay = 0;
+
+        void Write(uint8_t value);
+        void Clock();
+        uint8_t Volume() const { return constant ? period : decay; }
+    };
+
+    // https://www.nesdev.org/wiki/APU_Pulse
+    struct Pulse {
+        explicit Pulse(Channel channel) : channel(channel) {}
+
+        Channel channel;
+        uint8_t duty = 0;
+        uint8_t sequence = 0;
+        uint16_t period = 0;
+        uint64_t nextClock = 0; // CPU cycle of the next sequencer step
+        Envelope envelope;
+        uint8_t length = 0;
+        bool enabled = false;
+
+        // https://www.nesdev.org/wiki/APU_Sweep
+        bool sweepEnabled = false;
+        bool sweepNegate = false;
+        bool sweepReload = false;
+        uint8_t sweepPeriod = 0;
+        uint8_t sweepShift = 0;
+        uint8_t sweepDivider = 0;
+
+        uint8_t level = 0;
+
+        uint16_t SweepTarget() const;
+        bool IsMuted() const { return period < 8 || SweepTarget() > 0x7FF; }
+        uint8_t Output() const;
+
+        void Write(uint16_t reg, uint8_t value);
+        void ClockSweepAndLength();
+        void Run(uint64_t until, Changes& changes);
+    };
+
+    // https://www.nesdev.org/wiki/APU_Triangle
+    struct Triangle {
+        uint8_t sequence = 0;
+        uint16_t period = 0;
+        uint64_t nextClock = 0;
+        uint8_t length = 0;
+        bool enabled = false;
+        bool control = false; // Also halts the length counter
+        bool linearReload = false;
+        uint8_t linearPeriod = 0;
+        uint8_t linearCounter = 0;
+
+        uint8_t level = 0;
+
+        // Periods below 2 are ultrasonic, treated as holding the current level
+        bool IsStepping() const { return length && linearCounter && period >= 2; }
+        uint8_t Output() const;
+
+        void Write(uint16_t reg, uint8_t value);
+        void ClockLinear();
+        void Run(uint64_t until, Changes& changes);
+    };
+
+    // https://www.nesdev.org/wiki/APU_Noise
+    struct Noise {
+        bool shortMode = false;
+        uint16_t shiftRegister = 1;
+        uint16_t period = 0;
+        uint64_t nextClock = 0;
+        Envelope envelope;
+        uint8_t length = 0;
+        bool enabled = false;
+
+        uint8_t level = 0;
+
+        uint8_t Output() const;
+
+        void Write(uint16_t reg, uint8_t value);
+        void Run(uint64_t until, Changes& changes);
+    };
+
+    // https://www.nesdev.org/wiki/APU_DMC
+    struct DMC {
+        bool irqEnabled = false;
+        bool loop = false;
+        uint16_t period = 0;
+        uint64_t nextClock = 0;
+
+        // Memory reader
+        uint16_t sampleAddress = 0xC000;
+        uint16_t sampleLength = 1;
+        uint16_t currentAddress = 0xC000;
+        uint16_t bytesRemaining = 0;
+        std::optional<uint8_t> sampleBuffer;
+
+        // Output unit
+        uint8_t shiftRegister = 0;
+        uint8_t bitsRemaining = 8;
+        bool silence = true;
+        uint8_t outputLevel = 0;
+
+        bool irqFlag = false;
+        uint64_t irqCycle = 0;
+        uint8_t level = 0;
+
+        // CPU cycles the fetches in FillSampleBuffer stole
+        size_t stallCycles = 0;
+
+        uint8_t Output() const { return outputLevel; }
+        // CPU cycle at which the output unit takes the sample buffer and the next byte is
+        // fetched, UINT64_MAX if nothing is left to fetch
+        uint64_t NextFetch() const;
+        // CPU cycle the last byte is fetched and the interrupt flag set, UINT64_MAX if never
+        uint64_t NextIRQ() const;
+
+        void Write(uint16_t reg, uint8_t value);
+        void Restart();
+        void FillSampleBuffer(Cartridge& cartridge, uint64_t time, size_t stall);
+        void Run(uint64_t until, Changes& changes, Cartridge& cartridge);
+    };
+
+    // Catch every channel up to the given CPU cycle
+    void Run(uint64_t until);
+    void RunChannels(uint64_t until);
+    // Frame counter step at the current cycle, see FrameStepCycles
+    void ClockFrameCounter();
+    void ClockQuarterFrame();
+    void ClockHalfFrame();
+    uint64_t NextFrameEvent() const { return frameSequenceStart + FrameStepCycles[frameMode][frameStep]; }
+    // Earliest event Tick has to catch up for
+    void UpdateSchedule() { nextEvent = std::min(NextFrameEvent(), dmc.NextFetch()); }
+
+    // Push level changes caused by register writes or frame counter clocks at the current cycle
+    void UpdateLevels();
+    // Mix the channel levels and hand changes of the output to the resampler
+    void MixChanges(std::span<const LevelChange> changes);
+    void DeliverSamples();
+
+    // Nonlinear mixer as two tables, indexed by pulse1 + pulse2 and 3 * triangle + 2 * noise + DMC
+    // https://www.nesdev.org/wiki/APU_Mixer#Lookup_Table
+    static constexpr auto PulseTable = [] {
+        std::array<float, 31> table{};
+        for (size_t n = 1; n < table.size(); ++n) {
+            table[n] = 95.52f / (8128.0f / n + 100.0f);
+        }
+        return table;
+    }();
+    static constexpr auto TNDTable = [] {
+        std::array<float, 203> table{};
+        for (size_t n = 1; n < table.size(); ++n) {
+            table[n] = 163.67f / (24329.0f / n + 100.0f);
+        }
+        return table;
+    }();
+    // Weight of each channel's level in its table index
+    static constexpr uint8_t MixWeights[Channel_Count] = { 1, 1, 3, 2, 1 };
+
+    // https://www.nesdev.org/wiki/APU_Frame_Counter, in CPU cycles for 4 and 5 step mode
+    static constexpr uint32_t FrameStepCycles[2][4] = {
+        { 7457, 14913, 22371, 29829 },
+        { 7457, 14913, 22371, 37281 }
+    };
+
+    // https://www.nesdev.org/wiki/DMA#DMC_DMA, the CPU is halted for 3 cycles on a load
+    // started by $4015 and 4 on a reload during playback. Halting on a CPU write cycle or
+    // during OAM DMA can shorten both, which isn't modeled.
+    static constexpr size_t DMCLoadStall = 3;
+    static constexpr size_t DMCReloadStall = 4;
+
+    Cartridge& cartridge;
+    InterruptLines& interrupts;
+
+    Pulse pulse1{ Channel_Pulse1 };
+    Pulse pulse2{ Channel_Pulse2 };
+    Triangle triangle;
+    Noise noise;
+    DMC dmc;
+
+    uint64_t cycle = 0;   // CPU cycle the channels have been run up to
+    uint64_t target = 0;  // CPU cycle the APU clock is at, ahead of cycle between syncs
+    uint64_t nextEvent = 0;
+    size_t stallCycles = 0;
+
+    uint8_t frameMode = 0;
+    bool frameIRQInhibit = false;
+    bool frameIRQFlag = false;
+    uint64_t frameIRQCycle = 0;
+    uint8_t frameStep = 0;
+    uint64_t frameSequenceStart = 0;
+
+    uint8_t levels[Channel_Count] = {};
+    uint8_t pulseIndex = 0;
+    uint8_t tndIndex = 0;
+    float output = 0.0f;
+    Changes changes;
+
+    Resampler resampler;
+    std::vector<int16_t> samples;
+    SampleCallback sampleCallback;
+};
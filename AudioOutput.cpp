@@ -0,0 +1,230 @@
+#include "AudioOutput.h"
+
+#include "Timeline.h"
+
+#include <algorithm>
+#include <bit>
+#include <csignal>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+SampleRing::SampleRing(size_t capacity) {
+    VERIFY(std::has_single_bit(capacity), "Sample ring capacity must be a power of two", capacity);
+    buffer = std::make_unique<int16_t[]>(capacity);
+    mask = capacity - 1;
+}
+
+size_t SampleRing::Write(std::span<const int16_t> samples) {
+    const uint64_t write = writePosition.load(std::memory_order_relaxed);
+    const uint64_t read = readPosition.load(std::memory_order_acquire);
+    const size_t count = std::min(samples.size(), Capacity() - static_cast<size_t>(write - read));
+
+    // At most two copies, before and after the wrap
+    const size_t start = write & mask;
+    const size_t first = std::min(count, Capacity() - start);
+    std::memcpy(&buffer[start], samples.data(), first * sizeof(int16_t));
+    std::memcpy(&buffer[0], samples.data() + first, (count - first) * sizeof(int16_t));
+
+    if (count) {
+        writePosition.store(write + count, std::memory_order_release);
+    }
+    return count;
+}
+
+size_t SampleRing::Read(int16_t* out, size_t count) {
+    const uint64_t read = readPosition.load(std::memory_order_relaxed);
+    const uint64_t write = writePosition.load(std::memory_order_acquire);
+    count = std::min(count, static_cast<size_t>(write - read));
+
+    const size_t start = read & mask;
+    const size_t first = std::min(count, Capacity() - start);
+    std::memcpy(out, &buffer[start], first * sizeof(int16_t));
+    std::memcpy(out + first, &buffer[0], (count - first) * sizeof(int16_t));
+
+    if (count) {
+        readPosition.store(read + count, std::memory_order_release);
+        readPosition.notify_one();
+    }
+    return count;
+}
+
+RawSink::RawSink(const char* path) : file(path, std::ios::binary) {
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to open audio output {}", path));
+    }
+}
+
+void RawSink::Write(std::span<const int16_t> samples) {
+    file.write(reinterpret_cast<const char*>(samples.data()), samples.size_bytes());
+    if (!file) {
+        throw std::runtime_error("Failed to write audio output");
+    }
+}
+
+WavSink::WavSink(const char* path, uint32_t sampleRate) : RawSink(path), sampleRate(sampleRate) {
+    WriteHeader(0);
+}
+
+WavSink::~WavSink() {
+    // RIFF sizes are 32 bit
+    file.seekp(0);
+    WriteHeader(static_cast<uint32_t>(std::min<uint64_t>(dataBytes, UINT32_MAX - 36)));
+    SPDLOG_INFO("Wrote {} audio samples", dataBytes / sizeof(int16_t));
+}
+
+void WavSink::Write(std::span<const int16_t> samples) {
+    RawSink::Write(samples);
+    dataBytes += samples.size_bytes();
+}
+
+void WavSink::WriteHeader(uint32_t dataSize) {
+    constexpr uint16_t Channels = 1;
+    constexpr uint16_t BitsPerSample = 16;
+    constexpr uint16_t BlockAlign = Channels * BitsPerSample / 8;
+
+    // Little endian fields, all naturally aligned so there is no padding
+    struct {
+        char riff[4] = { 'R', 'I', 'F', 'F' };
+        uint32_t riffSize;
+        char wave[4] = { 'W', 'A', 'V', 'E' };
+        char fmt[4] = { 'f', 'm', 't', ' ' };
+        uint32_t fmtSize = 16;
+        uint16_t format = 1; // PCM
+        uint16_t channels = Channels;
+        uint32_t sampleRate;
+        uint32_t byteRate;
+        uint16_t blockAlign = BlockAlign;
+        uint16_t bitsPerSample = BitsPerSample;
+        char data[4] = { 'd', 'a', 't', 'a' };
+        uint32_t dataSize;
+    } header;
+    static_assert(sizeof(header) == 44);
+
+    header.riffSize = 36 + dataSize;
+    header.sampleRate = sampleRate;
+    header.byteRate = sampleRate * BlockAlign;
+    header.dataSize = dataSize;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+PipeSink::PipeSink(const char* command) : pipe(popen(command, "w")) {
+    if (!pipe) {
+        throw std::runtime_error(fmt::format("Failed to start audio player {}", command));
+    }
+#ifndef _WIN32
+    // Writing to a player that exited fails with EPIPE instead
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+}
+
+PipeSink::~PipeSink() {
+    pclose(pipe);
+}
+
+void PipeSink::Write(std::span<const int16_t> samples) {
+    if (std::fwrite(samples.data(), sizeof(int16_t), samples.size(), pipe) != samples.size()) {
+        throw std::runtime_error("Failed to write to audio player");
+    }
+}
+
+AudioOutput::AudioOutput(std::unique_ptr<AudioSink> sink, bool realTime, size_t capacity) :
+    ring(capacity),
+    sink(std::move(sink)),
+    realTime(realTime),
+    consumer(&AudioOutput::ConsumerLoop, this) {
+}
+
+AudioOutput::~AudioOutput() {
+    try {
+        Close();
+    } catch (const std::exception& e) {
+        SPDLOG_ERROR("Audio output failed: {}", e.what());
+    }
+}
+
+void AudioOutput::Close() {
+    if (!consumer.joinable()) {
+        return;
+    }
+    stopping.store(true, std::memory_order_release);
+    signal.fetch_add(1, std::memory_order_release);
+    signal.notify_one();
+    consumer.join();
+    if (droppedSamples) {
+        SPDLOG_WARN("Audio output dropped {} samples", droppedSamples);
+    }
+    RethrowSinkError();
+}
+
+void AudioOutput::RethrowSinkError() {
+    // Reported once, later pushes go to the audio thread which discards them
+    if (sinkFailed.load(std::memory_order_acquire) && sinkError) {
+        std::rethrow_exception(std::exchange(sinkError, nullptr));
+    }
+}
+
+void AudioOutput::Push(std::span<const int16_t> samples) {
+    TimelineScope scope("Audio push");
+    RethrowSinkError();
+    while (!samples.empty()) {
+        const uint64_t read = ring.ReadPosition();
+        size_t written = ring.Write(samples);
+        samples = samples.subspan(written);
+        if (written) {
+            signal.fetch_add(1, std::memory_order_release);
+            signal.notify_one();
+        }
+        if (samples.empty()) {
+            break;
+        }
+
+        if (realTime) {
+            droppedSamples += samples.size();
+            break;
+        }
+        // Lossless, wait for the sink to catch up
+        ring.WaitForRead(read);
+    }
+}
+
+double AudioOutput::GetRateAdjust() const {
+    if (!realTime) {
+        return 1.0;
+    }
+    // Below half full produce more samples per emulated second, above half fewer
+    double fill = static_cast<double>(ring.Size()) / ring.Capacity();
+    return 1.0 + MaxRateAdjust * std::clamp((0.5 - fill) * 2.0, -1.0, 1.0);
+}
+
+void AudioOutput::ConsumerLoop() {
+    // Large chunks keep the sink at a few writes per frame at most
+    std::vector<int16_t> chunk(16384);
+    Timeline::SetThreadName("Audio output");
+    while (true) {
+        const uint32_t pushed = signal.load(std::memory_order_acquire);
+        size_t count = ring.Read(chunk.data(), chunk.size());
+        if (count) {
+            // After a failure keep draining so a waiting producer gets to see it
+            if (sinkFailed.load(std::memory_order_relaxed)) {
+                continue;
+            }
+            TimelineScope scope("Audio write");
+            try {
+                sink->Write({ chunk.data(), count });
+            } catch (...) {
+                sinkError = std::current_exception();
+                sinkFailed.store(true, std::memory_order_release);
+            }
+            continue;
+        }
+        if (stopping.load(std::memory_order_acquire)) {
+            return;
+        }
+        signal.wait(pushed, std::memory_order_acquire);
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "pch.h"
+
+#include <atomic>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <thread>
+
+// Lock-free single producer, single consumer ring of 16-bit samples.
+//
+// The producer only moves the write position and the consumer only moves the read
+// position, each on its own cache line. Capacity is a power of two so positions can run
+// freely and wrap with a mask.
+class SampleRing {
+public:
+    SampleRing(size_t capacity);
+
+    SampleRing(const SampleRing&) = delete;
+    SampleRing& operator=(const SampleRing&) = delete;
+
+    size_t Capacity() const { return mask + 1; }
+    size_t Size() const {
+        return static_cast<size_t>(writePosition.load(std::memory_order_acquire) - readPosition.load(std::memory_order_acquire));
+    }
+
+    // Producer side, returns how many samples fit
+    size_t Write(std::span<const int16_t> samples);
+    // Block the producer until the consumer has read past the given position
+    void WaitForRead(uint64_t position) const { readPosition.wait(position, std::memory_order_acquire); }
+    uint64_t ReadPosition() const { return readPosition.load(std::memory_order_acquire); }
+
+    // Consumer side, returns how many samples were read
+    size_t Read(int16_t* out, size_t count);
+
+private:
+    std::unique_ptr<int16_t[]> buffer;
+    size_t mask;
+
+    alignas(64) std::atomic<uint64_t> writePosition{ 0 };
+    alignas(64) std::atomic<uint64_t> readPosition{ 0 };
+};
+
+// Destination for mono 16-bit samples, written from the audio thread only
+class AudioSink {
+public:
+    virtual ~AudioSink() = default;
+    virtual void Write(std::span<const int16_t> samples) = 0;
+};
+
+// Raw little endian PCM to a file
+class RawSink : public AudioSink {
+public:
+    RawSink(const char* path);
+    void Write(std::span<const int16_t> samples) override;
+
+protected:
+    std::ofstream file;
+};
+
+// PCM WAV file, sizes in the header are filled in when the sink is destroyed
+// http://soundfile.sapp.org/doc/WaveFormat/
+class WavSink : public RawSink {
+public:
+    WavSink(const char* path, uint32_t sampleRate);
+    ~WavSink();
+    void Write(std::span<const int16_t> samples) override;
+
+private:
+    void WriteHeader(uint32_t dataBytes);
+
+    uint32_t sampleRate;
+    uint64_t dataBytes = 0;
+};
+
+// Raw PCM to the standard input of an external player, for example "aplay -f S16_LE -r 48000".
+// A player that exits makes Write throw instead of the process dying of SIGPIPE.
+class PipeSink : public AudioSink {
+public:
+    PipeSink(const char* command);
+    ~PipeSink();
+    void Write(std::span<const int16_t> samples) override;
+
+private:
+    std::FILE* pipe;
+};
+
+// Moves samples from the emulation thread to a sink on its own thread.
+//
+// Lossless outputs (files) make Push wait whenever the ring is full, which only happens if
+// the disk can't keep up. Real-time outputs never wait: they drop what doesn't fit and
+// instead steer the resampling rate within +-0.5% to keep the ring half full, absorbing
+// the drift between the emulated and the playback clock.
+//
+// If the sink throws, the audio thread stores the error and discards samples from then on.
+// Push or Close rethrow it on the emulation thread.
+class AudioOutput {
+public:
+    AudioOutput(std::unique_ptr<AudioSink> sink, bool realTime, size_t capacity = 1 << 16);
+    // Closes if that wasn't done yet, logging a sink error instead of throwing it
+    ~AudioOutput();
+
+    // Emulation thread
+    void Push(std::span<const int16_t> samples);
+    // Drains the ring into the sink and stops the audio thread
+    void Close();
+    // Factor for the resampler's output rate, 1.0 for lossless outputs
+    double GetRateAdjust() const;
+    uint64_t GetDroppedSamples() const { return droppedSamples; }
+
+    static constexpr double MaxRateAdjust = 0.005;
+
+private:
+    void ConsumerLoop();
+    void RethrowSinkError();
+
+    SampleRing ring;
+    std::unique_ptr<AudioSink> sink;
+    bool realTime;
+    uint64_t droppedSamples = 0;
+
+    // Bumped after every push and on shutdown, the consumer sleeps on it
+    std::atomic<uint32_t> signal{ 0 };
+    std::atomic<bool> stopping{ false };
+    // Written by the audio thread before setting sinkFailed, taken by the emulation thread
+    std::exception_ptr sinkError;
+    std::atomic<bool> sinkFailed{ false };
+    std::thread consumer;
+};
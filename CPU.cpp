@@ -1,16 +1,32 @@
 #include "CPU.h"
 
+#include "Timeline.h"
+
 #include <fmt/format.h>
 
+#include <utility>
+
 // https://www.nesdev.org/wiki/CPU_power_up_state#At_power-up
-void CPU::PowerOn() {
+template <CPUCore Core>
+void CPU<Core>::PowerOn() {
     SPDLOG_INFO("CPU power up");
 
+    if (nesTestLogEnabled && !nesTestOutput.is_open()) {
+        nesTestOutput.open("nestest.log", std::ofstream::out);
+    }
+
+    // The other components restart their clocks too, the sequence below brings it to 7
+    cycles = 0;
+    busCycles = 0;
+
     P = 0x24; // IRQ Disabled
     A = 0x00;
     X = 0x00;
     Y = 0x00;
     S = 0xFD;
+    polledInterruptDisable.reset();
+    stoppedAt.reset();
+    ResetHangState();
 
     mmu.Write(0x4015, 0x00);
     mmu.Write(0x4017, 0x00);
@@ -28,17 +44,40 @@ void CPU::PowerOn() {
     Tick(7);
 }
 // https://www.nesdev.org/wiki/CPU_power_up_state#After_reset
-void CPU::Reset() {
+template <CPUCore Core>
+void CPU<Core>::Reset() {
     S -= 3;
     P |= 0x04;
+    polledInterruptDisable.reset();
+    stoppedAt.reset();
+    ResetHangState();
     ReadResetVector();
 }
-void CPU::Execute() {
+template <CPUCore Core>
+void CPU<Core>::ResetHangState() {
+    jamAddress.reset();
+    spinAddress = 0;
+    spinStart = spinEnd = 0;
+}
+template <CPUCore Core>
+void CPU<Core>::Execute() {
+    if (IsDebugging()) [[unlikely]] {
+        if (CheckExecute()) {
+            return;
+        }
+    }
+
     // Save the offset before PC gets messed with
     const auto instrOffset = PC;
+    const size_t startCycles = cycles;
+    // Before the cycle core ticks the opcode fetch, the logs show where the instruction starts
+    if (nesTestLogEnabled || traceWriter) {
+        SamplePPU();
+    }
 
     // Read opcode
-    auto opcode = mmu.Read(PC);
+    auto opcode = Read(PC, CoverageFlag_Opcode);
+    Counters::CountInstruction(opcode);
 
     // Read addressing mode
     auto addrMode = InstrDataTable[opcode].mode;
@@ -50,8 +89,18 @@ void CPU::Execute() {
     // Decode addressing mode and fill operands
     FetchOperands(addrMode, opcode, instrOffset);
 
+    // Read-modify-write instructions write the unmodified value back first
+    if (ReadModifyWrite[opcode]) {
+        DummyWrite(operandAddr, operand);
+    }
+
     // Print NESTest line for diffing/debugging
-    PrintNESTestLine(instrOffset);
+    if (nesTestLogEnabled) {
+        PrintNESTestLine(opcode, instrOffset);
+    }
+    if (traceWriter) [[unlikely]] {
+        WriteTraceRecord(opcode, instrOffset);
+    }
 
     // Execute instruction
     ExecInstr(opcode);
@@ -59,28 +108,193 @@ void CPU::Execute() {
     UpdateOperands(addrMode, opcode);
 
     UpdateCycleCount(addrMode, opcode);
+
+    // DMA halts the CPU, with an extra alignment cycle when starting on an odd cycle
+    if (auto stallCycles = mmu.TakeStallCycles()) {
+        stallCycles += cycles & 1;
+        Counters::Count(Counter_OAMDMACycles, stallCycles);
+        Tick(stallCycles);
+    }
+    // DMC sample fetches scheduled within the instruction
+    if (auto stallCycles = apu.TakeStallCycles()) {
+        Counters::Count(Counter_DMCDMACycles, stallCycles);
+        Tick(stallCycles);
+    }
+
+    ProfileInstruction(opcode, instrOffset, cycles - startCycles);
+
+    // Jumping to itself right after the previous one did continues the spin
+    if (PC == instrOffset) [[unlikely]] {
+        if (spinEnd != startCycles || spinAddress != instrOffset) {
+            spinAddress = instrOffset;
+            spinStart = startCycles;
+        }
+        spinEnd = cycles;
+    }
+}
+template <CPUCore Core>
+void CPU<Core>::SamplePPU() {
+    // The coroutine engine's PPU lags behind until synced
+    if (scheduler) {
+        scheduler->Sync();
+    }
+    instrPPU = { ppu.GetScanline(), ppu.GetDot(), ppu.GetFrameNumber() };
 }
-void CPU::Run() {
+template <CPUCore Core>
+void CPU<Core>::Run() {
+    running = true;
+    // Resuming at the breakpoint that stopped the CPU runs its instruction instead of
+    // triggering it again
+    resumingBreak = stoppedAt == PC;
+    stoppedAt.reset();
     while (running) {
-        Execute();
+        // Instructions before the interrupt deadline run without looking at the lines
+        {
+            TimelineScope scope("CPU");
+            while (cycles < interrupts.GetDeadline()) {
+                Execute();
+            }
+        }
+        if (running) {
+            PollInterrupts();
+        }
     }
+    resumingBreak = false;
 }
-void CPU::Pause() {
+template <CPUCore Core>
+void CPU<Core>::Pause() {
     running = false;
+    // Leave the instruction loop
+    interrupts.ForcePoll();
 }
-void CPU::ReadResetVector() {
+template <CPUCore Core>
+void CPU<Core>::SetNESTestLogEnabled(bool enabled) {
+    nesTestLogEnabled = enabled;
+}
+template <CPUCore Core>
+void CPU<Core>::ReadResetVector() {
     // Little Endian
-    PC = 0xC000;
+    PC = entryPoint ? *entryPoint : mmu.Read(Addr_Reset) | (mmu.Read(Addr_Reset + 1) << 8);
     SPDLOG_TRACE(fmt::runtime("PC initialized from reset vector to {:#x}"), PC);
 }
 
-void CPU::Push(uint8_t value) {
+// https://www.nesdev.org/wiki/CPU_interrupts#Detailed_interrupt_behavior
+template <CPUCore Core>
+void CPU<Core>::PollInterrupts() {
+    const bool delayed = polledInterruptDisable.has_value();
+    const bool interruptDisable = polledInterruptDisable.value_or(P.test(Flag_InterruptDisable));
+    polledInterruptDisable.reset();
+
+    if (InterruptLines::RecognizedAt(interrupts.GetNMI()) <= cycles) {
+        interrupts.AcknowledgeNMI();
+        Counters::Count(Counter_NMIs);
+        DummyRead(PC);
+        DummyRead(PC);
+        Interrupt(Addr_NMI, false);
+        CompleteCycles(7);
+        ProfileInterrupt();
+    } else if (!interruptDisable && InterruptLines::RecognizedAt(interrupts.GetIRQ()) <= cycles) {
+        Counters::Count(Counter_IRQs);
+        DummyRead(PC);
+        DummyRead(PC);
+        Interrupt(Addr_IRQ, false);
+        CompleteCycles(7);
+        ProfileInterrupt();
+    }
+
+    // A masked IRQ only matters again once the I flag is cleared, which polls by itself
+    uint64_t deadline = InterruptLines::RecognizedAt(interrupts.GetNMI());
+    if (!P.test(Flag_InterruptDisable)) {
+        deadline = std::min(deadline, InterruptLines::RecognizedAt(interrupts.GetIRQ()));
+    }
+    // The instruction after a delayed I flag change always runs first
+    if (delayed) {
+        deadline = std::max<uint64_t>(deadline, cycles + 1);
+    }
+    interrupts.SetDeadline(deadline);
+}
+
+template <CPUCore Core>
+void CPU<Core>::Interrupt(Addr vector, bool brk) {
+    PushAddr(PC);
+    // B is only set in the copy pushed by BRK
+    Push((P.to_ulong() & ~(1 << Flag_B4)) | (1 << Flag_B5) | (brk ? (1 << Flag_B4) : 0));
+    P.set(Flag_InterruptDisable);
+    Addr lower = Read(vector);
+    Addr upper = Read(vector + 1) << 8;
+    PC = upper | lower;
+}
+
+template <CPUCore Core>
+void CPU<Core>::ProfileInstruction(uint8_t opcode, Addr instrOffset, size_t instrCycles) {
+    if constexpr (ProfilerEnabled) {
+        if (!profiler) {
+            return;
+        }
+        profiler->Instruction(instrOffset, instrCycles);
+        switch (opcode) {
+        case OP_JSR_ABS:
+        case OP_BRK_IMP:
+            profiler->Call(PC, S);
+            break;
+        case OP_RTS_IMP:
+        case OP_RTI_IMP:
+            profiler->Return(S);
+            break;
+        }
+    }
+}
+
+template <CPUCore Core>
+void CPU<Core>::ProfileInterrupt() {
+    if constexpr (ProfilerEnabled) {
+        if (profiler) {
+            // The 7 cycles of the interrupt sequence go to the handler
+            profiler->Call(PC, S, 7);
+        }
+    }
+}
+
+template <CPUCore Core>
+bool CPU<Core>::CheckExecute() {
+    debugPC = PC;
+    if (std::exchange(resumingBreak, false) || !debugger->IsWatched(Access_Execute, PC)) {
+        return false;
+    }
+    // A breakpoint that stopped the CPU leaves the instruction unexecuted
+    if (debugger->Trigger(Access_Execute, PC, mmu.Peek(PC), GetRegisters()) && !running) {
+        stoppedAt = PC;
+        return true;
+    }
+    return false;
+}
+
+template <CPUCore Core>
+void CPU<Core>::CheckAccess(Access access, Addr address, uint8_t value) {
+    // Stopping takes effect after the instruction
+    debugger->Check(access, address, value, GetRegisters());
+}
+
+template <CPUCore Core>
+Debugger::Registers CPU<Core>::GetRegisters() const {
+    return { A, X, Y, S, static_cast<uint8_t>(P.to_ulong()), debugPC };
+}
+
+template <CPUCore Core>
+void CPU<Core>::DelayInterruptDisable() {
+    polledInterruptDisable = P.test(Flag_InterruptDisable);
+    interrupts.ForcePoll();
+}
+
+template <CPUCore Core>
+void CPU<Core>::Push(uint8_t value) {
     SPDLOG_TRACE("Push to offset {:#02X} ({:#04X}) = {:#02X}", S, Addr_Stack + S, value);
-    mmu.Write(Addr_Stack + S, value);
+    Write(Addr_Stack + S, value);
     S--;
 }
 
-void CPU::PushAddr(Addr address) {
+template <CPUCore Core>
+void CPU<Core>::PushAddr(Addr address) {
     SPDLOG_TRACE("Pushing address to stack: {:#04X}", address);
     uint8_t upper = address >> 8;
     uint8_t lower = address & 0xFF;
@@ -88,14 +302,16 @@ void CPU::PushAddr(Addr address) {
     Push(lower);
 }
 
-uint8_t CPU::Pop() {
+template <CPUCore Core>
+uint8_t CPU<Core>::Pop() {
     S++;
-    auto value = mmu.Read(Addr_Stack + S);
+    auto value = Read(Addr_Stack + S);
     SPDLOG_TRACE("Popping value {:#02X} from stack offset {:#02X} = {:#04X}", value, S, Addr_Stack + S);
     return value;
 }
 
-Addr CPU::PopAddr() {
+template <CPUCore Core>
+Addr CPU<Core>::PopAddr() {
     auto lower = Pop();
     auto upper = Pop();
     Addr addr = (upper << 8) | lower;
@@ -103,7 +319,8 @@ Addr CPU::PopAddr() {
     return addr;
 }
 
-void CPU::FetchOperands(AddrMode addrMode, uint8_t opcode, uint16_t instrOffset) {
+template <CPUCore Core>
+void CPU<Core>::FetchOperands(AddrMode addrMode, uint8_t opcode, uint16_t instrOffset) {
     pageCrossed = false;
 
     auto addrData = AddrModeDataTable[addrMode];
@@ -115,38 +332,52 @@ void CPU::FetchOperands(AddrMode addrMode, uint8_t opcode, uint16_t instrOffset)
         imm0 = 0;
         imm1 = 0;
     case 2:
-        imm0 = mmu.Read(instrOffset + 1);
+        imm0 = Read(instrOffset + 1, CoverageFlag_Operand);
         imm1 = 0;
         break;
     case 3:
-        imm0 = mmu.Read(instrOffset + 1);
-        imm1 = mmu.Read(instrOffset + 2);
+        imm0 = Read(instrOffset + 1, CoverageFlag_Operand);
+        // JSR reads the high byte after pushing the return address, the log still shows it
+        if (Core == CPUCore_Cycle && opcode == OP_JSR_ABS) {
+            imm1 = mmu.Peek(instrOffset + 2);
+        } else {
+            imm1 = Read(instrOffset + 2, CoverageFlag_Operand);
+        }
         break;
     }
 
+    // Only build the NESTest representation when it is going to be printed
     instrToStr = "";
+    auto describe = [&](auto... args) {
+        if (nesTestLogEnabled) {
+            instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic, args...);
+        }
+    };
+
     switch (addrMode) {
     case Addr_Implicit:
-        // No operand
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic);
+        // No operand, the byte after the opcode is read anyway
+        DummyRead(PC);
+        describe();
         break;
 
     case Addr_Accumulator:
+        DummyRead(PC);
         operand = A;
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic);
+        describe();
         break;
 
     case Addr_Immediate:
         // Operand is immediately after opcode
         operand = imm0;
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic, operand);
+        describe(operand);
         break;
 
     case Addr_ZeroPage: {
         // Operand address is immediately after and extended to 16-bit
-        operand = mmu.Read(imm0);
+        operand = ReadOperand(opcode, imm0);
         operandAddr = imm0;
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic, imm0, operand);
+        describe(imm0, operand);
         }
         break;
 
@@ -155,8 +386,8 @@ void CPU::FetchOperands(AddrMode addrMode, uint8_t opcode, uint16_t instrOffset)
         auto addrLower = imm0;
         auto addrUpper = imm1 << 8;
         operandAddr = addrUpper | addrLower;
-        operand = mmu.Read(operandAddr);
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic, operandAddr);
+        operand = ReadOperand(opcode, operandAddr);
+        describe(operandAddr);
         }
         break;
 
@@ -166,7 +397,7 @@ void CPU::FetchOperands(AddrMode addrMode, uint8_t opcode, uint16_t instrOffset)
         int8_t offset = imm0;
         operandAddr += offset;
         pageCrossed = PC >> 8 != operandAddr >> 8;
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic, operandAddr);
+        describe(operandAddr);
         }
         break;
 
@@ -175,32 +406,35 @@ void CPU::FetchOperands(AddrMode addrMode, uint8_t opcode, uint16_t instrOffset)
         auto indirectLower = imm0;
         Addr indirectUpper = imm1 << 8;
         Addr indirectEffectiveAddr = indirectUpper | indirectLower;
-        Addr derefLower = mmu.Read(indirectEffectiveAddr);
+        Addr derefLower = Read(indirectEffectiveAddr);
         Addr derefUpperAddr = indirectEffectiveAddr + 1;
         // Emulate 6502 bug where indirect jump wraps around page boundary
         if (opcode == OP_JMP_IND && indirectLower == 0xFF) {
             SPDLOG_DEBUG("6502 bug: JMP indirect wraps around page boundary");
             derefUpperAddr -= 0x100;
         }
-        Addr derefUpper = mmu.Read(derefUpperAddr) << 8;
+        Addr derefUpper = Read(derefUpperAddr) << 8;
         operandAddr = derefUpper | derefLower;
         operand = 0x00; // Unused
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic, indirectEffectiveAddr, operandAddr);
+        describe(indirectEffectiveAddr, operandAddr);
         }
         break;
 
     // Indexed addressing modes
     case Addr_ZeroPageX: {  // Zero page indexed, val = PEEK((arg + X) % 256)
+        // The unindexed address is read while X is added
+        DummyRead(imm0);
         operandAddr = (imm0 + X) % 256;
-        operand = mmu.Read(operandAddr);
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic, imm0, operandAddr, operand);
+        operand = ReadOperand(opcode, operandAddr);
+        describe(imm0, operandAddr, operand);
         }
         break;
     
     case Addr_ZeroPageY: {   // Zero page indexed, val = PEEK((arg + Y) % 256)
+        DummyRead(imm0);
         operandAddr = (imm0 + Y) % 256;
-        operand = mmu.Read(operandAddr);
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic, imm0, operandAddr, operand);
+        operand = ReadOperand(opcode, operandAddr);
+        describe(imm0, operandAddr, operand);
         }
         break;
 
@@ -208,8 +442,9 @@ void CPU::FetchOperands(AddrMode addrMode, uint8_t opcode, uint16_t instrOffset)
         Addr abslAddrBase = (imm0 | (imm1 << 8));
         operandAddr = abslAddrBase + X;
         pageCrossed = abslAddrBase >> 8 != operandAddr >> 8;
-        operand = mmu.Read(operandAddr);
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic, abslAddrBase, operandAddr, operand);
+        DummyReadIndexed(opcode, abslAddrBase);
+        operand = ReadOperand(opcode, operandAddr);
+        describe(abslAddrBase, operandAddr, operand);
         }
         break;
 
@@ -217,52 +452,61 @@ void CPU::FetchOperands(AddrMode addrMode, uint8_t opcode, uint16_t instrOffset)
         Addr abslAddrBase = (imm0 | (imm1 << 8));
         operandAddr = abslAddrBase + Y;
         pageCrossed = abslAddrBase >> 8 != operandAddr >> 8;
-        operand = mmu.Read(operandAddr);
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic, abslAddrBase, operandAddr, operand);
+        DummyReadIndexed(opcode, abslAddrBase);
+        operand = ReadOperand(opcode, operandAddr);
+        describe(abslAddrBase, operandAddr, operand);
         }
         break;
 
     case Addr_IndirX: {      // Indexed indirect, val = PEEK(PEEK((arg + X) % 256) + PEEK((arg + X + 1) % 256) * 256)
+        DummyRead(imm0);
         Addr indirXAddr = (imm0 + X) % 256;
         pageCrossed = imm0 >> 8 != indirXAddr >> 8;
-        auto indirXLower = mmu.Read(indirXAddr);
+        auto indirXLower = Read(indirXAddr);
         Addr indirX1Addr = (imm0 + X + 1) % 256;
         pageCrossed |= imm0 >> 8 != indirX1Addr >> 8;
-        auto indirXUpper = mmu.Read(indirX1Addr) << 8;
+        auto indirXUpper = Read(indirX1Addr) << 8;
         operandAddr = (indirXUpper | indirXLower);
-        operand = mmu.Read(operandAddr);
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic, imm0, indirXAddr, operandAddr, operand);
+        operand = ReadOperand(opcode, operandAddr);
+        describe(imm0, indirXAddr, operandAddr, operand);
         }
         break;
 
     case Addr_IndirY: {     // Indexed indirect, val = PEEK(PEEK(arg) + PEEK((arg + 1) % 256) * 256 + Y)
-        auto indirYLower = mmu.Read(imm0);
+        auto indirYLower = Read(imm0);
         auto indirYUpperAddr = (imm0 + 1) % 256;
         pageCrossed = imm0 >> 8 != indirYUpperAddr >> 8;
-        auto indirYUpper = mmu.Read(indirYUpperAddr) << 8;
+        auto indirYUpper = Read(indirYUpperAddr) << 8;
         auto derefYAddr = indirYUpper | indirYLower;
         operandAddr = derefYAddr + Y;
         pageCrossed |= derefYAddr >> 8 != operandAddr >> 8;
-        operand = mmu.Read(operandAddr);
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic, imm0, derefYAddr, operandAddr, operand);
+        DummyReadIndexed(opcode, derefYAddr);
+        operand = ReadOperand(opcode, operandAddr);
+        describe(imm0, derefYAddr, operandAddr, operand);
         }
         break;
     
     case Addr_Illegal:
+        DummyRead(PC);
+        // Jams (KIL) have no cycles in the table
+        if (!InstrDataTable[opcode].cycles && !jamAddress) {
+            jamAddress = instrOffset;
+        }
         SPDLOG_WARN("Illegal addressing mode");
-        instrToStr = fmt::format(fmt::runtime(addrData.fmt), opData.mnemonic);
+        describe();
         break;
     }
 
     // Append current memory value to instruction string for non-jump absolute instructions
     // NESTest prints it this way instead of the value to be loaded/stored
-    if (ShouldPrintOperand(opcode)) {
+    if (nesTestLogEnabled && ShouldPrintOperand(opcode)) {
         instrToStr += fmt::format(" = {:02X}", operand);
     }
 
 }
 
-void CPU::UpdateOperands(AddrMode addrMode, uint8_t opcode) {
+template <CPUCore Core>
+void CPU<Core>::UpdateOperands(AddrMode addrMode, uint8_t opcode) {
     if (!InstrDataTable[opcode].updatesOperand)
         return;
 
@@ -273,33 +517,33 @@ void CPU::UpdateOperands(AddrMode addrMode, uint8_t opcode) {
     case Addr_Immediate:
         break;  
     case Addr_ZeroPage:
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         break;
     case Addr_Absolute:
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         break;
     case Addr_Relative:
         break;
     case Addr_Indirect:
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         break;
     case Addr_ZeroPageX:
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         break;
     case Addr_ZeroPageY:
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         break;
     case Addr_AbslX:
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         break;
     case Addr_AbslY:
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         break;
     case Addr_IndirX:
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         break;
     case Addr_IndirY:
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         break;
     case Addr_Implicit:
         break;
@@ -308,8 +552,49 @@ void CPU::UpdateOperands(AddrMode addrMode, uint8_t opcode) {
     }
 }
 
+template <CPUCore Core>
+uint8_t CPU<Core>::ReadOperand(uint8_t opcode, Addr address) {
+    // Instructions that don't read their target must not trigger I/O read side effects,
+    // but NESTest still prints the old value for them
+    if (!ReadsOperand(opcode)) {
+        return mmu.Peek(address);
+    }
+    return Read(address);
+}
+
+template <CPUCore Core>
+bool CPU<Core>::ReadsOperand(uint8_t opcode) {
+    switch (opcode) {
+    case OP_STA_ZP:
+    case OP_STA_ZPX:
+    case OP_STA_ABS:
+    case OP_STA_ABSX:
+    case OP_STA_ABSY:
+    case OP_STA_INDX:
+    case OP_STA_INDY:
+    case OP_STX_ZP:
+    case OP_STX_ZPY:
+    case OP_STX_ABS:
+    case OP_STY_ZP:
+    case OP_STY_ZPX:
+    case OP_STY_ABS:
+    case OP_I_SAX_ZP:
+    case OP_I_SAX_ZPY:
+    case OP_I_SAX_ABS:
+    case OP_I_SAX_INDX:
+    case OP_I_AHX_ABSY:
+    case OP_I_AHX_INDX:
+    case OP_JMP_ABS:
+    case OP_JSR_ABS:
+        return false;
+    default:
+        return true;
+    }
+}
+
 // We print the operand for all absolute addressing modes except for jumps
-bool CPU::ShouldPrintOperand(uint8_t opcode) {
+template <CPUCore Core>
+bool CPU<Core>::ShouldPrintOperand(uint8_t opcode) {
     if (InstrDataTable[opcode].mode != Addr_Absolute)
         return false;
     switch (opcode) {
@@ -321,7 +606,8 @@ bool CPU::ShouldPrintOperand(uint8_t opcode) {
     }
 }
 
-void CPU::ExecInstr(uint8_t opcode) {
+template <CPUCore Core>
+void CPU<Core>::ExecInstr(uint8_t opcode) {
     // Add with carry, also used by SBC and some illegal instrs
     auto ADC = [=]() {
         SPDLOG_TRACE("SubOP: ADC");
@@ -443,10 +729,9 @@ void CPU::ExecInstr(uint8_t opcode) {
 
     // BRK - Force Interrupt
     case OP_BRK_IMP:
-        PushAddr(PC);
-        Push(P.to_ulong());
-        P.set(Flag_InterruptDisable);
-        PC = Addr_BRK;
+        // The byte after BRK is skipped
+        PC++;
+        Interrupt(Addr_BRK, true);
         break;
 
     // CLC - Clear Carry Flag
@@ -461,6 +746,7 @@ void CPU::ExecInstr(uint8_t opcode) {
 
     // CLI - Clear Interrupt Disable
     case OP_CLI_IMP:
+        DelayInterruptDisable();
         P.reset(Flag_InterruptDisable);
         break;
 
@@ -480,6 +766,8 @@ void CPU::ExecInstr(uint8_t opcode) {
 
     // PLA - Pull Accumulator
     case OP_PLA_IMP:
+        // Pulls spend a cycle reading the stack before incrementing S
+        DummyRead(Addr_Stack + S);
         A = Pop();
         P.set(Flag_Zero, A == 0);
         P.set(Flag_Negative, A & NEGATIVE_BIT);
@@ -493,6 +781,8 @@ void CPU::ExecInstr(uint8_t opcode) {
     
     // PLP - Pull Processor Status
     case OP_PLP_IMP: {
+        DelayInterruptDisable();
+        DummyRead(Addr_Stack + S);
         auto PSave = P.to_ulong() & (1 << Flag_B4);
         P = (Pop() & 0xEF) | PSave;
         // B5 flag is implicitly set on pull
@@ -502,6 +792,9 @@ void CPU::ExecInstr(uint8_t opcode) {
     
     // RTI - Return from Interrupt
     case OP_RTI_IMP:
+        // Unlike PLP the restored I flag applies to the poll right away
+        interrupts.ForcePoll();
+        DummyRead(Addr_Stack + S);
         P = Pop();
         // B5 flag is implicitly set on pull
         P.set(Flag_B5);
@@ -510,12 +803,15 @@ void CPU::ExecInstr(uint8_t opcode) {
 
     // RTS - Return from Subroutine
     case OP_RTS_IMP:
+        DummyRead(Addr_Stack + S);
         PC = PopAddr();
         if (PC == 0) {
             // Halt
             Pause();
             break;
         }
+        // The return address is read before it is incremented past the JSR
+        DummyRead(PC);
         PC++;
         break;
 
@@ -531,6 +827,7 @@ void CPU::ExecInstr(uint8_t opcode) {
 
     // SEI - Set Interrupt Disable
     case OP_SEI_IMP:
+        DelayInterruptDisable();
         P.set(Flag_InterruptDisable);
         break;
 
@@ -585,7 +882,7 @@ void CPU::ExecInstr(uint8_t opcode) {
         --operand;
         P.set(Flag_Zero, operand == 0);
         P.set(Flag_Negative, operand & NEGATIVE_BIT);
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         // Fallthrough to CMP
 
     // CMP - Compare
@@ -628,7 +925,7 @@ void CPU::ExecInstr(uint8_t opcode) {
         --operand;
         P.set(Flag_Zero, operand == 0);
         P.set(Flag_Negative, operand & NEGATIVE_BIT);
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         break;
 
     // DEX - Decrement X Register
@@ -681,7 +978,7 @@ void CPU::ExecInstr(uint8_t opcode) {
         ++operand;
         P.set(Flag_Zero, operand == 0);
         P.set(Flag_Negative, operand & NEGATIVE_BIT);
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         break;
 
     // JMP - Jump
@@ -692,7 +989,13 @@ void CPU::ExecInstr(uint8_t opcode) {
 
     // JSR - Jump to Subroutine
     case OP_JSR_ABS:
+        DummyRead(Addr_Stack + S);
         PushAddr(PC - 1);
+        // The target's high byte is read last, after the pushes
+        if constexpr (Core == CPUCore_Cycle) {
+            imm1 = Read(PC - 1, CoverageFlag_Operand);
+            operandAddr = (imm1 << 8) | imm0;
+        }
         PC = operandAddr;
         break;
     
@@ -792,7 +1095,7 @@ void CPU::ExecInstr(uint8_t opcode) {
     case OP_I_ISB_INDX:
     case OP_I_ISB_INDY:
         ++operand;
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         // Fallthrough to SBC
     
     // SBC - Subtract with Carry
@@ -818,21 +1121,21 @@ void CPU::ExecInstr(uint8_t opcode) {
     case OP_STA_ABSY:
     case OP_STA_INDX:
     case OP_STA_INDY:
-        mmu.Write(operandAddr, A);
+        Write(operandAddr, A);
         break;
     
     // STX - Store X Register
     case OP_STX_ZP:
     case OP_STX_ZPY:
     case OP_STX_ABS:
-        mmu.Write(operandAddr, X);
+        Write(operandAddr, X);
         break;
     
     // STY - Store Y Register
     case OP_STY_ZP:
     case OP_STY_ZPX:
     case OP_STY_ABS:
-        mmu.Write(operandAddr, Y);
+        Write(operandAddr, Y);
         break;
 
     //
@@ -856,7 +1159,7 @@ void CPU::ExecInstr(uint8_t opcode) {
     case OP_I_SAX_ZPY:
     case OP_I_SAX_ABS:
     case OP_I_SAX_INDX:
-        mmu.Write(operandAddr, A & X);
+        Write(operandAddr, A & X);
         break;
 
     // *SLO - Arithmetic Shift Left and OR
@@ -871,7 +1174,7 @@ void CPU::ExecInstr(uint8_t opcode) {
         operand <<= 1;
         P.set(Flag_Zero, operand == 0);
         P.set(Flag_Negative, operand & NEGATIVE_BIT);
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         A |= operand;
         P.set(Flag_Zero, A == 0);
         P.set(Flag_Negative, A & NEGATIVE_BIT);
@@ -892,7 +1195,7 @@ void CPU::ExecInstr(uint8_t opcode) {
         operand |= carrySave;
         P.set(Flag_Zero, operand == 0);
         P.set(Flag_Negative, operand & NEGATIVE_BIT);
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         A &= operand;
         P.set(Flag_Zero, A == 0);
         P.set(Flag_Negative, A & NEGATIVE_BIT);
@@ -911,7 +1214,7 @@ void CPU::ExecInstr(uint8_t opcode) {
         operand >>= 1;
         P.set(Flag_Zero, operand == 0);
         P.set(Flag_Negative, operand & NEGATIVE_BIT);
-        mmu.Write(operandAddr, operand);
+        Write(operandAddr, operand);
         A ^= operand;
         P.set(Flag_Zero, A == 0);
         P.set(Flag_Negative, A & NEGATIVE_BIT);
@@ -937,7 +1240,8 @@ void CPU::ExecInstr(uint8_t opcode) {
     }
 }
 
-void CPU::UpdateCycleCount(AddrMode addrMode, uint8_t opcode) {
+template <CPUCore Core>
+void CPU<Core>::UpdateCycleCount(AddrMode addrMode, uint8_t opcode) {
     uint8_t newCycles = 0;
     newCycles += InstrDataTable[opcode].cycles;
 
@@ -960,17 +1264,76 @@ void CPU::UpdateCycleCount(AddrMode addrMode, uint8_t opcode) {
     }
 
 finally:
-    Tick(newCycles);
+    // Taken branches spend their extra cycles reading the next opcodes, which only the
+    // timing can tell apart, so no core makes those reads
+    CompleteCycles(newCycles);
 }
 
-void CPU::Tick(size_t cycles) {
+template <CPUCore Core>
+uint8_t CPU<Core>::Read(Addr address, uint8_t coverageFlags) {
+    if constexpr (Core == CPUCore_Cycle) {
+        Tick(1);
+        busCycles++;
+    }
+    if constexpr (CoverageEnabled) {
+        if (coverage && coverageFlags) {
+            coverage->MarkCPU(address, coverageFlags);
+        }
+    }
+    const uint8_t value = mmu.Read(address);
+    if (IsDebugging()) [[unlikely]] {
+        CheckAccess(Access_Read, address, value);
+    }
+    return value;
+}
+
+template <CPUCore Core>
+void CPU<Core>::Write(Addr address, uint8_t value, bool dummy) {
+    if constexpr (Core == CPUCore_Cycle) {
+        Tick(1);
+        busCycles++;
+    }
+    if constexpr (CoverageEnabled) {
+        if (coverage) {
+            coverage->MarkCPU(address, CoverageFlag_Write);
+        }
+    }
+    mmu.Write(address, value, dummy);
+    if (!dummy && IsDebugging()) [[unlikely]] {
+        CheckAccess(Access_Write, address, value);
+    }
+}
+
+template <CPUCore Core>
+void CPU<Core>::DummyReadIndexed(uint8_t opcode, Addr base) {
+    // While the high byte is fixed up the address with only the low byte indexed is read.
+    // Reads skip it when no fix up is needed, writes can't.
+    if (pageCrossed || !ReadsOperand(opcode) || ReadModifyWrite[opcode]) {
+        DummyRead((base & 0xFF00) | (operandAddr & 0x00FF));
+    }
+}
+
+template <CPUCore Core>
+void CPU<Core>::CompleteCycles(size_t total) {
+    // Jams (KIL) have no cycles in the table
+    Tick(total > busCycles ? total - busCycles : 0);
+    busCycles = 0;
+}
+
+template <CPUCore Core>
+void CPU<Core>::Tick(size_t cycles) {
     this->cycles += cycles;
-    ppuEmu.Tick(cycles * 3);
+    if (scheduler) {
+        scheduler->Advance(cycles);
+        return;
+    }
+    ppu.Tick(cycles * 3);
+    apu.Tick(cycles);
 }
 
-void CPU::PrintNESTestLine(Addr instrOffset) {
+template <CPUCore Core>
+void CPU<Core>::PrintNESTestLine(uint8_t opcode, Addr instrOffset) {
     // Print opcode based on instruction length
-    auto opcode = mmu.Read(instrOffset);
     auto instr = InstrDataTable[opcode];
     auto addrMode = AddrModeDataTable[instr.mode];
     std::string fullOpcode;
@@ -998,10 +1361,11 @@ void CPU::PrintNESTestLine(Addr instrOffset) {
     std::string registers = fmt::format("A:{:02X} X:{:02X} Y:{:02X} P:{:02X} SP:{:02X}", A, X, Y, P.to_ulong(), S);
 
     // Print PPU state
-    std::string ppuInfo = fmt::format("PPU:{:3d},{:3d}", ppuEmu.scanline, ppuEmu.cycles);
+    std::string ppuInfo = fmt::format("PPU:{:3d},{:3d}", instrPPU.scanline, instrPPU.dot);
 
     // Print cycle count
-    std::string cycleInfo = fmt::format("CYC:{}", cycles);
+    // The cycle core has already spent the opcode and operand fetches
+    std::string cycleInfo = fmt::format("CYC:{}", cycles - busCycles);
 
     //C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
     std::string fullString;
@@ -1011,3 +1375,27 @@ void CPU::PrintNESTestLine(Addr instrOffset) {
     nesTestOutput << fullString << std::endl;
     nesTestOutput.flush();
 }
+
+template <CPUCore Core>
+void CPU<Core>::WriteTraceRecord(uint8_t opcode, Addr instrOffset) {
+    TraceRecord record{};
+    // Same values as the NESTest line
+    record.cycle = cycles - busCycles;
+    record.pc = instrOffset;
+    record.size = AddrModeDataTable[InstrDataTable[opcode].mode].size;
+    record.bytes[0] = opcode;
+    record.bytes[1] = record.size > 1 ? imm0 : 0;
+    record.bytes[2] = record.size > 2 ? imm1 : 0;
+    record.a = A;
+    record.x = X;
+    record.y = Y;
+    record.p = static_cast<uint8_t>(P.to_ulong());
+    record.s = S;
+    record.scanline = instrPPU.scanline;
+    record.dot = instrPPU.dot;
+    record.frame = instrPPU.frame;
+    traceWriter->Write(record);
+}
+
+template class CPU<CPUCore_Fast>;
+template class CPU<CPUCore_Cycle>;
@@ -1,12 +1,45 @@
+#pragma once
+
+#include "APU.h"
+#include "Counters.h"
+#include "Coverage.h"
+#include "Debugger.h"
+#include "Interrupts.h"
 #include "MMU.h"
+#include "PPU.h"
+#include "Profiler.h"
+#include "Scheduler.h"
+#include "Trace.h"
 
+#include <algorithm>
+#include <array>
 #include <fstream>
+#include <optional>
+#include <string_view>
+
+// The fast core is instruction stepped: an instruction's bus accesses run back to back and
+// the rest of the system catches up once it completes. The cycle core advances the system
+// by one cycle before every bus access, dummy reads and writes included, so the PPU, APU
+// and mappers see each access on its own cycle.
+enum CPUCore : uint8_t {
+    CPUCore_Fast,
+    CPUCore_Cycle
+};
+
+// An uninterrupted run of an instruction jumping to itself, like JMP * or a branch to itself
+struct CPUSpin {
+    Addr address;
+    uint64_t cycles;
+};
 
+template <CPUCore Core>
 class CPU {
 public:
-    CPU(MMU& mmu) :
-        nesTestOutput("nestest.log", std::ofstream::out),
-        mmu(mmu) {
+    CPU(MMU& mmu, PPU& ppu, APU& apu, InterruptLines& interrupts) :
+        mmu(mmu),
+        ppu(ppu),
+        apu(apu),
+        interrupts(interrupts) {
         SPDLOG_INFO("CPU created");
     }
 
@@ -19,10 +52,34 @@ public:
 
     void Execute();
 
+    // Runs until paused, calling it again resumes
     void Run();
 
     void Pause();
 
+    // CPU cycles since power on
+    uint64_t GetCycles() const { return cycles; }
+    // Address of the first KIL since power on or reset. Execution carries on past it as if it
+    // were a one byte NOP, where the real CPU would stop fetching instructions.
+    std::optional<Addr> GetJamAddress() const { return jamAddress; }
+    // The last spin, its cycles stop growing once an interrupt or another instruction breaks it
+    CPUSpin GetSpin() const { return { spinAddress, spinEnd - spinStart }; }
+
+    // Per instruction NESTest format log written to nestest.log, on by default
+    void SetNESTestLogEnabled(bool enabled);
+    // Start at the given address instead of the reset vector, nestest's automated mode starts at $C000
+    void SetEntryPoint(std::optional<Addr> address) { entryPoint = address; }
+    // Advance the scheduler's master clock instead of ticking the PPU and APU in lockstep
+    void SetScheduler(Scheduler* scheduler) { this->scheduler = scheduler; }
+    // Attribute cycles to the code spending them, nullptr to stop. Only builds with NES2_PROFILER call it.
+    void SetProfiler(Profiler* profiler) { this->profiler = profiler; }
+    // Check breakpoints and watchpoints, nullptr to stop
+    void SetDebugger(Debugger* debugger) { this->debugger = debugger; }
+    // Mark the bytes the CPU accesses, nullptr to stop. Only builds with NES2_COVERAGE call it.
+    void SetCoverage(Coverage* coverage) { this->coverage = coverage; }
+    // Write a record of every instruction before it executes, nullptr to stop
+    void SetTraceWriter(TraceWriter* traceWriter) { this->traceWriter = traceWriter; }
+
     enum AddrConstants : Addr {
         Addr_Stack = 0x0100,
         Addr_IRQ   = 0xFFFE,
@@ -36,15 +93,76 @@ private:
 #include "InstrTable.h"
 
     void ReadResetVector();
+    void ResetHangState();
 
     void FetchOperands(AddrMode addrMode, uint8_t opcode, uint16_t instrOffset);
     void UpdateOperands(AddrMode addrMode, uint8_t opcode);
+    uint8_t ReadOperand(uint8_t opcode, Addr address);
+    bool ReadsOperand(uint8_t opcode);
     bool ShouldPrintOperand(uint8_t opcode);
     void ExecInstr(uint8_t opcode);
     void UpdateCycleCount(AddrMode addrMode, uint8_t opcode);
 
+    // Memory operations with a fixed number of operand reads followed by as many writes
+    static constexpr auto ReadModifyWrite = [] {
+        constexpr std::string_view Mnemonics[] = {
+            "ASL", "LSR", "ROL", "ROR", "INC", "DEC", "*SLO", "*RLA", "*SRE", "*RRA", "*DCP", "*ISB"
+        };
+        std::array<bool, 256> table{};
+        for (size_t opcode = 0; opcode < table.size(); ++opcode) {
+            const InstrData& instr = InstrDataTable[opcode];
+            table[opcode] = instr.mode != Addr_Accumulator && std::ranges::find(Mnemonics, instr.mnemonic) != std::end(Mnemonics);
+        }
+        return table;
+    }();
+
+    // Bus accesses, the cycle core advances the system by a cycle before each. Reads mark
+    // the byte with the coverage flags, opcode and operand fetches pass their own. Dummy
+    // writes aren't seen by the debugger.
+    uint8_t Read(Addr address, uint8_t coverageFlags = CoverageFlag_Read);
+    void Write(Addr address, uint8_t value, bool dummy = false);
+    // Accesses with nothing to show for them but their side effects, only the cycle core makes them
+    void DummyRead(Addr address) {
+        if constexpr (Core == CPUCore_Cycle) {
+            Read(address, 0);
+        }
+    }
+    // Read-modify-write instructions write the unmodified value back a cycle before the
+    // result, write watches only report the result like on the fast core. Mappers see it on
+    // both cores, the MMC1 ignores the result written right after it.
+    void DummyWrite(Addr address, uint8_t value) {
+        if constexpr (Core == CPUCore_Cycle) {
+            Write(address, value, true);
+        } else if (MMU::IsCartridgeAddress(address)) {
+            mmu.Write(address, value, true);
+        }
+    }
+    // Dummy read of absolute and indirect indexed addressing
+    void DummyReadIndexed(uint8_t opcode, Addr base);
+    // Advance the system by the part of the instruction's cycles its bus accesses haven't
+    void CompleteCycles(size_t total);
+
     void Tick(size_t cycles);
 
+    // Take a pending NMI or IRQ and move the interrupt deadline to the next one
+    void PollInterrupts();
+    // Push PC and P, then continue at the address in the vector
+    void Interrupt(Addr vector, bool brk);
+    // CLI, SEI and PLP change the I flag after the poll at the end of their own
+    // instruction, that poll still sees the previous value
+    void DelayInterruptDisable();
+
+    // Profiler hooks, compiled out without NES2_PROFILER
+    void ProfileInstruction(uint8_t opcode, Addr instrOffset, size_t instrCycles);
+    void ProfileInterrupt();
+
+    // Debugger hooks, only called while some debugger in the process is armed. A triggered
+    // execute breakpoint that stops the CPU stops it before the instruction.
+    bool IsDebugging() const { return Debugger::IsAnyArmed() && debugger; }
+    bool CheckExecute();
+    void CheckAccess(Access access, Addr address, uint8_t value);
+    Debugger::Registers GetRegisters() const;
+
     void Push(uint8_t value);
     void PushAddr(Addr address);
     uint8_t Pop();
@@ -53,10 +171,30 @@ private:
     // Instruction string representation for NESTest
     std::string instrToStr;
     std::ofstream nesTestOutput;
-    void PrintNESTestLine(Addr instrOffset);
+    bool nesTestLogEnabled = true;
+    // Takes the opcode already fetched, logging makes no bus accesses of its own
+    void PrintNESTestLine(uint8_t opcode, Addr instrOffset);
+    // PPU position as the current instruction started, only sampled for the logs
+    struct PPUPosition {
+        uint16_t scanline;
+        uint16_t dot;
+        uint64_t frame;
+    };
+    PPUPosition instrPPU{};
+    void SamplePPU();
+    void WriteTraceRecord(uint8_t opcode, Addr instrOffset);
 
     bool running = true;
     size_t cycles = 0;
+    size_t busCycles = 0; // Cycles of the current instruction already ticked by bus accesses
+    std::optional<Addr> entryPoint;
+    // I flag as seen by the next poll when an instruction just changed it
+    std::optional<bool> polledInterruptDisable;
+    std::optional<Addr> jamAddress;
+    Addr spinAddress = 0;
+    // Cycles the last spin started and ended on
+    uint64_t spinStart = 0;
+    uint64_t spinEnd = 0;
 
     enum StatusFlags {
         Flag_Carry = 0,
@@ -82,6 +220,21 @@ private:
     // Memory
     MMU& mmu;
 
+    PPU& ppu;
+    APU& apu;
+    InterruptLines& interrupts;
+    Scheduler* scheduler = nullptr;
+    Profiler* profiler = nullptr;
+    Debugger* debugger = nullptr;
+    Coverage* coverage = nullptr;
+    TraceWriter* traceWriter = nullptr;
+    // Start of the current instruction, only kept while debugging
+    Addr debugPC = 0;
+    // Where an execute breakpoint last stopped the CPU, and whether Run resumed there and
+    // skips the check on its first instruction
+    std::optional<Addr> stoppedAt;
+    bool resumingBreak = false;
+
     // Registers
     uint8_t A; // Accumulator
     uint8_t X; // X index
@@ -99,26 +252,7 @@ private:
     // Optional values immediately following the opcode, depending on addressing mode
     uint8_t imm0 = 0;
     uint8_t imm1 = 0;
+};
 
-    struct PPUEmu {
-        uint16_t scanline = 0;
-        uint16_t cycles = 0;
-
-        void Tick(size_t newCycles) {
-            cycles += newCycles;
-
-            if (cycles >= 341) {
-                cycles -= 341;
-                scanline++;
-            }
-
-            if (scanline == 241) {
-                SPDLOG_INFO("PPU::Tick() - VBLANK");
-            }
-
-            if (scanline >= 262) {
-                scanline -= 262;
-            }
-        }
-    } ppuEmu;
-};
\ No newline at end of file
+extern template class CPU<CPUCore_Fast>;
+extern template class CPU<CPUCore_Cycle>;
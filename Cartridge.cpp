@@ -1,10 +1,14 @@
 #include "pch.h"
 
 #include "Cartridge.h"
+#include "Counters.h"
 #include "iNES.h"
 #include "MMC1.h"
 #include "SimpleMapper.h"
 
+#include <algorithm>
+#include <array>
+
 Cartridge::Cartridge() {
     SPDLOG_INFO("Cartridge created, but not initialized");
 }
@@ -21,10 +25,10 @@ void Cartridge::LoadFromPath(const char *path) {
             mapper = std::make_unique<MMC1>();
             break;
         default:
-            VERIFY(false, "Unsupported mapper");
+            throw std::runtime_error(fmt::format("Unsupported mapper {}", ines->GetHeader().GetMapperNumber()));
     }
 
-    SPDLOG_INFO("Cartridge loading mapper {}", (uint8_t)ines->GetHeader().GetMapper());
+    SPDLOG_INFO("Cartridge loading mapper {}", ines->GetHeader().GetMapperNumber());
     mapper->LoadFromINES(*ines);
 
     loaded = true;
@@ -44,14 +48,85 @@ void Cartridge::Reset() {
     mapper->Reset();
 }
 
-void Cartridge::Write(uint16_t address, uint8_t value) {
+void Cartridge::Write(uint16_t address, uint8_t value, bool dummy) {
     ASSERT(loaded, "Cartridge not loaded");
     ASSERT(address >= 0x4020, "Cartridge write out of range");
-    return mapper->Write(address, value);
+    auto write = [&] {
+        if (dummy) {
+            mapper->DummyWrite(address, value);
+        } else {
+            mapper->Write(address, value);
+        }
+    };
+    if constexpr (CountersEnabled) {
+        if (address >= 0x8000) {
+            Counters::Count(Counter_MapperWrites);
+        }
+        // Any mapper's bank switches show as the banks changing across the write
+        auto prgBanks = [&] {
+            std::array<size_t, 4> offsets;
+            for (size_t i = 0; i < offsets.size(); ++i) {
+                offsets[i] = mapper->GetPrgRomOffset(static_cast<uint16_t>(0x8000 + i * 0x2000));
+            }
+            return offsets;
+        };
+        const auto prgBefore = prgBanks();
+        const auto chrBefore = mapper->GetChrBanks();
+        write();
+        if (prgBanks() != prgBefore) {
+            Counters::Count(Counter_PrgBankSwitches);
+        }
+        if (!std::ranges::equal(mapper->GetChrBanks().banks, chrBefore.banks)) {
+            Counters::Count(Counter_ChrBankSwitches);
+        }
+        return;
+    }
+    write();
 }
 
 uint8_t Cartridge::Read(uint16_t address) {
     ASSERT(loaded, "Cartridge not loaded");
     ASSERT(address >= 0x4020, "Cartridge read out of range");
     return mapper->Read(address);
-}
\ No newline at end of file
+}
+
+size_t Cartridge::GetPrgRomOffset(uint16_t address) {
+    ASSERT(loaded, "Cartridge not loaded");
+    return mapper->GetPrgRomOffset(address);
+}
+
+std::span<const uint8_t> Cartridge::GetPrgRom() const {
+    ASSERT(loaded, "Cartridge not loaded");
+    return ines->GetPrgRom();
+}
+
+uint8_t Cartridge::ReadChr(uint16_t address) {
+    ASSERT(loaded, "Cartridge not loaded");
+    ASSERT(address < 0x2000, "Cartridge CHR read out of range");
+    return mapper->ReadChr(address);
+}
+
+void Cartridge::WriteChr(uint16_t address, uint8_t value) {
+    ASSERT(loaded, "Cartridge not loaded");
+    ASSERT(address < 0x2000, "Cartridge CHR write out of range");
+    mapper->WriteChr(address, value);
+}
+
+Mapper::ChrBanks Cartridge::GetChrBanks() {
+    ASSERT(loaded, "Cartridge not loaded");
+    return mapper->GetChrBanks();
+}
+
+std::span<const uint8_t> Cartridge::GetChrMemory() {
+    ASSERT(loaded, "Cartridge not loaded");
+    return mapper->GetChrMemory();
+}
+
+Cartridge::Mirroring Cartridge::GetMirroring() const {
+    ASSERT(loaded, "Cartridge not loaded");
+    const auto& header = ines->GetHeader();
+    if (header.HasFourScreenVRAM()) {
+        return Mirroring_FourScreen;
+    }
+    return mapper->GetMirroring(header.IsVerticalMirroring() ? Mirroring_Vertical : Mirroring_Horizontal);
+}
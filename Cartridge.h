@@ -3,6 +3,8 @@
 #include "Mapper.h"
 #include "iNES.h"
 
+#include <span>
+
 class Cartridge {
 public:
     Cartridge();
@@ -12,8 +14,22 @@ public:
     void PowerOn();
     void Reset();
 
-    void Write(uint16_t address, uint8_t value);
+    // See Mapper::DummyWrite for dummy writes
+    void Write(uint16_t address, uint8_t value, bool dummy = false);
     uint8_t Read(uint16_t address);
+    // See Mapper::GetPrgRomOffset
+    size_t GetPrgRomOffset(uint16_t address);
+    std::span<const uint8_t> GetPrgRom() const;
+
+    uint8_t ReadChr(uint16_t address);
+    void WriteChr(uint16_t address, uint8_t value);
+    Mapper::ChrBanks GetChrBanks();
+    std::span<const uint8_t> GetChrMemory();
+
+    using Mirroring = Mapper::Mirroring;
+    using enum Mapper::Mirroring;
+    // See Mapper::GetMirroring, four screen VRAM on the cartridge can't be switched
+    Mirroring GetMirroring() const;
 
     bool IsLoaded() const { return loaded; }
 private:
@@ -0,0 +1,199 @@
+#include "Checksum.h"
+
+#include "SIMD.h"
+
+#include <bit>
+#include <cstring>
+
+namespace {
+
+// Slice-by-8 tables for the reflected polynomial, row n advances a byte through n more zero bytes
+constexpr auto CRCTables = [] {
+    std::array<std::array<uint32_t, 256>, 8> tables{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+        tables[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (size_t n = 1; n < tables.size(); ++n) {
+            tables[n][i] = (tables[n - 1][i] >> 8) ^ tables[0][tables[n - 1][i] & 0xFF];
+        }
+    }
+    return tables;
+}();
+
+// Raw register update, without the inversions at the start and end
+uint32_t UpdateCRC(const uint8_t* data, size_t size, uint32_t crc) {
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t lo;
+        uint32_t hi;
+        std::memcpy(&lo, data, 4);
+        std::memcpy(&hi, data + 4, 4);
+        if constexpr (std::endian::native == std::endian::big) {
+            lo = std::byteswap(lo);
+            hi = std::byteswap(hi);
+        }
+        lo ^= crc;
+        crc = CRCTables[7][lo & 0xFF] ^ CRCTables[6][(lo >> 8) & 0xFF] ^ CRCTables[5][(lo >> 16) & 0xFF] ^ CRCTables[4][lo >> 24]
+            ^ CRCTables[3][hi & 0xFF] ^ CRCTables[2][(hi >> 8) & 0xFF] ^ CRCTables[1][(hi >> 16) & 0xFF] ^ CRCTables[0][hi >> 24];
+    }
+    for (; size > 0; ++data, --size) {
+        crc = (crc >> 8) ^ CRCTables[0][(crc ^ *data) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef NES2_X86
+// The low and high halves of x carried forward by their constants, added to the next block
+NES2_TARGET("pclmul")
+inline __m128i Fold(__m128i x, __m128i k, __m128i next) {
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), next);
+}
+
+// Folds 64 bytes at a time with carry-less multiplies down to one 16 byte remainder that has
+// the same CRC as everything folded into it, which the tables then finish. Returns the bytes done.
+// https://www.intel.com/content/dam/www/public/us/en/documents/white-papers/fast-crc-computation-generic-polynomials-pclmulqdq-paper.pdf
+NES2_TARGET("pclmul")
+size_t FoldCRC(const uint8_t* data, size_t size, uint32_t& crc) {
+    // x^(n+32) and x^(n-32) mod P, reflected, for folding over 512 and 128 bits
+    const __m128i fold4 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+    const __m128i fold1 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+
+    auto load = [&](size_t offset) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)); };
+
+    __m128i x0 = _mm_xor_si128(load(0), _mm_cvtsi32_si128(static_cast<int>(crc)));
+    __m128i x1 = load(16);
+    __m128i x2 = load(32);
+    __m128i x3 = load(48);
+    size_t offset = 64;
+    for (; offset + 64 <= size; offset += 64) {
+        x0 = Fold(x0, fold4, load(offset));
+        x1 = Fold(x1, fold4, load(offset + 16));
+        x2 = Fold(x2, fold4, load(offset + 32));
+        x3 = Fold(x3, fold4, load(offset + 48));
+    }
+    x0 = Fold(x0, fold1, x1);
+    x0 = Fold(x0, fold1, x2);
+    x0 = Fold(x0, fold1, x3);
+    for (; offset + 16 <= size; offset += 16) {
+        x0 = Fold(x0, fold1, load(offset));
+    }
+
+    alignas(16) uint8_t remainder[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(remainder), x0);
+    crc = UpdateCRC(remainder, sizeof(remainder), 0);
+    return offset;
+}
+
+bool HasPCLMUL() {
+#if defined(__GNUC__) || defined(__clang__)
+    static const bool hasPCLMUL = __builtin_cpu_supports("pclmul");
+#else
+    static const bool hasPCLMUL = [] {
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 1)) != 0;
+    }();
+#endif
+    return hasPCLMUL;
+}
+#endif
+
+} // namespace
+
+uint32_t CRC32(std::span<const uint8_t> data, uint32_t crc) {
+    crc = ~crc;
+    size_t done = 0;
+#ifdef NES2_X86
+    // Below this the tables are as fast as setting up the folds
+    if (data.size() >= 256 && HasPCLMUL()) {
+        done = FoldCRC(data.data(), data.size(), crc);
+    }
+#endif
+    return ~UpdateCRC(data.data() + done, data.size() - done, crc);
+}
+
+void SHA1::Update(std::span<const uint8_t> data) {
+    length += data.size();
+    if (buffered) {
+        const size_t count = std::min(data.size(), sizeof(buffer) - buffered);
+        std::memcpy(buffer + buffered, data.data(), count);
+        buffered += count;
+        data = data.subspan(count);
+        if (buffered < sizeof(buffer)) {
+            return;
+        }
+        ProcessBlock(buffer);
+        buffered = 0;
+    }
+    for (; data.size() >= sizeof(buffer); data = data.subspan(sizeof(buffer))) {
+        ProcessBlock(data.data());
+    }
+    std::memcpy(buffer, data.data(), data.size());
+    buffered = data.size();
+}
+
+SHA1::Digest SHA1::Final() {
+    // A 1 bit, zeros up to 8 bytes before a block end, then the message length in bits
+    const uint64_t bits = length * 8;
+    const uint8_t one = 0x80;
+    Update({ &one, 1 });
+    const uint8_t zero = 0;
+    while (buffered != sizeof(buffer) - 8) {
+        Update({ &zero, 1 });
+    }
+    uint8_t size[8];
+    for (int i = 0; i < 8; ++i) {
+        size[i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+    }
+    Update(size);
+
+    Digest digest;
+    for (size_t i = 0; i < digest.size(); ++i) {
+        digest[i] = static_cast<uint8_t>(state[i / 4] >> (24 - (i % 4) * 8));
+    }
+    return digest;
+}
+
+void SHA1::ProcessBlock(const uint8_t* block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = (block[i * 4] << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = std::rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f;
+        uint32_t k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        const uint32_t temp = std::rotl(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = std::rotl(b, 30);
+        b = a;
+        a = temp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "pch.h"
+
+#include <array>
+#include <span>
+
+// CRC-32 as used by zip and ROM databases. Pass the previous result back in to continue a
+// running checksum over data arriving in pieces.
+uint32_t CRC32(std::span<const uint8_t> data, uint32_t crc = 0);
+
+// Streaming SHA-1
+// https://datatracker.ietf.org/doc/html/rfc3174
+class SHA1 {
+public:
+    using Digest = std::array<uint8_t, 20>;
+
+    void Update(std::span<const uint8_t> data);
+    // Pads the message, the object is spent afterwards
+    Digest Final();
+
+private:
+    void ProcessBlock(const uint8_t* block);
+
+    uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint8_t buffer[64] = {};
+    size_t buffered = 0;
+    uint64_t length = 0;
+};
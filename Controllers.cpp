@@ -0,0 +1,39 @@
+#include "Controllers.h"
+
+void Controllers::PowerOn() {
+    shift[0] = shift[1] = 0;
+    strobe = false;
+}
+
+void Controllers::Write(uint8_t value, uint64_t frame) {
+    strobe = value & 1;
+    if (strobe) {
+        Latch(frame);
+    }
+}
+
+uint8_t Controllers::Read(int port) {
+    // While strobed the register keeps reloading, so it always returns A
+    const uint8_t bit = shift[port] & 1;
+    if (!strobe) {
+        shift[port] = static_cast<uint8_t>(shift[port] >> 1 | 0x80);
+    }
+    return OpenBus | bit;
+}
+
+uint8_t Controllers::Peek(int port) const {
+    return OpenBus | (shift[port] & 1);
+}
+
+void Controllers::Latch(uint64_t frame) {
+    uint8_t buttons[2] = { held[0], held[1] };
+    if (movie) {
+        buttons[0] = movie->GetButtons(frame, 0);
+        buttons[1] = movie->GetButtons(frame, 1);
+    }
+    if (recorder) {
+        recorder->Record(frame, buttons);
+    }
+    shift[0] = buttons[0];
+    shift[1] = buttons[1];
+}
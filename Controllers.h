@@ -0,0 +1,41 @@
+#pragma once
+
+#include "pch.h"
+
+#include "Movie.h"
+
+// Standard controllers on both ports
+// https://www.nesdev.org/wiki/Standard_controller
+//
+// Writing bit 0 of $4016 sets the strobe, while it is set the buttons are reloaded into the
+// shift registers. Reads of $4016 and $4017 return the next button of port 1 and 2 in bit 0,
+// A first, and 1 once all 8 are out. The buttons come from the movie being played when there
+// is one, by the PPU frame they are latched on, otherwise from SetButtons.
+class Controllers {
+public:
+    void PowerOn();
+
+    void Write(uint8_t value, uint64_t frame);
+    uint8_t Read(int port);
+    // Without shifting, for tracing
+    uint8_t Peek(int port) const;
+
+    // Buttons held on a port, see Button
+    void SetButtons(int port, uint8_t buttons) { held[port] = buttons; }
+    // Play the movie's input instead, nullptr to stop
+    void SetMovie(Movie* movie) { this->movie = movie; }
+    // Record the input latched on every frame, nullptr to stop
+    void SetRecorder(MovieWriter* recorder) { this->recorder = recorder; }
+
+private:
+    void Latch(uint64_t frame);
+
+    // The upper bits of the data bus are left from the address, $40
+    static constexpr uint8_t OpenBus = 0x40;
+
+    uint8_t held[2] = {};
+    uint8_t shift[2] = {};
+    bool strobe = false;
+    Movie* movie = nullptr;
+    MovieWriter* recorder = nullptr;
+};
@@ -0,0 +1,119 @@
+#include "Counters.h"
+
+#include "InstrTable.h"
+
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr std::string_view RegionNames[BusRegion_Count] = { "ram", "ppu", "apuIO", "cartridge" };
+constexpr std::string_view CounterNames[Counter_Count] = {
+    "nmis", "irqs", "oamDMACycles", "dmcDMACycles", "mapperWrites", "prgBankSwitches", "chrBankSwitches", "frames"
+};
+
+} // namespace
+
+// Blocks are never freed, a thread's counts stay part of the totals after it exits
+struct Counters::Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Block>> blocks;
+    std::vector<Block*> free;
+
+    static Registry& Get() {
+        static Registry registry;
+        return registry;
+    }
+};
+
+Counters::Block& Counters::AcquireBlock() {
+    Registry& registry = Registry::Get();
+    std::lock_guard lock(registry.mutex);
+    Block* block;
+    if (!registry.free.empty()) {
+        block = registry.free.back();
+        registry.free.pop_back();
+    } else {
+        block = registry.blocks.emplace_back(std::make_unique<Block>()).get();
+    }
+
+    // Hands the block back for the next thread on exit
+    struct Release {
+        Block* block;
+        ~Release() {
+            Registry& registry = Registry::Get();
+            std::lock_guard lock(registry.mutex);
+            registry.free.push_back(block);
+        }
+    };
+    static thread_local Release release{ block };
+    return *block;
+}
+
+Counters::Totals Counters::Aggregate() {
+    Totals totals;
+    auto sum = [](auto& total, const auto& counts) {
+        for (size_t i = 0; i < total.size(); ++i) {
+            total[i] += counts[i].load(std::memory_order_relaxed);
+        }
+    };
+
+    Registry& registry = Registry::Get();
+    std::lock_guard lock(registry.mutex);
+    for (const auto& block : registry.blocks) {
+        sum(totals.opcodes, block->opcodes);
+        sum(totals.reads, block->reads);
+        sum(totals.writes, block->writes);
+        sum(totals.events, block->events);
+    }
+    return totals;
+}
+
+std::string Counters::FormatJSON(const Totals& totals) {
+    std::string out;
+    auto it = std::back_inserter(out);
+    uint64_t instructions = 0;
+    for (uint64_t count : totals.opcodes) {
+        instructions += count;
+    }
+
+    fmt::format_to(it, "{{\"instructions\":{},\"opcodes\":{{", instructions);
+    const char* separator = "";
+    for (size_t opcode = 0; opcode < totals.opcodes.size(); ++opcode) {
+        if (totals.opcodes[opcode]) {
+            const InstrData& instr = InstrDataTable[opcode];
+            fmt::format_to(it, "{}\"{:02X} {} {}\":{}", separator, opcode, instr.mnemonic,
+                AddrModeDataTable[instr.mode].mnemonic, totals.opcodes[opcode]);
+            separator = ",";
+        }
+    }
+    for (auto [name, counts] : { std::pair{ "reads", &totals.reads }, std::pair{ "writes", &totals.writes } }) {
+        fmt::format_to(it, "}},\"{}\":{{", name);
+        for (size_t region = 0; region < BusRegion_Count; ++region) {
+            fmt::format_to(it, "{}\"{}\":{}", region ? "," : "", RegionNames[region], (*counts)[region]);
+        }
+    }
+    out += '}';
+    for (size_t counter = 0; counter < Counter_Count; ++counter) {
+        fmt::format_to(it, ",\"{}\":{}", CounterNames[counter], totals.events[counter]);
+    }
+    out += '}';
+    return out;
+}
+
+CounterLog::CounterLog(const char* path) : file(path, std::ios::binary), path(path) {
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to open counter log {}", path));
+    }
+}
+
+void CounterLog::Write() {
+    file << Counters::FormatJSON(Counters::Aggregate()) << '\n';
+    file.flush();
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to write counter log {}", path));
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "pch.h"
+
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <string>
+
+// The components only count when built with NES2_COUNTERS, without it every Count call is
+// compiled out
+#ifdef NES2_COUNTERS
+constexpr bool CountersEnabled = true;
+#else
+constexpr bool CountersEnabled = false;
+#endif
+
+// https://www.nesdev.org/wiki/CPU_memory_map
+enum BusRegion : uint8_t {
+    BusRegion_RAM,       // $0000-$1FFF
+    BusRegion_PPU,       // $2000-$3FFF
+    BusRegion_APUIO,     // $4000-$401F
+    BusRegion_Cartridge, // $4020-$FFFF
+    BusRegion_Count
+};
+
+enum Counter : uint8_t {
+    Counter_NMIs,
+    Counter_IRQs,
+    Counter_OAMDMACycles,
+    Counter_DMCDMACycles,
+    Counter_MapperWrites,    // Writes to $8000-$FFFF, where mappers have their registers
+    Counter_PrgBankSwitches, // Cartridge writes that changed what PRG ROM is mapped where
+    Counter_ChrBankSwitches, // Cartridge writes that changed the CHR banks
+    Counter_Frames,
+    Counter_Count
+};
+
+// Event counts of the whole process.
+//
+// Each thread counts into its own block, aligned to cache lines so threads never share one.
+// Only the owning thread writes its block, so a count is a relaxed load and store rather than
+// a locked add, and Aggregate reads the blocks of all threads without stopping them.
+class Counters {
+public:
+    struct Totals {
+        std::array<uint64_t, 256> opcodes{};
+        std::array<uint64_t, BusRegion_Count> reads{};
+        std::array<uint64_t, BusRegion_Count> writes{};
+        std::array<uint64_t, Counter_Count> events{};
+    };
+
+    static void CountInstruction(uint8_t opcode) {
+        if constexpr (CountersEnabled) {
+            Add(GetBlock().opcodes[opcode], 1);
+        }
+    }
+    static void CountRead(Addr address) {
+        if constexpr (CountersEnabled) {
+            Add(GetBlock().reads[GetRegion(address)], 1);
+        }
+    }
+    static void CountWrite(Addr address) {
+        if constexpr (CountersEnabled) {
+            Add(GetBlock().writes[GetRegion(address)], 1);
+        }
+    }
+    static void Count(Counter counter, uint64_t count = 1) {
+        if constexpr (CountersEnabled) {
+            Add(GetBlock().events[counter], count);
+        }
+    }
+
+    // Sum of every thread's counts so far, threads that exited included
+    static Totals Aggregate();
+    // The totals as a one line JSON object
+    static std::string FormatJSON(const Totals& totals);
+
+private:
+    struct alignas(64) Block {
+        std::array<std::atomic<uint64_t>, 256> opcodes{};
+        std::array<std::atomic<uint64_t>, BusRegion_Count> reads{};
+        std::array<std::atomic<uint64_t>, BusRegion_Count> writes{};
+        std::array<std::atomic<uint64_t>, Counter_Count> events{};
+    };
+
+    static void Add(std::atomic<uint64_t>& counter, uint64_t count) {
+        counter.store(counter.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+
+    static BusRegion GetRegion(Addr address) {
+        if (address < 0x2000) {
+            return BusRegion_RAM;
+        }
+        if (address < 0x4000) {
+            return BusRegion_PPU;
+        }
+        return address < 0x4020 ? BusRegion_APUIO : BusRegion_Cartridge;
+    }
+
+    static Block& GetBlock() {
+        // A plain pointer, unlike an object with a destructor it needs no guard on every access
+        static thread_local Block* block = nullptr;
+        if (!block) [[unlikely]] {
+            block = &AcquireBlock();
+        }
+        return *block;
+    }
+    // Takes over the block of an exited thread or allocates one, returned when the thread exits
+    static Block& AcquireBlock();
+
+    struct Registry;
+};
+
+// Writes counter snapshots to a file as JSON Lines, one object per snapshot
+class CounterLog {
+public:
+    explicit CounterLog(const char* path);
+
+    // Appends a snapshot of the current totals
+    void Write();
+
+private:
+    std::ofstream file;
+    std::string path;
+};
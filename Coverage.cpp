@@ -0,0 +1,89 @@
+#include "Coverage.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+constexpr char Magic[4] = { 'N', 'C', 'O', 'V' };
+
+struct Header {
+    char magic[4];
+    uint32_t prgSize;
+    uint32_t chrSize;
+    uint32_t ramSize;
+};
+
+void Pack(const std::vector<uint8_t>& flags, std::vector<uint8_t>& out) {
+    for (size_t i = 0; i < flags.size(); i += 2) {
+        const uint8_t high = i + 1 < flags.size() ? flags[i + 1] : 0;
+        out.push_back(static_cast<uint8_t>((flags[i] & 0x0F) | (high << 4)));
+    }
+}
+
+size_t PackedSize(size_t size) {
+    return (size + 1) / 2;
+}
+
+std::vector<uint8_t> Unpack(std::span<const uint8_t> packed, size_t size) {
+    std::vector<uint8_t> flags(size);
+    for (size_t i = 0; i < size; ++i) {
+        flags[i] = (packed[i / 2] >> ((i & 1) * 4)) & 0x0F;
+    }
+    return flags;
+}
+
+} // namespace
+
+void CoverageMap::Save(const char* path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to open coverage file {}", path));
+    }
+
+    Header header{ {}, static_cast<uint32_t>(prg.size()), static_cast<uint32_t>(chr.size()), static_cast<uint32_t>(ram.size()) };
+    std::copy(std::begin(Magic), std::end(Magic), header.magic);
+    std::vector<uint8_t> packed;
+    packed.reserve(PackedSize(prg.size()) + PackedSize(chr.size()) + PackedSize(ram.size()));
+    Pack(prg, packed);
+    Pack(chr, packed);
+    Pack(ram, packed);
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to write coverage file {}", path));
+    }
+}
+
+CoverageMap CoverageMap::Load(const char* path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to open coverage file {}", path));
+    }
+    const std::vector<uint8_t> data{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+    Header header;
+    if (data.size() < sizeof(header)) {
+        throw std::runtime_error(fmt::format("Coverage file {} is truncated", path));
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (!std::equal(std::begin(Magic), std::end(Magic), header.magic)) {
+        throw std::runtime_error(fmt::format("{} is not a coverage file", path));
+    }
+    const size_t packedSize = PackedSize(header.prgSize) + PackedSize(header.chrSize) + PackedSize(header.ramSize);
+    if (data.size() != sizeof(header) + packedSize) {
+        throw std::runtime_error(fmt::format("Coverage file {} has {} bytes, expected {}", path, data.size(), sizeof(header) + packedSize));
+    }
+
+    std::span<const uint8_t> packed = std::span(data).subspan(sizeof(header));
+    CoverageMap map;
+    map.prg = Unpack(packed, header.prgSize);
+    packed = packed.subspan(PackedSize(header.prgSize));
+    map.chr = Unpack(packed, header.chrSize);
+    packed = packed.subspan(PackedSize(header.chrSize));
+    map.ram = Unpack(packed, header.ramSize);
+    return map;
+}
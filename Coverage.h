@@ -0,0 +1,83 @@
+#pragma once
+
+#include "pch.h"
+
+#include "Cartridge.h"
+
+#include <atomic>
+#include <span>
+#include <vector>
+
+// The components only record coverage when built with NES2_COVERAGE, without it the hooks and
+// their checks are compiled out
+#ifdef NES2_COVERAGE
+constexpr bool CoverageEnabled = true;
+#else
+constexpr bool CoverageEnabled = false;
+#endif
+
+// How a byte was used, any number of them
+enum CoverageFlag : uint8_t {
+    CoverageFlag_Opcode  = 0x01, // Executed as an instruction's opcode
+    CoverageFlag_Operand = 0x02, // Fetched as an instruction's operand
+    CoverageFlag_Read    = 0x04, // Read as data, CHR by the PPU
+    CoverageFlag_Write   = 0x08  // Written, for PRG ROM a mapper register write
+};
+
+// Coverage flags of every byte of PRG ROM and CHR memory by offset, so the same address in
+// different banks is told apart, and of the 2KB of internal RAM.
+//
+// The file is a header with the sizes followed by the flags of PRG ROM, CHR and RAM in that
+// order, packed two bytes to a file byte with the even offset in the low nibble.
+struct CoverageMap {
+    std::vector<uint8_t> prg;
+    std::vector<uint8_t> chr;
+    std::vector<uint8_t> ram;
+
+    void Save(const char* path) const;
+    static CoverageMap Load(const char* path);
+};
+
+// Records the coverage of one cartridge. The CPU marks its bus accesses on the emulation
+// thread, each a single OR into the flag byte. The PPU marks CHR from its pattern fetches,
+// which run on the renderer threads too, those OR atomically but only the first time.
+class Coverage {
+public:
+    explicit Coverage(Cartridge& cartridge) :
+        cartridge(cartridge),
+        chrMemory(cartridge.GetChrMemory()) {
+        map.prg.resize(cartridge.GetPrgRom().size());
+        map.chr.resize(chrMemory.size());
+        map.ram.resize(0x800);
+    }
+
+    void MarkCPU(Addr address, uint8_t flags) {
+        if (address < 0x2000) {
+            map.ram[address & 0x7FF] |= flags;
+        } else if (address >= 0x8000) {
+            const size_t offset = cartridge.GetPrgRomOffset(address);
+            if (offset != Mapper::NotPrgRom) {
+                map.prg[offset] |= flags;
+            }
+        }
+    }
+    // A byte the PPU accessed through a CHR bank pointer. Copies of CHR RAM taken for the
+    // renderer threads aren't the cartridge's memory and go unmarked.
+    void MarkChr(const uint8_t* byte, uint8_t flags) {
+        if (byte < chrMemory.data() || byte >= chrMemory.data() + chrMemory.size()) {
+            return;
+        }
+        std::atomic_ref<uint8_t> marked(map.chr[byte - chrMemory.data()]);
+        if ((marked.load(std::memory_order_relaxed) & flags) != flags) {
+            marked.fetch_or(flags, std::memory_order_relaxed);
+        }
+    }
+
+    // Only consistent once the renderer threads are done with the frames
+    const CoverageMap& GetMap() const { return map; }
+
+private:
+    Cartridge& cartridge;
+    std::span<const uint8_t> chrMemory;
+    CoverageMap map;
+};
@@ -0,0 +1,130 @@
+#include "Debugger.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr std::string_view FieldNames[] = { "A", "X", "Y", "S", "P", "value" };
+
+// Number of at most the given value, hex ones with an optional $
+uint32_t ParseNumber(std::string_view text, int base, uint32_t max, std::string_view spec) {
+    if (base == 16 && text.starts_with('$')) {
+        text.remove_prefix(1);
+    }
+    size_t end = 0;
+    uint64_t value = 0;
+    try {
+        value = std::stoull(std::string(text), &end, base);
+    } catch (const std::exception&) {
+        end = 0;
+    }
+    VERIFY(!text.empty() && end == text.size() && value <= max, "Invalid number in breakpoint", text, spec);
+    return static_cast<uint32_t>(value);
+}
+
+} // namespace
+
+Debugger::Breakpoint Debugger::Breakpoint::Parse(std::string_view spec, uint8_t access) {
+    Breakpoint breakpoint{ access, 0, 0, {} };
+    std::string_view rest = spec;
+    auto next = [&] {
+        const size_t colon = rest.find(':');
+        std::string_view part = rest.substr(0, colon);
+        rest = colon == std::string_view::npos ? std::string_view{} : rest.substr(colon + 1);
+        return part;
+    };
+
+    const std::string_view range = next();
+    const size_t dash = range.find('-');
+    breakpoint.first = static_cast<Addr>(ParseNumber(range.substr(0, dash), 16, 0xFFFF, spec));
+    breakpoint.last = dash == std::string_view::npos ? breakpoint.first : static_cast<Addr>(ParseNumber(range.substr(dash + 1), 16, 0xFFFF, spec));
+    VERIFY(breakpoint.first <= breakpoint.last, "Breakpoint range ends before it starts", spec);
+
+    while (!rest.empty()) {
+        const std::string_view condition = next();
+        const size_t equals = condition.find('=');
+        VERIFY(equals != std::string_view::npos, "Breakpoint condition needs a value", condition, spec);
+        const std::string_view name = condition.substr(0, equals);
+        const std::string_view value = condition.substr(equals + 1);
+        if (name == "hits") {
+            const uint32_t hits = ParseNumber(value, 10, UINT32_MAX, spec);
+            VERIFY(hits > 0, "Breakpoint hit count starts at 1", spec);
+            breakpoint.hitsBefore = hits - 1;
+            continue;
+        }
+        const auto field = std::ranges::find(FieldNames, name);
+        VERIFY(field != std::end(FieldNames), "Unknown breakpoint condition", name, spec);
+        breakpoint.conditions.push_back({ static_cast<Field>(field - std::begin(FieldNames)),
+            static_cast<uint8_t>(ParseNumber(value, 16, 0xFF, spec)) });
+    }
+    return breakpoint;
+}
+
+Debugger::~Debugger() {
+    SetArmed(false);
+}
+
+void Debugger::Add(Breakpoint breakpoint) {
+    for (uint32_t address = breakpoint.first; address <= breakpoint.last; ++address) {
+        watched[address] |= breakpoint.access;
+    }
+    breakpoints.push_back(std::move(breakpoint));
+    SetArmed(true);
+}
+
+void Debugger::Clear() {
+    watched.fill(0);
+    breakpoints.clear();
+    SetArmed(false);
+}
+
+void Debugger::SetArmed(bool armed) {
+    if (armed != this->armed) {
+        if (armed) {
+            armedDebuggers.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            armedDebuggers.fetch_sub(1, std::memory_order_relaxed);
+        }
+        this->armed = armed;
+    }
+}
+
+bool Debugger::Trigger(Access access, Addr address, uint8_t value, const Registers& registers) {
+    auto fieldValue = [&](Field field) {
+        switch (field) {
+        case Field_A: return registers.A;
+        case Field_X: return registers.X;
+        case Field_Y: return registers.Y;
+        case Field_S: return registers.S;
+        case Field_P: return registers.P;
+        case Field_Value: return value;
+        }
+        return uint8_t{ 0 };
+    };
+
+    bool triggered = false;
+    for (Breakpoint& breakpoint : breakpoints) {
+        if (!(breakpoint.access & access) || address < breakpoint.first || address > breakpoint.last) {
+            continue;
+        }
+        if (!std::ranges::all_of(breakpoint.conditions, [&](const Condition& condition) { return fieldValue(condition.field) == condition.value; })) {
+            continue;
+        }
+        if (breakpoint.hits++ < breakpoint.hitsBefore) {
+            continue;
+        }
+        triggered = true;
+        if (hitCallback) {
+            hitCallback({ access, address, value, registers, breakpoint });
+        }
+    }
+    return triggered;
+}
+
+std::string Debugger::Format(const Hit& hit) {
+    const char* kind = hit.access == Access_Execute ? "Execute" : hit.access == Access_Read ? "Read" : "Write";
+    // Registers as NESTest logs them
+    return fmt::format("{} ${:04X} value ${:02X} hit {} at PC ${:04X} A:{:02X} X:{:02X} Y:{:02X} P:{:02X} SP:{:02X}",
+        kind, hit.address, hit.value, hit.breakpoint.hits, hit.registers.PC, hit.registers.A, hit.registers.X,
+        hit.registers.Y, hit.registers.P, hit.registers.S);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "pch.h"
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum Access : uint8_t {
+    Access_Execute = 0x01,
+    Access_Read    = 0x02,
+    Access_Write   = 0x04
+};
+
+// Breakpoints on executing an address and watchpoints on the CPU reading or writing it.
+//
+// Every address has a byte of Access bits for what is being watched there, so the CPU's check
+// on an instruction or bus access is a single bit test. With no breakpoint set anywhere in the
+// process a global flag skips even that. Conditions on registers, the value and hit counts are
+// only evaluated once the bit test hits.
+class Debugger {
+public:
+    struct Registers {
+        uint8_t A;
+        uint8_t X;
+        uint8_t Y;
+        uint8_t S;
+        uint8_t P;
+        Addr PC; // Of the instruction being executed
+    };
+
+    enum Field : uint8_t {
+        Field_A,
+        Field_X,
+        Field_Y,
+        Field_S,
+        Field_P,
+        Field_Value // Byte read or written, the opcode for execute
+    };
+
+    struct Condition {
+        Field field;
+        uint8_t value;
+    };
+
+    struct Breakpoint {
+        uint8_t access; // Access bits
+        Addr first;
+        Addr last;
+        std::vector<Condition> conditions;
+        // Triggers from the nth time the address is hit with the conditions met
+        uint64_t hitsBefore = 0;
+        uint64_t hits = 0;
+
+        // "<address>[-<last>][:<field>=<value>...][:hits=<n>]" with hex addresses and values,
+        // e.g. "C000", "0300-03FF:value=FF" or "8123:A=00:X=10:hits=3"
+        static Breakpoint Parse(std::string_view spec, uint8_t access);
+    };
+
+    struct Hit {
+        Access access;
+        Addr address;
+        uint8_t value;
+        Registers registers;
+        const Breakpoint& breakpoint;
+    };
+    // Called for every triggered breakpoint, may stop the system
+    using HitCallback = std::function<void(const Hit&)>;
+
+    Debugger() = default;
+    ~Debugger();
+    Debugger(const Debugger&) = delete;
+    Debugger& operator=(const Debugger&) = delete;
+
+    void Add(Breakpoint breakpoint);
+    void Clear();
+    void SetHitCallback(HitCallback callback) { hitCallback = std::move(callback); }
+
+    // Whether any debugger in the process has a breakpoint, checked before every other test
+    static bool IsAnyArmed() { return armedDebuggers.load(std::memory_order_relaxed) != 0; }
+
+    bool IsWatched(Access access, Addr address) const { return watched[address] & access; }
+    // Evaluates the breakpoints on a watched address and calls back for those that trigger,
+    // true if any did
+    bool Trigger(Access access, Addr address, uint8_t value, const Registers& registers);
+    bool Check(Access access, Addr address, uint8_t value, const Registers& registers) {
+        return IsWatched(access, address) && Trigger(access, address, value, registers);
+    }
+
+    static std::string Format(const Hit& hit);
+
+private:
+    void SetArmed(bool armed);
+
+    std::array<uint8_t, 0x10000> watched{};
+    std::vector<Breakpoint> breakpoints;
+    HitCallback hitCallback;
+    bool armed = false;
+
+    static inline std::atomic<uint32_t> armedDebuggers{ 0 };
+};
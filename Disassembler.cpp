@@ -0,0 +1,348 @@
+#include "Disassembler.h"
+
+#include "Coverage.h"
+#include "InstrTable.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+// Vectors in the order their labels are preferred when they share a target
+// https://www.nesdev.org/wiki/CPU_memory_map
+constexpr std::pair<Addr, std::string_view> Vectors[] = {
+    { 0xFFFC, "RESET" },
+    { 0xFFFA, "NMI" },
+    { 0xFFFE, "IRQ" }
+};
+constexpr Addr VectorStart = 0xFFFA;
+
+// Appends one instruction as listed, code starts at its opcode. Flow targets are named by
+// label(target), or by address when that is empty. Returns the instruction size.
+template <typename Label>
+size_t AppendInstruction(std::span<const uint8_t> code, Addr address, const Label& label, std::string& out) {
+    auto it = std::back_inserter(out);
+    const uint8_t opcode = code[0];
+    const InstrData& instr = InstrDataTable[opcode];
+    const size_t size = AddrModeDataTable[instr.mode].size;
+    const uint8_t lo = size > 1 ? code[1] : 0;
+    const uint8_t hi = size > 2 ? code[2] : 0;
+    const Addr absolute = static_cast<Addr>(lo | (hi << 8));
+
+    fmt::format_to(it, "{:04X}  {:02X} ", address, opcode);
+    for (size_t i = 1; i < 3; ++i) {
+        if (i < size) {
+            fmt::format_to(it, "{:02X} ", code[i]);
+        } else {
+            out += "   ";
+        }
+    }
+    fmt::format_to(it, " {:<4} ", instr.mnemonic);
+
+    auto target = [&](Addr target) {
+        std::string name = label(target);
+        return name.empty() ? fmt::format("${:04X}", target) : name;
+    };
+    switch (instr.mode) {
+    case Addr_Implicit:
+    case Addr_Illegal:
+        break;
+    case Addr_Accumulator: out += 'A'; break;
+    case Addr_Immediate: fmt::format_to(it, "#${:02X}", lo); break;
+    case Addr_ZeroPage: fmt::format_to(it, "${:02X}", lo); break;
+    case Addr_ZeroPageX: fmt::format_to(it, "${:02X},X", lo); break;
+    case Addr_ZeroPageY: fmt::format_to(it, "${:02X},Y", lo); break;
+    case Addr_Absolute:
+        out += opcode == OP_JSR_ABS || opcode == OP_JMP_ABS ? target(absolute) : fmt::format("${:04X}", absolute);
+        break;
+    case Addr_AbslX: fmt::format_to(it, "${:04X},X", absolute); break;
+    case Addr_AbslY: fmt::format_to(it, "${:04X},Y", absolute); break;
+    case Addr_Indirect: fmt::format_to(it, "(${:04X})", absolute); break;
+    case Addr_IndirX: fmt::format_to(it, "(${:02X},X)", lo); break;
+    case Addr_IndirY: fmt::format_to(it, "(${:02X}),Y", lo); break;
+    case Addr_Relative:
+        out += target(static_cast<Addr>(address + 2 + static_cast<int8_t>(lo)));
+        break;
+    }
+    // Trim the padding of operandless instructions
+    while (out.back() == ' ') {
+        out.pop_back();
+    }
+    return size;
+}
+
+} // namespace
+
+Disassembler::Disassembler(std::span<const uint8_t> prgRom) {
+    VERIFY(!prgRom.empty() && prgRom.size() % BankSize == 0, "PRG ROM must be a multiple of 16KB", prgRom.size());
+
+    // NROM maps up to 32KB at $8000, 16KB is mirrored
+    if (prgRom.size() <= 2 * BankSize) {
+        banks.push_back({ 0, prgRom, 0x8000, 0x10000, {}, {} });
+    } else {
+        const size_t count = prgRom.size() / BankSize;
+        for (size_t i = 0; i < count; ++i) {
+            const bool fixed = i + 1 == count;
+            banks.push_back({ static_cast<uint16_t>(i), prgRom.subspan(i * BankSize, BankSize),
+                fixed ? 0xC000u : 0x8000u, fixed ? 0x10000u : 0xC000u, {}, {} });
+        }
+    }
+    for (Bank& bank : banks) {
+        bank.types.assign(bank.rom.size(), ByteType_Data);
+    }
+}
+
+void Disassembler::SetCoverage(std::span<const uint8_t> prgCoverage) {
+    const size_t prgSize = static_cast<size_t>(GetFixedBank().rom.data() + GetFixedBank().rom.size() - banks.front().rom.data());
+    VERIFY(prgCoverage.size() == prgSize, "Coverage is for a different PRG ROM size", prgCoverage.size(), prgSize);
+    for (Bank& bank : banks) {
+        bank.coverage = prgCoverage.subspan(static_cast<size_t>(bank.rom.data() - banks.front().rom.data()), bank.rom.size());
+    }
+}
+
+std::vector<Addr> Disassembler::GetExecutedEntries(const Bank& bank) const {
+    std::vector<Addr> entries;
+    for (size_t offset = 0; offset < bank.coverage.size(); ++offset) {
+        if (bank.coverage[offset] & CoverageFlag_Opcode) {
+            entries.push_back(bank.GetAddress(offset));
+        }
+    }
+    return entries;
+}
+
+void Disassembler::Analyze(size_t threads) {
+    Bank& fixed = GetFixedBank();
+    std::vector<Reference> fixedEntries;
+    for (auto [vector, name] : Vectors) {
+        const size_t offset = fixed.GetOffset(vector);
+        fixedEntries.push_back({ static_cast<Addr>(fixed.rom[offset] | (fixed.rom[offset + 1] << 8)), fixed.index, vector });
+    }
+    std::fill(fixed.types.end() - (0x10000 - VectorStart), fixed.types.end(), ByteType_Vector);
+
+    // The fixed bank decides where the switchable banks are entered, and they may call back
+    // into code of the fixed bank nothing else reached. Usually settles in two rounds. Code
+    // the coverage saw executed is traced in the first round, every bank has its own.
+    bool firstRound = true;
+    while (firstRound || !fixedEntries.empty()) {
+        const std::vector<Reference> switchableEntries = Trace(fixed, std::exchange(fixedEntries, {}),
+            firstRound ? GetExecutedEntries(fixed) : std::vector<Addr>{});
+        if (switchableEntries.empty() && (!firstRound || fixed.coverage.empty())) {
+            break;
+        }
+
+        // Banks only touch their own state while tracing, references out are merged after
+        std::vector<std::vector<Reference>> exits(banks.size() - 1);
+        ParallelFor(banks.size() - 1, threads, [&](size_t i) {
+            exits[i] = Trace(banks[i], switchableEntries, firstRound ? GetExecutedEntries(banks[i]) : std::vector<Addr>{});
+        });
+        firstRound = false;
+        for (const auto& bankExits : exits) {
+            std::ranges::copy_if(bankExits, std::back_inserter(fixedEntries),
+                [&](const Reference& reference) { return fixed.Contains(reference.target); });
+        }
+    }
+
+    for (Bank& bank : banks) {
+        std::ranges::stable_sort(bank.references, {}, &std::pair<size_t, Reference>::first);
+    }
+}
+
+std::vector<Disassembler::Reference> Disassembler::Trace(Bank& bank, std::vector<Reference> entries, std::span<const Addr> executed) {
+    std::vector<Reference> exits;
+    // Executed code goes last, after everything the references reach
+    std::vector<Addr> pending(executed.begin(), executed.end());
+    for (const Reference& entry : entries) {
+        if (!bank.Contains(entry.target)) {
+            continue;
+        }
+        bank.references.emplace_back(bank.GetOffset(entry.target), entry);
+        pending.push_back(entry.target);
+    }
+
+    // Instructions from a jump, call or branch target until the flow ends
+    auto follow = [&](Addr target, Addr source) {
+        if (bank.Contains(target)) {
+            bank.references.emplace_back(bank.GetOffset(target), Reference{ target, bank.index, source });
+            pending.push_back(target);
+        } else if (target >= 0x8000) {
+            exits.push_back({ target, bank.index, source });
+        }
+    };
+
+    while (!pending.empty()) {
+        Addr address = pending.back();
+        pending.pop_back();
+
+        while (true) {
+            const size_t offset = bank.GetOffset(address);
+            if (!bank.Contains(address) || bank.types[offset] != ByteType_Data) {
+                break;
+            }
+            const uint8_t opcode = bank.rom[offset];
+            const InstrData& instr = InstrDataTable[opcode];
+            const size_t size = AddrModeDataTable[instr.mode].size;
+            // Instructions running into the vectors or off the bank are data after all
+            if (offset + size > bank.rom.size() ||
+                !std::all_of(bank.types.begin() + offset + 1, bank.types.begin() + offset + size, [](ByteType type) { return type == ByteType_Data; })) {
+                break;
+            }
+
+            bank.types[offset] = ByteType_Opcode;
+            std::fill_n(bank.types.begin() + offset + 1, size - 1, ByteType_Operand);
+            const Addr source = bank.GetAddress(offset);
+            const Addr operand = size == 3 ? static_cast<Addr>(bank.rom[offset + 1] | (bank.rom[offset + 2] << 8)) : 0;
+            address += static_cast<Addr>(size);
+
+            if (opcode == OP_JSR_ABS) {
+                follow(operand, source);
+            } else if (opcode == OP_JMP_ABS) {
+                follow(operand, source);
+                break;
+            } else if (instr.mode == Addr_Relative) {
+                follow(static_cast<Addr>(address + static_cast<int8_t>(bank.rom[offset + 1])), source);
+            } else if (opcode == OP_JMP_IND || opcode == OP_RTS_IMP || opcode == OP_RTI_IMP || opcode == OP_BRK_IMP ||
+                instr.mode == Addr_Illegal) {
+                // Indirect targets aren't known, jams never continue
+                break;
+            }
+        }
+    }
+    return exits;
+}
+
+size_t Disassembler::GetCodeBytes() const {
+    size_t count = 0;
+    for (const Bank& bank : banks) {
+        count += std::ranges::count_if(bank.types, [](ByteType type) { return type == ByteType_Opcode || type == ByteType_Operand; });
+    }
+    return count;
+}
+
+size_t Disassembler::GetExecutedBytes() const {
+    size_t count = 0;
+    for (const Bank& bank : banks) {
+        count += std::ranges::count_if(bank.coverage, [](uint8_t flags) { return flags & (CoverageFlag_Opcode | CoverageFlag_Operand); });
+    }
+    return count;
+}
+
+std::string Disassembler::FormatInstruction(std::span<const uint8_t> code, Addr address) {
+    std::string out;
+    AppendInstruction(code, address, [](Addr) { return std::string(); }, out);
+    return out;
+}
+
+std::string Disassembler::Format(size_t threads) const {
+    std::vector<std::string> listings(banks.size());
+    ParallelFor(banks.size(), threads, [&](size_t i) {
+        FormatBank(banks[i], listings[i]);
+    });
+
+    std::string out;
+    size_t size = 0;
+    for (const std::string& listing : listings) {
+        size += listing.size();
+    }
+    out.reserve(size);
+    for (const std::string& listing : listings) {
+        out += listing;
+    }
+    return out;
+}
+
+bool Disassembler::HasLabel(const Bank& bank, size_t offset) const {
+    auto it = std::ranges::lower_bound(bank.references, offset, {}, &std::pair<size_t, Reference>::first);
+    return it != bank.references.end() && it->first == offset && bank.types[offset] != ByteType_Operand;
+}
+
+std::string Disassembler::GetLabelAt(const Bank& bank, size_t offset) const {
+    auto [first, last] = std::ranges::equal_range(bank.references, offset, {}, &std::pair<size_t, Reference>::first);
+    if (&bank == &GetFixedBank()) {
+        for (auto [vector, name] : Vectors) {
+            if (std::any_of(first, last, [&](const auto& reference) { return reference.second.source == vector; })) {
+                return std::string(name);
+            }
+        }
+    }
+    return fmt::format("L_{:04X}", bank.GetAddress(offset));
+}
+
+std::string Disassembler::GetLabel(const Bank& from, Addr address) const {
+    // Targets in a switchable bank seen from the fixed bank could be in any of them
+    const Bank* bank = from.Contains(address) ? &from : GetFixedBank().Contains(address) ? &GetFixedBank() : nullptr;
+    if (!bank || !HasLabel(*bank, bank->GetOffset(address))) {
+        return {};
+    }
+    return GetLabelAt(*bank, bank->GetOffset(address));
+}
+
+void Disassembler::FormatBank(const Bank& bank, std::string& out) const {
+    auto it = std::back_inserter(out);
+    fmt::format_to(it, "; Bank {:02X} at ${:04X}-${:04X}{}\n", bank.index, bank.GetAddress(0),
+        bank.GetAddress(bank.rom.size() - 1), banks.size() > 1 && &bank == &GetFixedBank() ? ", fixed" : "");
+
+    size_t offset = 0;
+    while (offset < bank.rom.size()) {
+        const Addr address = bank.GetAddress(offset);
+
+        // Label with every place that jumps, calls or branches here
+        if (HasLabel(bank, offset)) {
+            out += '\n';
+            fmt::format_to(it, "{}:", GetLabelAt(bank, offset));
+            const char* separator = " ; xref ";
+            for (auto reference = std::ranges::lower_bound(bank.references, offset, {}, &std::pair<size_t, Reference>::first);
+                 reference != bank.references.end() && reference->first == offset; ++reference) {
+                const Reference& source = reference->second;
+                if (source.sourceBank == bank.index) {
+                    fmt::format_to(it, "{}{:04X}", separator, source.source);
+                } else {
+                    fmt::format_to(it, "{}{:02X}:{:04X}", separator, source.sourceBank, source.source);
+                }
+                separator = ", ";
+            }
+            out += '\n';
+        }
+
+        const ByteType type = bank.types[offset];
+        if (type == ByteType_Vector) {
+            const Addr target = static_cast<Addr>(bank.rom[offset] | (bank.rom[offset + 1] << 8));
+            const std::string label = GetLabel(bank, target);
+            fmt::format_to(it, "{:04X}  .word {}\n", address, label.empty() ? fmt::format("${:04X}", target) : label);
+            offset += 2;
+            continue;
+        }
+
+        if (type == ByteType_Data) {
+            // A row of up to 16 bytes, ending early at code and labels, and with coverage
+            // where the CPU starts or stops having read them
+            auto isRead = [&](size_t offset) { return !bank.coverage.empty() && (bank.coverage[offset] & CoverageFlag_Read); };
+            const bool read = isRead(offset);
+            size_t end = offset + 1;
+            while (end < bank.rom.size() && end - offset < 16 && bank.types[end] == ByteType_Data && !HasLabel(bank, end) &&
+                isRead(end) == read) {
+                end++;
+            }
+            fmt::format_to(it, "{:04X}  .byte ${:02X}", address, bank.rom[offset]);
+            for (size_t i = offset + 1; i < end; ++i) {
+                fmt::format_to(it, ",${:02X}", bank.rom[i]);
+            }
+            if (read) {
+                out += " ; read";
+            }
+            out += '\n';
+            offset = end;
+            continue;
+        }
+
+        // Flow targets by label when they have one
+        auto label = [&](Addr target) { return GetLabel(bank, target); };
+        const bool executed = bank.coverage.empty() || (bank.coverage[offset] & CoverageFlag_Opcode);
+        offset += AppendInstruction(bank.rom.subspan(offset), address, label, out);
+        if (!executed) {
+            out += " ; not executed";
+        }
+        out += '\n';
+    }
+    out += '\n';
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "pch.h"
+
+#include <span>
+#include <string>
+#include <vector>
+
+// Recursive traversal disassembler for PRG ROM.
+//
+// Only what the flow reaches from the reset, NMI and IRQ vectors through jumps, calls and
+// branches is code, everything else is listed as data. PRG ROM up to 32KB is one bank at the
+// top of the address space. Larger ROMs are split into 16KB banks with the last one fixed at
+// $C000 and the others switched in at $8000, the power on layout of MMC1 and UxROM. The
+// switchable banks are entered through the calls the fixed bank makes into $8000-$BFFF.
+//
+// Coverage recorded by the emulator adds what static tracing can't see: code executed is
+// traced from as well, which reaches the targets of indirect jumps and RTS tables, and the
+// listing tells data the CPU read from data nothing touched and code that never ran.
+class Disassembler {
+public:
+    explicit Disassembler(std::span<const uint8_t> prgRom);
+
+    // CoverageFlag bits per PRG ROM byte, see Coverage.h. Call before Analyze.
+    void SetCoverage(std::span<const uint8_t> prgCoverage);
+
+    // Trace the code of every bank, switchable banks on up to the given number of threads
+    void Analyze(size_t threads);
+    // Listing of every bank with labels and cross references, banks formatted in parallel
+    std::string Format(size_t threads) const;
+
+    size_t GetBankCount() const { return banks.size(); }
+    // Bytes traced as instructions, opcode and operands
+    size_t GetCodeBytes() const;
+    // Bytes the coverage saw executed as opcodes or operands
+    size_t GetExecutedBytes() const;
+
+    // One instruction as listed, without labels. code starts at the opcode and holds the operands.
+    static std::string FormatInstruction(std::span<const uint8_t> code, Addr address);
+
+private:
+    static constexpr size_t BankSize = 16384;
+
+    enum ByteType : uint8_t {
+        ByteType_Data,
+        ByteType_Opcode,
+        ByteType_Operand,
+        ByteType_Vector
+    };
+
+    // A jump, call, branch or vector to target, from the instruction at source in sourceBank
+    struct Reference {
+        Addr target;
+        uint16_t sourceBank;
+        Addr source;
+    };
+
+    struct Bank {
+        uint16_t index;
+        std::span<const uint8_t> rom;
+        // Addresses the bank is mapped at, mirrored when the window is larger than the bank
+        uint32_t windowStart;
+        uint32_t windowEnd;
+        std::vector<ByteType> types;
+        // References into the bank by target offset, sorted once analyzed
+        std::vector<std::pair<size_t, Reference>> references;
+        // CoverageFlag bits per byte, empty without coverage
+        std::span<const uint8_t> coverage = {};
+
+        // Address listed for an offset
+        Addr GetAddress(size_t offset) const { return static_cast<Addr>(windowEnd - rom.size() + offset); }
+        bool Contains(Addr address) const { return address >= windowStart && address < windowEnd; }
+        size_t GetOffset(Addr address) const { return (address - windowStart) % rom.size(); }
+    };
+
+    // Follows the flow from the entries, all targeting the bank. Returns the references that
+    // leave the bank's window for another bank.
+    std::vector<Reference> Trace(Bank& bank, std::vector<Reference> entries, std::span<const Addr> executed = {});
+    // Addresses the coverage saw executed as opcodes, the trace starts without labeling them
+    std::vector<Addr> GetExecutedEntries(const Bank& bank) const;
+    void FormatBank(const Bank& bank, std::string& out) const;
+    // Label of a traced address as seen from the given bank, empty if there is none
+    std::string GetLabel(const Bank& from, Addr address) const;
+    std::string GetLabelAt(const Bank& bank, size_t offset) const;
+    bool HasLabel(const Bank& bank, size_t offset) const;
+
+    Bank& GetFixedBank() { return banks.back(); }
+    const Bank& GetFixedBank() const { return banks.back(); }
+
+    std::vector<Bank> banks;
+};
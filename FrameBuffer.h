@@ -0,0 +1,85 @@
+#pragma once
+
+#include "pch.h"
+
+#include <array>
+#include <atomic>
+
+constexpr size_t FrameWidth = 256;
+constexpr size_t FrameHeight = 240;
+
+// One output pixel: the 6-bit palette index in bits 0-5 and the PPUMASK color emphasis
+// bits in 6-8, see Palette for conversion to RGB
+using Pixel = uint16_t;
+constexpr Pixel PixelIndexMask = 0x3F;
+constexpr Pixel PixelMask = 0x1FF;
+
+struct Frame {
+    uint64_t number = 0;
+    // False for frames skipped by the PPU present interval, pixels are stale then
+    bool presented = true;
+    std::array<Pixel, FrameWidth * FrameHeight> pixels{};
+
+    Pixel* Line(size_t y) { return &pixels[y * FrameWidth]; }
+    const Pixel* Line(size_t y) const { return &pixels[y * FrameWidth]; }
+};
+
+// Lock-free single producer, single consumer triple buffer.
+//
+// The producer always owns the back buffer and the consumer always owns the front buffer.
+// The third buffer sits in the middle slot, exchanged atomically on publish and acquire, so
+// neither side ever waits on or copies from the other. If the consumer falls behind, older
+// frames in the middle slot are overwritten and the consumer just sees the latest one.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : buffers(std::make_unique<T[]>(3)) {}
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    //
+    // Producer side
+    //
+
+    T& Back() { return buffers[back]; }
+
+    // Hand the back buffer over to the consumer and take whatever is in the middle slot
+    void Publish() {
+        back = middle.exchange(back | FreshBit, std::memory_order_acq_rel) & IndexMask;
+        published.fetch_add(1, std::memory_order_release);
+        published.notify_all();
+    }
+
+    //
+    // Consumer side
+    //
+
+    // Returns the latest published buffer, or nullptr if nothing new was published since the
+    // last call. The returned buffer stays valid and untouched until the next Acquire.
+    const T* Acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & FreshBit)) {
+            return nullptr;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & IndexMask;
+        return &buffers[front];
+    }
+
+    // Number of buffers published so far, usable with WaitForPublish
+    uint64_t PublishCount() const { return published.load(std::memory_order_acquire); }
+
+    // Block the calling (consumer) thread until more than `seen` buffers have been published
+    void WaitForPublish(uint64_t seen) const { published.wait(seen, std::memory_order_acquire); }
+
+private:
+    static constexpr uint8_t IndexMask = 0b011;
+    static constexpr uint8_t FreshBit = 0b100;
+
+    std::unique_ptr<T[]> buffers;
+
+    // Keep the shared slot away from the producer and consumer private indices
+    alignas(64) std::atomic<uint8_t> middle{1};
+    alignas(64) std::atomic<uint64_t> published{0};
+    alignas(64) uint8_t back = 0;
+    alignas(64) uint8_t front = 2;
+};
@@ -0,0 +1,157 @@
+#include "FrameHash.h"
+
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t Prime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+// Input is read little endian, which matches every host we build for
+uint64_t Read64(const uint8_t* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t Read32(const uint8_t* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint64_t Round(uint64_t acc, uint64_t input) {
+    acc += input * Prime2;
+    acc = std::rotl(acc, 31);
+    return acc * Prime1;
+}
+
+uint64_t MergeRound(uint64_t acc, uint64_t value) {
+    acc ^= Round(0, value);
+    return acc * Prime1 + Prime4;
+}
+
+} // namespace
+
+uint64_t Hash64(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    uint64_t hash;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + Prime1 + Prime2;
+        uint64_t v2 = seed + Prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - Prime1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+        }
+        hash = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+        hash = MergeRound(hash, v1);
+        hash = MergeRound(hash, v2);
+        hash = MergeRound(hash, v3);
+        hash = MergeRound(hash, v4);
+    } else {
+        hash = seed + Prime5;
+    }
+
+    hash += size;
+
+    for (; p + 8 <= end; p += 8) {
+        hash ^= Round(0, Read64(p));
+        hash = std::rotl(hash, 27) * Prime1 + Prime4;
+    }
+    if (p + 4 <= end) {
+        hash ^= Read32(p) * Prime1;
+        hash = std::rotl(hash, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        hash ^= *p * Prime5;
+        hash = std::rotl(hash, 11) * Prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+FrameHasher::FrameHasher(Mode mode) : mode(mode) {
+    if (mode == Mode_RGB) {
+        rgb.resize(FrameWidth * FrameHeight);
+    }
+}
+
+uint64_t FrameHasher::Hash(const Frame& frame) {
+    switch (mode) {
+    case Mode_Indices:
+        return Hash64(frame.pixels.data(), frame.pixels.size() * sizeof(Pixel));
+    case Mode_RGB:
+        palette.ToRGBA8888(frame, rgb.data());
+        return Hash64(rgb.data(), rgb.size() * sizeof(uint32_t));
+    }
+    LIBASSERT_UNREACHABLE;
+}
+
+void GoldenHashes::Load(const char* path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to open golden hash file {}", path));
+    }
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        uint64_t frame, hash;
+        fields >> std::dec >> frame >> std::hex >> hash;
+        if (!fields) {
+            throw std::runtime_error(fmt::format("Malformed golden hash at {}:{}", path, lineNumber));
+        }
+        hashes[frame] = hash;
+    }
+
+    SPDLOG_INFO("Loaded {} golden frame hashes from {}", hashes.size(), path);
+}
+
+void GoldenHashes::Save(const char* path) const {
+    fmt::memory_buffer out;
+    fmt::format_to(std::back_inserter(out), "# frame hash\n");
+    for (auto [frame, hash] : hashes) {
+        fmt::format_to(std::back_inserter(out), "{} {:016x}\n", frame, hash);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(out.data(), out.size());
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to write golden hash file {}", path));
+    }
+
+    SPDLOG_INFO("Saved {} frame hashes to {}", hashes.size(), path);
+}
+
+std::optional<uint64_t> GoldenHashes::Get(uint64_t frame) const {
+    auto it = hashes.find(frame);
+    if (it == hashes.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
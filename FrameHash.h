@@ -0,0 +1,47 @@
+#pragma once
+
+#include "pch.h"
+
+#include "FrameBuffer.h"
+#include "Palette.h"
+
+#include <map>
+#include <optional>
+
+// XXH64 of a byte range, stable across hosts so hashes can be checked in
+uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0);
+
+// Hashes completed frames, either the raw PPU output or the RGB a display would show
+class FrameHasher {
+public:
+    enum Mode {
+        Mode_Indices, // Palette index and emphasis bits, no conversion
+        Mode_RGB      // RGBA8888 after palette conversion
+    };
+
+    FrameHasher(Mode mode);
+
+    uint64_t Hash(const Frame& frame);
+
+private:
+    Mode mode;
+    Palette palette;
+    std::vector<uint32_t> rgb;
+};
+
+// Golden frame hashes, stored as text with one "<frame> <hash in hex>" pair per line.
+// Empty lines and lines starting with '#' are ignored.
+class GoldenHashes {
+public:
+    void Load(const char* path);
+    void Save(const char* path) const;
+
+    void Set(uint64_t frame, uint64_t hash) { hashes[frame] = hash; }
+    std::optional<uint64_t> Get(uint64_t frame) const;
+
+    bool Empty() const { return hashes.empty(); }
+    uint64_t LastFrame() const { return hashes.empty() ? 0 : hashes.rbegin()->first; }
+
+private:
+    std::map<uint64_t, uint64_t> hashes;
+};
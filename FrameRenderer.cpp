@@ -0,0 +1,81 @@
+#include "FrameRenderer.h"
+
+#include "Timeline.h"
+
+FrameRenderer::FrameRenderer(size_t threads) {
+    VERIFY(threads > 0, "Frame renderer needs at least one thread");
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(&FrameRenderer::WorkerLoop, this);
+    }
+}
+
+FrameRenderer::~FrameRenderer() {
+    Wait();
+    stopping = true;
+    job.fetch_add(1, std::memory_order_release);
+    job.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void FrameRenderer::Submit(const PPU::FrameSnapshot& snapshot, Frame& frame) {
+    ASSERT(bandsDone.load(std::memory_order_acquire) == BandCount, "Previous frame still rendering");
+
+    this->snapshot = &snapshot;
+    this->frame = &frame;
+    bandsDone.store(0, std::memory_order_relaxed);
+
+    uint32_t next = job.load(std::memory_order_relaxed) + 1;
+    bands.store(static_cast<uint64_t>(next) << 32, std::memory_order_release);
+    job.store(next, std::memory_order_release);
+    job.notify_all();
+}
+
+void FrameRenderer::Wait() {
+    uint32_t done;
+    while ((done = bandsDone.load(std::memory_order_acquire)) < BandCount) {
+        bandsDone.wait(done, std::memory_order_acquire);
+    }
+}
+
+void FrameRenderer::WorkerLoop() {
+    uint32_t seen = 0;
+    Timeline::SetThreadName("Frame renderer");
+    while (true) {
+        job.wait(seen, std::memory_order_acquire);
+        seen = job.load(std::memory_order_acquire);
+        if (stopping) {
+            return;
+        }
+
+        uint32_t band;
+        while (ClaimBand(seen, band)) {
+            TimelineScope scope("Render band");
+            // Only valid once a band is claimed, the job can't be replaced before it is done
+            const PPU::FrameSnapshot& lines = *snapshot;
+            const PPU::Memory memory = lines.GetMemory();
+            for (uint16_t line = band * LinesPerBand; line < (band + 1) * LinesPerBand; ++line) {
+                const auto& state = lines.lines[line];
+                PPU::RenderScanline(memory, state, lines.GetEvents(state), line, frame->Line(line));
+            }
+
+            if (bandsDone.fetch_add(1, std::memory_order_acq_rel) + 1 == BandCount) {
+                bandsDone.notify_all();
+            }
+        }
+    }
+}
+
+bool FrameRenderer::ClaimBand(uint32_t currentJob, uint32_t& band) {
+    uint64_t current = bands.load(std::memory_order_acquire);
+    do {
+        if ((current >> 32) != currentJob || static_cast<uint32_t>(current) >= BandCount) {
+            return false;
+        }
+    } while (!bands.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel, std::memory_order_acquire));
+
+    band = static_cast<uint32_t>(current);
+    return true;
+}
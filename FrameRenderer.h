@@ -0,0 +1,43 @@
+#pragma once
+
+#include "pch.h"
+
+#include "PPU.h"
+
+#include <atomic>
+#include <thread>
+
+// Renders recorded PPU frames on worker threads. Each frame is split into bands of lines
+// that the workers claim until none are left, so a frame finishes in roughly the time of
+// one band per worker while the emulation thread is already running the next frame.
+class FrameRenderer {
+public:
+    FrameRenderer(size_t threads);
+    ~FrameRenderer();
+
+    // Start rendering the snapshot into the frame, both must stay untouched until Wait returns
+    void Submit(const PPU::FrameSnapshot& snapshot, Frame& frame);
+    // Block until the submitted frame is complete
+    void Wait();
+
+private:
+    static constexpr uint32_t LinesPerBand = 16;
+    static constexpr uint32_t BandCount = FrameHeight / LinesPerBand;
+    static_assert(FrameHeight % LinesPerBand == 0);
+
+    void WorkerLoop();
+    // Claims the next band of the given job, false once all are taken or a newer job started
+    bool ClaimBand(uint32_t currentJob, uint32_t& band);
+
+    std::vector<std::thread> workers;
+
+    // Current job, written before job is bumped and only read by workers after seeing it
+    const PPU::FrameSnapshot* snapshot = nullptr;
+    Frame* frame = nullptr;
+
+    // Job number in the upper 32 bits, next unclaimed band in the lower
+    alignas(64) std::atomic<uint64_t> bands{ BandCount };
+    alignas(64) std::atomic<uint32_t> job{ 0 };
+    alignas(64) std::atomic<uint32_t> bandsDone{ BandCount };
+    bool stopping = false;
+};
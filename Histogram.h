@@ -0,0 +1,69 @@
+#pragma once
+
+#include "pch.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+// Histogram of unsigned values with a bounded relative error, after HdrHistogram. Values
+// below 128 are counted exactly, every power of two above is split into 64 linear
+// sub-buckets, so percentiles are within 1/64 of the recorded values at any scale.
+// https://hdrhistogram.github.io/HdrHistogram/
+class Histogram {
+public:
+    void Record(uint64_t value, uint64_t times = 1) {
+        counts[GetIndex(value)] += times;
+        count += times;
+        sum += value * times;
+        min = std::min(min, value);
+        max = std::max(max, value);
+    }
+
+    uint64_t GetCount() const { return count; }
+    uint64_t GetMin() const { return count ? min : 0; }
+    uint64_t GetMax() const { return max; }
+    double GetMean() const { return count ? static_cast<double>(sum) / count : 0.0; }
+
+    // Highest value equivalent to the one at the percentile, at most the largest recorded
+    uint64_t GetPercentile(double percentile) const {
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * count)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return std::min(GetHighest(i), max);
+            }
+        }
+        return max;
+    }
+
+private:
+    static constexpr size_t SubBuckets = 128;
+    static constexpr size_t HalfSubBuckets = SubBuckets / 2;
+    static constexpr size_t SubBucketBits = std::countr_zero(SubBuckets);
+
+    static size_t GetIndex(uint64_t value) {
+        if (value < SubBuckets) {
+            return static_cast<size_t>(value);
+        }
+        const size_t shift = std::bit_width(value) - SubBucketBits;
+        return SubBuckets + (shift - 1) * HalfSubBuckets + static_cast<size_t>(value >> shift) - HalfSubBuckets;
+    }
+    static uint64_t GetHighest(size_t index) {
+        if (index < SubBuckets) {
+            return index;
+        }
+        const size_t shift = (index - SubBuckets) / HalfSubBuckets + 1;
+        const uint64_t subBucket = (index - SubBuckets) % HalfSubBuckets + HalfSubBuckets;
+        return ((subBucket + 1) << shift) - 1;
+    }
+
+    std::array<uint64_t, SubBuckets + (64 - SubBucketBits) * HalfSubBuckets> counts{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t min = std::numeric_limits<uint64_t>::max();
+    uint64_t max = 0;
+};
@@ -0,0 +1,156 @@
+#include "HostStats.h"
+
+#include <utility>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+
+#ifdef __linux__
+// Counts the calling thread on any CPU, user space only which perf_event_paranoid 2 still allows
+// https://man7.org/linux/man-pages/man2/perf_event_open.2.html
+int OpenEvent(uint32_t type, uint64_t config, int group) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    // The group starts once all members are in
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC));
+}
+
+constexpr uint64_t CacheReadMisses(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+} // namespace
+
+HostStats::HostStats(uint32_t batchFrames) : batchFrames(batchFrames) {
+    VERIFY(batchFrames > 0, "Host stats need at least one frame per sample");
+    events.fill(-1);
+    groupIndex.fill(-1);
+
+#ifdef __linux__
+    constexpr std::pair<uint32_t, uint64_t> Configs[Event_Count] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_HW_CACHE, CacheReadMisses(PERF_COUNT_HW_CACHE_L1D) },
+        { PERF_TYPE_HW_CACHE, CacheReadMisses(PERF_COUNT_HW_CACHE_LL) }
+    };
+    for (size_t event = 0; event < Event_Count; ++event) {
+        const int fd = OpenEvent(Configs[event].first, Configs[event].second, group);
+        if (fd < 0) {
+            SPDLOG_WARN("Host {} counter unavailable: {}", EventNames[event], std::strerror(errno));
+            continue;
+        }
+        if (group == -1) {
+            group = fd;
+        }
+        events[event] = fd;
+        groupIndex[event] = static_cast<int>(groupSize++);
+    }
+    if (group != -1) {
+        ioctl(group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#else
+    SPDLOG_WARN("Host performance counters are only available on Linux, reporting frame times only");
+#endif
+
+    batchStart = Clock::now();
+    batchStartEvents = ReadEvents();
+}
+
+HostStats::~HostStats() {
+#ifdef __linux__
+    for (int fd : events) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+std::array<uint64_t, HostStats::Event_Count> HostStats::ReadEvents() const {
+    std::array<uint64_t, Event_Count> counts{};
+#ifdef __linux__
+    if (group == -1) {
+        return counts;
+    }
+    // Number of events, time enabled and running, then the values in the order they joined
+    uint64_t values[3 + Event_Count];
+    if (read(group, values, sizeof(values)) < static_cast<ssize_t>((3 + groupSize) * sizeof(uint64_t)) || !values[2]) {
+        return counts;
+    }
+    // Events the PMU couldn't keep counting all the time are extrapolated
+    const double scale = static_cast<double>(values[1]) / values[2];
+    for (size_t event = 0; event < Event_Count; ++event) {
+        if (groupIndex[event] != -1) {
+            counts[event] = static_cast<uint64_t>(values[3 + groupIndex[event]] * scale);
+        }
+    }
+#endif
+    return counts;
+}
+
+void HostStats::Frame(uint64_t cpuCycles) {
+    if (++batchFramesDone < batchFrames) {
+        return;
+    }
+    const Clock::time_point now = Clock::now();
+    const std::array<uint64_t, Event_Count> counts = ReadEvents();
+
+    // Frames of a batch each count with the batch's average time
+    const uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(now - batchStart).count();
+    frameNanoseconds.Record(nanoseconds / batchFramesDone, batchFramesDone);
+    frames += batchFramesDone;
+    this->cpuCycles += cpuCycles - batchStartCycles;
+    for (size_t event = 0; event < Event_Count; ++event) {
+        totals[event] += counts[event] - batchStartEvents[event];
+    }
+
+    batchFramesDone = 0;
+    batchStart = now;
+    batchStartCycles = cpuCycles;
+    batchStartEvents = counts;
+}
+
+void HostStats::LogReport() const {
+    auto microseconds = [](uint64_t nanoseconds) { return nanoseconds / 1000.0; };
+    SPDLOG_INFO("Host frame time over {} frames, {} per sample: mean {:.1f}us, p50 {:.1f}us, p99 {:.1f}us, p99.9 {:.1f}us, max {:.1f}us",
+        frames, batchFrames, microseconds(static_cast<uint64_t>(frameNanoseconds.GetMean())),
+        microseconds(frameNanoseconds.GetPercentile(50)), microseconds(frameNanoseconds.GetPercentile(99)),
+        microseconds(frameNanoseconds.GetPercentile(99.9)), microseconds(frameNanoseconds.GetMax()));
+
+    if (group == -1) {
+        SPDLOG_INFO("Host performance counters unavailable");
+        return;
+    }
+    if (cpuCycles && events[Event_Cycles] != -1) {
+        SPDLOG_INFO("Host cycles per emulated CPU cycle: {:.2f}", static_cast<double>(totals[Event_Cycles]) / cpuCycles);
+    }
+    if (cpuCycles && events[Event_Instructions] != -1) {
+        SPDLOG_INFO("Host instructions per emulated CPU cycle: {:.2f}", static_cast<double>(totals[Event_Instructions]) / cpuCycles);
+    }
+    if (totals[Event_Cycles] && events[Event_Instructions] != -1) {
+        SPDLOG_INFO("Host IPC: {:.2f}", static_cast<double>(totals[Event_Instructions]) / totals[Event_Cycles]);
+    }
+    for (Event event : { Event_BranchMisses, Event_L1DMisses, Event_LLCMisses }) {
+        if (frames && events[event] != -1) {
+            SPDLOG_INFO("Host {} per frame: {:.0f}", EventNames[event], static_cast<double>(totals[event]) / frames);
+        }
+    }
+}
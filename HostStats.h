@@ -0,0 +1,65 @@
+#pragma once
+
+#include "pch.h"
+
+#include "Histogram.h"
+
+#include <array>
+#include <chrono>
+#include <string_view>
+
+// Host cost of emulating frames, measured on the emulating thread in batches of frames.
+//
+// Wall time per frame goes into a histogram. On Linux the CPU's hardware counters are read
+// through perf_event_open as one group, for host cycles and instructions per emulated cycle
+// and cache and branch misses per frame. Events the host doesn't provide, in VMs or with
+// perf_event_paranoid too strict, are left out and the rest are still reported.
+class HostStats {
+public:
+    // Starts counting on the calling thread, which must be the one running the emulation
+    explicit HostStats(uint32_t batchFrames);
+    ~HostStats();
+    HostStats(const HostStats&) = delete;
+    HostStats& operator=(const HostStats&) = delete;
+
+    // A frame completed, CPU cycles emulated so far
+    void Frame(uint64_t cpuCycles);
+
+    void LogReport() const;
+
+private:
+    enum Event : uint8_t {
+        Event_Cycles,
+        Event_Instructions,
+        Event_BranchMisses,
+        Event_L1DMisses,
+        Event_LLCMisses,
+        Event_Count
+    };
+    static constexpr std::array<std::string_view, Event_Count> EventNames = {
+        "cycles", "instructions", "branch misses", "L1D misses", "LLC misses"
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    // Current counts of the open events, scaled up if the kernel multiplexed them
+    std::array<uint64_t, Event_Count> ReadEvents() const;
+
+    uint32_t batchFrames;
+    uint32_t batchFramesDone = 0;
+    Clock::time_point batchStart;
+    uint64_t batchStartCycles = 0;
+    std::array<uint64_t, Event_Count> batchStartEvents{};
+
+    Histogram frameNanoseconds;
+    uint64_t frames = 0;
+    uint64_t cpuCycles = 0;
+    std::array<uint64_t, Event_Count> totals{};
+
+    // perf_event file descriptors, -1 for events that couldn't be opened
+    int group = -1;
+    std::array<int, Event_Count> events;
+    // Position of each event in the group's read, by Event
+    std::array<int, Event_Count> groupIndex;
+    size_t groupSize = 0;
+};
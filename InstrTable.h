@@ -260,7 +260,7 @@ static constexpr InstrData InstrDataTable[256] = {
     /* 0xC3 */ { "*DCP",  Addr_IndirX,      true,   8,     0,         false,         "Illegal" },
     /* 0xC4 */ { "CPY",   Addr_ZeroPage,    false,  3,     0,         false,         "Compare Memory with Index Y" },
     /* 0xC5 */ { "CMP",   Addr_ZeroPage,    false,  3,     0,         false,         "Compare Memory with Accumulator" },
-    /* 0xC6 */ { "DEC",   Addr_ZeroPage,    false,  5,     0,         true,          "Decrement Memory by One" },
+    /* 0xC6 */ { "DEC",   Addr_ZeroPage,    false,  5,     0,         false,         "Decrement Memory by One" },
     /* 0xC7 */ { "*DCP",  Addr_ZeroPage,    true,   5,     0,         false,         "Illegal" },
     /* 0xC8 */ { "INY",   Addr_Implicit,    false,  2,     0,         false,         "Increment Index Y by One" },
     /* 0xC9 */ { "CMP",   Addr_Immediate,   false,  2,     0,         false,         "Compare Memory with Accumulator" },
@@ -292,7 +292,7 @@ static constexpr InstrData InstrDataTable[256] = {
     /* 0xE3 */ { "*ISB",  Addr_IndirX,      true,   8,     0,         false,         "Illegal" },
     /* 0xE4 */ { "CPX",   Addr_ZeroPage,    false,  3,     0,         false,         "Compare Memory with Index X" },
     /* 0xE5 */ { "SBC",   Addr_ZeroPage,    false,  3,     0,         false,         "Subtract Memory from Accumulator with Borrow" },
-    /* 0xE6 */ { "INC",   Addr_ZeroPage,    false,  5,     0,         true,          "Increment Memory by One" },
+    /* 0xE6 */ { "INC",   Addr_ZeroPage,    false,  5,     0,         false,         "Increment Memory by One" },
     /* 0xE7 */ { "*ISB",  Addr_ZeroPage,    true,   5,     0,         false,         "Illegal" },
     /* 0xE8 */ { "INX",   Addr_Implicit,    false,  2,     0,         false,         "Increment Index X by One" },
     /* 0xE9 */ { "SBC",   Addr_Immediate,   false,  2,     0,         false,         "Subtract Memory from Accumulator with Borrow" },
@@ -300,7 +300,7 @@ static constexpr InstrData InstrDataTable[256] = {
     /* 0xEB */ { "*SBC",  Addr_Immediate,   true,   2,     0,         false,         "Illegal" },
     /* 0xEC */ { "CPX",   Addr_Absolute,    false,  4,     0,         false,         "Compare Memory with Index X" },
     /* 0xED */ { "SBC",   Addr_Absolute,    false,  4,     0,         false,         "Subtract Memory from Accumulator with Borrow" },
-    /* 0xEE */ { "INC",   Addr_Absolute,    false,  6,     0,         true,          "Increment Memory by One" },
+    /* 0xEE */ { "INC",   Addr_Absolute,    false,  6,     0,         false,         "Increment Memory by One" },
     /* 0xEF */ { "*ISB",  Addr_Absolute,    true,   6,     0,         false,         "Illegal" },
     /* 0xF0 */ { "BEQ",   Addr_Relative,    false,  2,     1,         false,         "Branch if Equal" },
     /* 0xF1 */ { "SBC",   Addr_IndirY,      false,  5,     1,         false,         "Subtract Memory from Accumulator with Borrow" },
@@ -308,7 +308,7 @@ static constexpr InstrData InstrDataTable[256] = {
     /* 0xF3 */ { "*ISB",  Addr_IndirY,      true,   8,     0,         false,         "Illegal" },
     /* 0xF4 */ { "*NOP",  Addr_ZeroPageX,   true,   4,     0,         false,         "Illegal" },
     /* 0xF5 */ { "SBC",   Addr_ZeroPageX,   false,  4,     0,         false,         "Subtract Memory from Accumulator with Borrow" },
-    /* 0xF6 */ { "INC",   Addr_ZeroPageX,   false,  6,     0,         true,          "Increment Memory by One" },
+    /* 0xF6 */ { "INC",   Addr_ZeroPageX,   false,  6,     0,         false,         "Increment Memory by One" },
     /* 0xF7 */ { "*ISB",  Addr_ZeroPageX,   true,   6,     0,         false,         "Illegal" },
     /* 0xF8 */ { "SED",   Addr_Implicit,    false,  2,     0,         false,         "Set Decimal Mode" },
     /* 0xF9 */ { "SBC",   Addr_AbslY,       false,  4,     1,         false,         "Subtract Memory from Accumulator with Borrow" },
@@ -316,7 +316,7 @@ static constexpr InstrData InstrDataTable[256] = {
     /* 0xFB */ { "*ISB",  Addr_AbslY,       true,   7,     0,         false,         "Illegal" },
     /* 0xFC */ { "*NOP",  Addr_AbslX,       true,   4,     1,         false,         "Illegal" },
     /* 0xFD */ { "SBC",   Addr_AbslX,       false,  4,     1,         false,         "Subtract Memory from Accumulator with Borrow" },
-    /* 0xFE */ { "INC",   Addr_AbslX,       false,  7,     0,         true,          "Increment Memory by One" },
+    /* 0xFE */ { "INC",   Addr_AbslX,       false,  7,     0,         false,         "Increment Memory by One" },
     /* 0xFF */ { "*ISB",  Addr_AbslX,       true,   7,     0,         false,         "Illegal" }
 };
 
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "pch.h"
+
+#include <algorithm>
+
+// Interrupt lines into the CPU.
+// https://www.nesdev.org/wiki/CPU_interrupts
+//
+// Sources never interrupt the CPU directly. They set a line with the CPU cycle it is asserted
+// from, which may still be in the future, and that pulls in the CPU's deadline. The CPU runs
+// instructions without looking at the lines until its clock reaches the deadline, polls once,
+// and moves the deadline to the next pending line.
+class InterruptLines {
+public:
+    enum IRQSource : uint8_t {
+        IRQSource_APU,
+        IRQSource_Mapper,
+        IRQSource_Count
+    };
+
+    static constexpr uint64_t Never = UINT64_MAX;
+
+    void Reset() {
+        nmi = Never;
+        std::ranges::fill(irq, Never);
+        deadline = 0;
+    }
+
+    // NMI is edge triggered, an edge stays latched until the CPU takes it
+    void SetNMI(uint64_t cycle) {
+        nmi = std::min(nmi, cycle);
+        Schedule(cycle);
+    }
+    uint64_t GetNMI() const { return nmi; }
+    void AcknowledgeNMI() { nmi = Never; }
+
+    // IRQ is level triggered, each source holds its line from the given cycle until it sets Never
+    void SetIRQ(IRQSource source, uint64_t cycle) {
+        irq[source] = cycle;
+        Schedule(cycle);
+    }
+    uint64_t GetIRQ() const { return *std::ranges::min_element(irq); }
+
+    // An instruction ending at or after this cycle count may have seen a line asserted
+    uint64_t GetDeadline() const { return deadline; }
+    void SetDeadline(uint64_t cycle) { deadline = cycle; }
+    // Poll after the current instruction
+    void ForcePoll() { deadline = 0; }
+
+    // Lines are polled before the last cycle of an instruction, so a line asserted at the
+    // given cycle is seen by instructions ending at least this late
+    static uint64_t RecognizedAt(uint64_t cycle) { return cycle == Never ? Never : cycle + 2; }
+
+private:
+    void Schedule(uint64_t cycle) { deadline = std::min(deadline, RecognizedAt(cycle)); }
+
+    uint64_t nmi = Never;
+    uint64_t irq[IRQSource_Count] = { Never, Never };
+    uint64_t deadline = 0;
+};
@@ -1,5 +1,8 @@
 #include "MMC1.h"
 
+#include <algorithm>
+#include <utility>
+
 MMC1::MMC1() {
     SPDLOG_INFO("MMC1 mapper created, but not initialized");
 }
@@ -17,6 +20,14 @@ void MMC1::LoadFromINES(const iNES &ines) {
 
     SPDLOG_INFO("MMC1 PRG ROM size {} bytes", prgRom->size());
 
+    chrRom = &ines.GetChrRom();
+    if (chrRom->empty()) {
+        chrRam.resize(0x2000);
+    }
+
+    const size_t prgRamSize = ines.GetHeader().GetPrgRamSize() + ines.GetHeader().GetPrgNvramSize();
+    prgRam.resize(std::min<size_t>(prgRamSize, 0x2000));
+
     SPDLOG_INFO("MMC1 mapper initialized from iNES header and ready for I/O");
     loaded = true;
 }
@@ -30,6 +41,7 @@ void MMC1::Reset() {
     ResetCHRBank1();
     ResetPRGBank();
     ResetShiftRegister();
+    ignoreSerialWrite = false;
 }
 
 void MMC1::Write(uint16_t address, uint8_t value) {
@@ -38,66 +50,142 @@ void MMC1::Write(uint16_t address, uint8_t value) {
 
     // Check for shift register write
     if (address >= 0x8000 && address <= 0xFFFF) {
-        // Shift register reset
+        // Only read-modify-write instructions write on consecutive cycles, the first write
+        // wins. Games rely on it to reset the shift register with INC on a byte of $80 or more.
+        if (std::exchange(ignoreSerialWrite, false)) {
+            return;
+        }
+        // Shift register reset, which also fixes the last PRG bank at $C000
         if (value & (1 << 7)) {
             ResetShiftRegister();
+            controlRegister |= Reg5{0b01100};
         } else {
-            // Shift register write
+            // The marker bit reaching bit 0 means this is the fifth write
+            const bool full = shiftRegister[0];
             shiftRegister >>= 1;
             shiftRegister.set(4, value & 0b1);
-            // Five bits written. Now the address matters.
-            if (shiftRegister.count() == 5) {
-                throw std::runtime_error("MMC1::Write() not implemented");
-
-                // Bits 14 and 13 of the address select the register.
-                //uint8_t reg = (address >> 13) & 0b11;
-                // Copy D0 and the SR to a bank register.
-                //uint8_t bankReg = (shiftRegister.to_ulong() & 0b11110) | (value & 0b1);
-                // Write the bank register to the appropriate register.
-                
-                //  Clear the shift register.
+            if (full) {
+                // Bits 14 and 13 of the address select the register
+                switch ((address >> 13) & 0b11) {
+                case 0: controlRegister = shiftRegister; break;
+                case 1: chrBank0 = shiftRegister; break;
+                case 2: chrBank1 = shiftRegister; break;
+                case 3: prgBank = shiftRegister; break;
+                }
                 ResetShiftRegister();
             }
         }
+    } else if (!prgRam.empty()) {
+        // CPU $6000-$7FFF: 8 KB PRG RAM bank, writes are dropped while it's disabled
+        if (IsPrgRamEnabled()) {
+            prgRam[(address - 0x6000) % prgRam.size()] = value;
+        }
     } else {
         throw std::runtime_error("MMC1::Write() not implemented");
     }
 
 }
 
+void MMC1::DummyWrite(uint16_t address, uint8_t value) {
+    Write(address, value);
+    ignoreSerialWrite = address >= 0x8000;
+}
+
 uint8_t MMC1::Read(uint16_t address) {
     ASSERT(address >= 0x6000 && address <= 0xFFFF, "MMC1 read out of range");
     VERIFY(loaded, "MMC1 mapper not initialized");
 
     if (address >= 0x6000 && address <= 0x7FFF) {
         // CPU $6000-$7FFF: 8 KB PRG RAM bank, (optional)
-        throw std::runtime_error("MMC1::Read() RAM bank not implemented");
-    } else if (address >= 0x8000 && address <= 0xBFFF) {
-        // CPU $8000-$BFFF: 16 KB PRG ROM bank, either switchable or fixed to the first bank
-        // TODO: implement switching
-        auto offset = address - 0x8000;
-        auto effectiveAddress = offset;
-        VERIFY(effectiveAddress < prgRom->size(), "MMC1 read out of range");
-        SPDLOG_TRACE("MMC1 read from address {} effective address {}", address, effectiveAddress);
-        return prgRom->at(effectiveAddress);
-    } else if (address >= 0xC000 && address <= 0xFFFF) {
-        // CPU $C000-$FFFF: 16 KB PRG ROM bank, either fixed to the last bank or switchable
-        // TODO: implement switching
-        auto last16k = prgRom->size() - 0x4000;
-        auto offset = address - 0xC000;
-        auto effectiveAddress = last16k + offset;
-        VERIFY(effectiveAddress < prgRom->size(), "MMC1 read out of range");
+        if (prgRam.empty()) {
+            throw std::runtime_error("MMC1::Read() without PRG RAM");
+        }
+        if (!IsPrgRamEnabled()) {
+            // Nothing drives the bus, read as 0 like the other unmapped cartridge addresses
+            return 0;
+        }
+        return prgRam[(address - 0x6000) % prgRam.size()];
+    } else if (address >= 0x8000) {
+        const size_t effectiveAddress = GetPrgRomOffset(address);
         SPDLOG_TRACE("MMC1 read from address {} effective address {}", address, effectiveAddress);
-        return prgRom->at(effectiveAddress);
+        return (*prgRom)[effectiveAddress];
     } else {
         throw std::runtime_error("MMC1::Read() not implemented");
     }
 }
 
+size_t MMC1::GetPrgRomOffset(uint16_t address) {
+    if (address < 0x8000) {
+        return NotPrgRom;
+    }
+    const size_t lastBank = std::max<size_t>(prgRom->size() / 0x4000, 1) - 1;
+    const size_t bank = prgBank.to_ulong() & 0b1111;
+    size_t offset;
+    switch ((controlRegister.to_ulong() >> 2) & 0b11) {
+    case 0:
+    case 1:
+        // CPU $8000-$FFFF: 32 KB PRG ROM bank, the low bit of the bank number is ignored
+        offset = (bank & ~1ul) * 0x4000 + (address - 0x8000);
+        break;
+    case 2:
+        // CPU $8000-$BFFF fixed to the first bank, $C000-$FFFF switchable
+        offset = address < 0xC000 ? address - 0x8000 : bank * 0x4000 + (address - 0xC000);
+        break;
+    default:
+        // CPU $8000-$BFFF switchable, $C000-$FFFF fixed to the last bank
+        offset = address < 0xC000 ? bank * 0x4000 + (address - 0x8000) : lastBank * 0x4000 + (address - 0xC000);
+        break;
+    }
+    return offset % prgRom->size();
+}
+
+// Bits 0-1 of the control register
+Mapper::Mirroring MMC1::GetMirroring(Mirroring headerMirroring) {
+    switch (controlRegister.to_ulong() & 0b11) {
+    case 0: return Mirroring_OneScreenLow;
+    case 1: return Mirroring_OneScreenHigh;
+    case 2: return Mirroring_Vertical;
+    default: return Mirroring_Horizontal;
+    }
+}
+
+size_t MMC1::GetChrOffset(uint16_t address) const {
+    const size_t size = chrRam.empty() ? chrRom->size() : chrRam.size();
+    size_t offset;
+    if (!controlRegister[4]) {
+        // One 8 KB bank, the low bit of the bank number is ignored
+        offset = (chrBank0.to_ulong() & ~1ul) * 0x1000 + (address & 0x1FFF);
+    } else {
+        // Two 4 KB banks
+        const Reg5& bank = address & 0x1000 ? chrBank1 : chrBank0;
+        offset = bank.to_ulong() * 0x1000 + (address & 0x0FFF);
+    }
+    return offset % size;
+}
+
 uint8_t MMC1::ReadChr(uint16_t address) {
-    return 0;
+    if (!chrRam.empty()) {
+        return chrRam[GetChrOffset(address)];
+    }
+    return (*chrRom)[GetChrOffset(address)];
 }
 
 void MMC1::WriteChr(uint16_t address, uint8_t value) {
+    if (!chrRam.empty()) {
+        chrRam[GetChrOffset(address)] = value;
+    }
+}
+
+Mapper::ChrBanks MMC1::GetChrBanks() {
+    const bool writable = !chrRam.empty();
+    const std::vector<uint8_t>& chr = writable ? chrRam : *chrRom;
+    ChrBanks chrBanks{ {}, writable };
+    for (size_t i = 0; i < 8; ++i) {
+        chrBanks.banks[i] = chr.data() + GetChrOffset(static_cast<uint16_t>(i * 0x400));
+    }
+    return chrBanks;
+}
 
+std::span<const uint8_t> MMC1::GetChrMemory() {
+    return chrRam.empty() ? std::span<const uint8_t>(*chrRom) : std::span<const uint8_t>(chrRam);
 }
@@ -8,8 +8,12 @@ using Reg5 = std::bitset<5>;
 
 // MMC1 Banks
 
+// CPU $8000-$BFFF: 16 KB PRG ROM bank, switchable or fixed to the first bank
+// CPU $C000-$FFFF: 16 KB PRG ROM bank, fixed to the last bank or switchable
+// or CPU $8000-$FFFF: 32 KB switchable PRG ROM bank, by bits 2-3 of the control register
 // PPU $0000-$0FFF: 4 KB switchable CHR bank
 // PPU $1000-$1FFF: 4 KB switchable CHR bank
+// or PPU $0000-$1FFF: 8 KB switchable CHR bank, by bit 4 of the control register
 
 
 class MMC1 : public Mapper {
@@ -23,10 +27,15 @@ public:
     void Reset();
 
     void Write(uint16_t address, uint8_t value);
+    void DummyWrite(uint16_t address, uint8_t value);
     uint8_t Read(uint16_t address);
+    size_t GetPrgRomOffset(uint16_t address);
 
     uint8_t ReadChr(uint16_t address);
     void WriteChr(uint16_t address, uint8_t value);
+    ChrBanks GetChrBanks();
+    std::span<const uint8_t> GetChrMemory();
+    Mirroring GetMirroring(Mirroring headerMirroring);
 
 private:
     bool loaded = false;
@@ -34,8 +43,12 @@ private:
     constexpr static Reg5 SHIFTREG_DEFAULT_VALUE = Reg5{0b10000}; 
     Reg5 shiftRegister{SHIFTREG_DEFAULT_VALUE};
     void ResetShiftRegister() { shiftRegister = SHIFTREG_DEFAULT_VALUE; }
+    // The serial port ignores a write on the cycle after the previous one, the result of a
+    // read-modify-write instruction after its dummy write
+    bool ignoreSerialWrite = false;
 
-    constexpr static Reg5 CONTROL_REGISTER_DEFAULT_VALUE = Reg5{0b10000};
+    // Last PRG bank fixed at $C000, one 8 KB CHR bank
+    constexpr static Reg5 CONTROL_REGISTER_DEFAULT_VALUE = Reg5{0b01100};
     Reg5 controlRegister{CONTROL_REGISTER_DEFAULT_VALUE};
     void ResetControlRegister() { controlRegister = CONTROL_REGISTER_DEFAULT_VALUE; }
 
@@ -50,6 +63,14 @@ private:
     constexpr static Reg5 PRG_BANK_DEFAULT_VALUE = Reg5{0b00000};
     Reg5 prgBank{PRG_BANK_DEFAULT_VALUE};
     void ResetPRGBank() { prgBank = PRG_BANK_DEFAULT_VALUE; }
+    // Bit 4 of the PRG bank register disables PRG RAM when set
+    bool IsPrgRamEnabled() const { return !prgBank[4]; }
+
+    // Offset into CHR ROM or RAM of PPU $0000-$1FFF with the banks selected
+    size_t GetChrOffset(uint16_t address) const;
    
     const RomBank* prgRom;
+    const RomBank* chrRom;
+    std::vector<uint8_t> chrRam;
+    std::vector<uint8_t> prgRam;
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "MMU.h"
 
-MMU::MMU(Cartridge &cartridge) : ram{}, cartridge(cartridge) {
+MMU::MMU(Cartridge &cartridge, PPU &ppu, APU &apu, Controllers &controllers) :
+    ram{}, cartridge(cartridge), ppu(ppu), apu(apu), controllers(controllers) {
     SPDLOG_INFO("MMU created, but not initialized");
 }
 
@@ -13,26 +14,99 @@ void MMU::Reset() {
 }
 
 uint8_t MMU::Read(Addr address) {
+    Counters::CountRead(address);
     if (address > 0x4020) {
         auto value = cartridge.Read(address);
         SPDLOG_TRACE("MMU read from cartridge address 0x{:04X} value 0x{:02X}", address, value);
         return value;
     }
+    if (address >= 0x2000 && address < 0x4000) {
+        Sync();
+        auto value = ppu.ReadRegister(address);
+        SPDLOG_TRACE("MMU read from PPU register 0x{:04X} value 0x{:02X}", address, value);
+        return value;
+    }
+    if (address == APU::APUAddr_STATUS) {
+        Sync();
+        auto value = apu.Read(address);
+        SPDLOG_TRACE("MMU read from APU register 0x{:04X} value 0x{:02X}", address, value);
+        return value;
+    }
+    if (address == IOAddr_JOY1 || address == IOAddr_JOY2) {
+        auto value = controllers.Read(address - IOAddr_JOY1);
+        SPDLOG_TRACE("MMU read from controller port 0x{:04X} value 0x{:02X}", address, value);
+        return value;
+    }
     auto value = GetAddRef(address);
     SPDLOG_TRACE("MMU read from RAM address 0x{:04X} value 0x{:02X}", address, value);
     return value;
 }
 
-void MMU::Write(Addr address, uint8_t value) {
-    if (address > 0x4020) {
+void MMU::Write(Addr address, uint8_t value, bool dummy) {
+    Counters::CountWrite(address);
+    if (IsCartridgeAddress(address)) {
         SPDLOG_TRACE("MMU delegating write to cartridge address 0x{:04X} value 0x{:02X}", address, value);
-        cartridge.Write(address, value);
+        // Mapper writes switch the banks the PPU renders with, the PPU is caught up before
+        // them and picks up a mirroring switch after
+        Sync();
+        cartridge.Write(address, value, dummy);
+        ppu.UpdateMirroring();
+        return;
+    }
+    if (address >= 0x2000 && address < 0x4000) {
+        SPDLOG_TRACE("MMU write to PPU register 0x{:04X} value 0x{:02X}", address, value);
+        Sync();
+        ppu.WriteRegister(address, value);
+        return;
+    }
+    if (IsAPURegister(address)) {
+        SPDLOG_TRACE("MMU write to APU register 0x{:04X} value 0x{:02X}", address, value);
+        Sync();
+        apu.Write(address, value);
+        // The write may have moved the APU's next event, sync again to pick up the new deadline
+        Sync();
+        return;
+    }
+    if (address == IOAddr_OAMDMA) {
+        // https://www.nesdev.org/wiki/PPU_registers#OAMDMA
+        SPDLOG_TRACE("MMU OAM DMA from page 0x{:02X}", value);
+        uint8_t page[256];
+        for (size_t i = 0; i < sizeof(page); ++i) {
+            page[i] = Read((value << 8) | i);
+        }
+        Sync();
+        ppu.WriteOAMDMA(page);
+        // One more cycle is added by the CPU when the DMA starts on an odd cycle
+        stallCycles += 513;
+        return;
+    }
+    if (address == IOAddr_JOY1) {
+        SPDLOG_TRACE("MMU controller strobe 0x{:02X}", value);
+        // Input is latched by the frame the PPU is on
+        Sync();
+        controllers.Write(value, ppu.GetFrameNumber());
         return;
     }
     SPDLOG_TRACE("MMU write to RAM address 0x{:04X} value 0x{:02X}", address, value);
     GetAddRef(address) = value;
 }
 
+uint8_t MMU::Peek(Addr address) {
+    if (address > 0x4020) {
+        return cartridge.Read(address);
+    }
+    if (address >= 0x2000 && address < 0x4000) {
+        return ppu.PeekRegister(address);
+    }
+    if (address == APU::APUAddr_STATUS) {
+        return apu.Peek(address);
+    }
+    if (address == IOAddr_JOY1 || address == IOAddr_JOY2) {
+        return controllers.Peek(address - IOAddr_JOY1);
+    }
+    return GetAddRef(address);
+}
+
 uint8_t& MMU::GetAddRef(Addr address) {
     // Check for RAM and mirrors
     if (address < 0x2000) {
@@ -40,9 +114,8 @@ uint8_t& MMU::GetAddRef(Addr address) {
         SPDLOG_TRACE("MMU referencing RAM address 0x{:04X}, effective address 0x{:04X}", address, effectiveAddress);
         return ram[effectiveAddress];
     } else if (address >= 0x2000 && address < 0x4000) {
-        auto effectiveRegister = (address - 0x2000) % 8;
-        SPDLOG_TRACE("MMU referencing address 0x{:04X}, PPU register {}", address, effectiveRegister);
-        return ppuRegisters[(address - 0x2000) % 8];
+        VERIFY(false, "MMU trying to get reference to PPU register 0x{:04X}", address);
+        LIBASSERT_UNREACHABLE;
     } else if (address >= 0x4000 && address < 0x4018) {
         auto effectiveRegister = (address - 0x4000) % 24;
         SPDLOG_TRACE("MMU referencing address 0x{:04X} to APU or I/O register {}", address, effectiveRegister);
@@ -1,6 +1,13 @@
 #pragma once
 
+#include "APU.h"
 #include "Cartridge.h"
+#include "Controllers.h"
+#include "Counters.h"
+#include "PPU.h"
+#include "Scheduler.h"
+
+#include <utility>
 /*
 Address range	Size	Device
 $0000–$07FF	$0800	2 KB internal RAM
@@ -15,22 +22,59 @@ $4020–$FFFF	$BFE0	Cartridge space: PRG ROM, PRG RAM, and mapper registers
 */
 class MMU {
 public:
-    MMU(Cartridge& cartridge);
+    MMU(Cartridge& cartridge, PPU& ppu, APU& apu, Controllers& controllers);
 
     void PowerOn();
     void Reset();
 
     uint8_t Read(Addr address);
-    void Write(Addr address, uint8_t value);
+    // Dummy writes are the unmodified value read-modify-write instructions write back, the
+    // cartridge is told about them
+    void Write(Addr address, uint8_t value, bool dummy = false);
+
+    // Read without side effects on I/O registers, for tracing and store instructions
+    uint8_t Peek(Addr address);
+
+    // With a scheduler the PPU, APU and cartridge are synced to the CPU clock before each
+    // access, nullptr when they are ticked in lockstep
+    void SetScheduler(Scheduler* scheduler) { this->scheduler = scheduler; }
+
+    // Brings the components up to the CPU when a scheduler runs them
+    void Sync() {
+        if (scheduler) {
+            scheduler->Sync();
+        }
+    }
+
+    // CPU cycles stolen by DMA since the last call
+    size_t TakeStallCycles() { return std::exchange(stallCycles, 0); }
+
+    static bool IsCartridgeAddress(Addr address) { return address > 0x4020; }
+
+    enum IOAddr : Addr {
+        IOAddr_OAMDMA = 0x4014,
+        IOAddr_JOY1   = 0x4016, // Controller strobe on write, port 1 on read
+        IOAddr_JOY2   = 0x4017  // Port 2 on read, writes go to the APU frame counter
+    };
 
 private:
     uint8_t& GetAddRef(Addr address);
 
     uint8_t ram[2048]; // 2KB of RAM   
 
-    uint8_t ppuRegisters[8]; // 8 PPU registers
     uint8_t apuRegisters[24]; // 24 APU registers
     uint8_t disabledRegisters[8]; // 8 disabled registers
 
+    size_t stallCycles = 0;
+    Scheduler* scheduler = nullptr;
+
+    // APU registers, $4014 and the controller ports live in the same range
+    static bool IsAPURegister(Addr address) {
+        return (address >= 0x4000 && address <= 0x4013) || address == APU::APUAddr_STATUS || address == APU::APUAddr_FRAME;
+    }
+
     Cartridge& cartridge;
+    PPU& ppu;
+    APU& apu;
+    Controllers& controllers;
 };
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const char* path) {
+#ifdef _WIN32
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER fileSize;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize)) {
+        Close();
+        throw std::runtime_error(fmt::format("Failed to open {}", path));
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+    if (size) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        data = mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    }
+#else
+    const int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error(fmt::format("Failed to open {}", path));
+    }
+    size = static_cast<size_t>(info.st_size);
+    if (size) {
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        data = mapped == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(mapped);
+    }
+    close(fd);
+#endif
+    if (size && !data) {
+        Close();
+        throw std::runtime_error(fmt::format("Failed to map {}", path));
+    }
+}
+
+void MappedFile::AdviseSequential() const {
+#ifndef _WIN32
+    if (data) {
+        madvise(const_cast<uint8_t*>(data), size, MADV_SEQUENTIAL);
+    }
+#endif
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file && file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    file = mapping = nullptr;
+#else
+    if (data) {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+#endif
+    data = nullptr;
+}
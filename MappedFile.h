@@ -0,0 +1,28 @@
+#pragma once
+
+#include "pch.h"
+
+// Read only mapping of a whole file. Empty files map to no data.
+class MappedFile {
+public:
+    explicit MappedFile(const char* path);
+    ~MappedFile() { Close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+
+    // The file will be read front to back once, lets the OS read ahead further
+    void AdviseSequential() const;
+
+private:
+    void Close();
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
@@ -4,6 +4,8 @@
 
 #include "iNES.h"
 
+#include <span>
+
 class Mapper {
 public:
     virtual void LoadFromINES(const iNES& ines) = 0;
@@ -12,10 +14,40 @@ public:
     virtual void Reset() = 0;
 
     virtual void Write(CPUAddr address, uint8_t value) = 0;
+    // The unmodified value a read-modify-write instruction writes back, its result is written
+    // on the next cycle
+    virtual void DummyWrite(CPUAddr address, uint8_t value) { Write(address, value); }
     virtual uint8_t Read(CPUAddr address) = 0;
 
+    // Offset into PRG ROM that the address reads from with the current banks, NotPrgRom when
+    // it isn't mapped to PRG ROM. Identifies code by ROM location rather than by address,
+    // which switchable banks reuse.
+    static constexpr size_t NotPrgRom = SIZE_MAX;
+    virtual size_t GetPrgRomOffset(CPUAddr address) = 0;
+
     virtual uint8_t ReadChr(PPUAddr address) = 0;
     virtual void WriteChr(PPUAddr address, uint8_t value) = 0;
 
+    // https://www.nesdev.org/wiki/Mirroring#Nametable_Mirroring
+    enum Mirroring {
+        Mirroring_Horizontal,
+        Mirroring_Vertical,
+        Mirroring_FourScreen,
+        Mirroring_OneScreenLow, // All four nametables are the first one
+        Mirroring_OneScreenHigh // All four nametables are the second one
+    };
+    // Nametable mirroring with the current registers, the header's for mappers that can't switch it
+    virtual Mirroring GetMirroring(Mirroring headerMirroring) { return headerMirroring; }
+
+    // CHR memory mapped at PPU $0000-$1FFF as eight 1KB banks, lets the PPU fetch patterns
+    // without going through ReadChr for every byte
+    struct ChrBanks {
+        const uint8_t* banks[8];
+        bool writable; // CHR RAM, contents can change after the banks were taken
+    };
+    virtual ChrBanks GetChrBanks() = 0;
+    // All of the CHR ROM or RAM the banks point into
+    virtual std::span<const uint8_t> GetChrMemory() = 0;
+
     virtual ~Mapper() {}
 };
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include "Movie.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+
+namespace {
+
+// Each line of an .fm2 movie, without the line break
+class LineReader {
+public:
+    LineReader(const MappedFile& file, size_t offset) :
+        data(reinterpret_cast<const char*>(file.GetData())), size(file.GetSize()), offset(offset) {}
+
+    bool Next(std::string_view& line) {
+        if (offset >= size) {
+            return false;
+        }
+        const char* begin = data + offset;
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', size - offset));
+        const char* end = newline ? newline : data + size;
+        offset = static_cast<size_t>(end - data) + (newline != nullptr);
+        line = std::string_view(begin, end);
+        if (line.ends_with('\r')) {
+            line.remove_suffix(1);
+        }
+        return true;
+    }
+    size_t GetOffset() const { return offset; }
+
+private:
+    const char* data;
+    size_t size;
+    size_t offset;
+};
+
+// "RLDUTSBA" with '.' or ' ' for buttons not held
+uint8_t ParseGamepad(std::string_view field) {
+    uint8_t buttons = 0;
+    for (size_t i = 0; i < std::min<size_t>(field.size(), 8); ++i) {
+        if (field[i] != '.' && field[i] != ' ') {
+            buttons |= static_cast<uint8_t>(Button_Right >> i);
+        }
+    }
+    return buttons;
+}
+
+} // namespace
+
+Movie::Movie(const char* path) : file(path) {
+    file.AdviseSequential();
+
+    MovieFileHeader header{};
+    if (file.GetSize() >= sizeof(header)) {
+        std::memcpy(&header, file.GetData(), sizeof(header));
+        binary = std::equal(std::begin(MovieMagic), std::end(MovieMagic), header.magic);
+    }
+    if (binary) {
+        if (header.version != MovieVersion || header.ports < 1 || header.ports > 2) {
+            throw std::runtime_error(fmt::format("Movie {} has version {} with {} ports, expected {} with 1 or 2",
+                path, header.version, header.ports, MovieVersion));
+        }
+        if (file.GetSize() != sizeof(header) + static_cast<uint64_t>(header.frames) * header.ports) {
+            throw std::runtime_error(fmt::format("Movie {} has {} bytes, expected {} for {} frames", path, file.GetSize(),
+                sizeof(header) + static_cast<uint64_t>(header.frames) * header.ports, header.frames));
+        }
+        ports = header.ports;
+        frames = header.frames;
+        return;
+    }
+
+    // Count the frames, input lines start with '|'
+    LineReader lines(file, 0);
+    std::string_view line;
+    while (lines.Next(line)) {
+        if (line.starts_with('|')) {
+            ++frames;
+        } else if (line == "binary 1") {
+            throw std::runtime_error(fmt::format("Movie {} has binary .fm2 input, only text input is supported", path));
+        }
+    }
+    if (!frames) {
+        throw std::runtime_error(fmt::format("{} is neither a movie nor an .fm2 movie with input", path));
+    }
+}
+
+uint8_t Movie::GetButtons(uint64_t frame, int port) {
+    if (frame >= frames || static_cast<uint32_t>(port) >= ports) {
+        return 0;
+    }
+    if (binary) {
+        return file.GetData()[sizeof(MovieFileHeader) + frame * ports + port];
+    }
+
+    if (frame + 1 < nextFrame) {
+        offset = 0;
+        nextFrame = 0;
+    }
+    while (nextFrame <= frame) {
+        if (!ParseNextFrame()) {
+            return 0;
+        }
+    }
+    return current[port];
+}
+
+bool Movie::ParseNextFrame() {
+    LineReader lines(file, offset);
+    std::string_view line;
+    while (lines.Next(line)) {
+        if (!line.starts_with('|')) {
+            continue;
+        }
+        offset = lines.GetOffset();
+
+        // |commands|port0|port1|port2|
+        std::string_view fields[4];
+        line.remove_prefix(1);
+        for (std::string_view& field : fields) {
+            const size_t bar = line.find('|');
+            field = line.substr(0, bar);
+            line = bar == std::string_view::npos ? std::string_view{} : line.substr(bar + 1);
+        }
+        if (!fields[0].empty() && fields[0] != "0") {
+            SPDLOG_WARN("Movie frame {} has commands {}, only the input is played", nextFrame, fields[0]);
+        }
+        current[0] = ParseGamepad(fields[1]);
+        current[1] = ParseGamepad(fields[2]);
+        ++nextFrame;
+        return true;
+    }
+    offset = lines.GetOffset();
+    return false;
+}
+
+MovieWriter::MovieWriter(const char* path) : file(path, std::ios::binary), path(path) {
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to open movie {}", path));
+    }
+    MovieFileHeader header{ {}, MovieVersion, 2, 0 };
+    std::copy(std::begin(MovieMagic), std::end(MovieMagic), header.magic);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void MovieWriter::Record(uint64_t frame, const uint8_t buttons[2]) {
+    for (; frames <= frame; ++frames) {
+        file.write(reinterpret_cast<const char*>(buttons), 2);
+    }
+}
+
+void MovieWriter::Finish() {
+    const uint32_t count = static_cast<uint32_t>(frames);
+    file.seekp(offsetof(MovieFileHeader, frames));
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    file.close();
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to write movie {}", path));
+    }
+}
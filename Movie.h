@@ -0,0 +1,72 @@
+#pragma once
+
+#include "pch.h"
+
+#include "MappedFile.h"
+
+#include <fstream>
+#include <string>
+
+// Bits of a standard controller's buttons, in the order they are read out
+enum Button : uint8_t {
+    Button_A      = 0x01,
+    Button_B      = 0x02,
+    Button_Select = 0x04,
+    Button_Start  = 0x08,
+    Button_Up     = 0x10,
+    Button_Down   = 0x20,
+    Button_Left   = 0x40,
+    Button_Right  = 0x80
+};
+
+// Binary movie layout: the header, then the buttons of every frame with a byte per port
+struct MovieFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t ports;
+    uint32_t frames;
+};
+constexpr char MovieMagic[4] = { 'N', 'M', 'O', 'V' };
+constexpr uint32_t MovieVersion = 1;
+
+// The input of a session by PPU frame, memory mapped and read as playback reaches it. Either
+// the binary format of MovieWriter or an FCEUX .fm2 text movie, whose gamepad lines are parsed
+// one at a time. Frames past the end have no buttons held.
+class Movie {
+public:
+    explicit Movie(const char* path);
+
+    // Frames are expected to mostly go forward, an .fm2 movie starts over for earlier ones
+    uint8_t GetButtons(uint64_t frame, int port);
+    uint64_t GetFrameCount() const { return frames; }
+
+private:
+    // Parse the next input line of an .fm2 movie into current, false at the end
+    bool ParseNextFrame();
+
+    MappedFile file;
+    bool binary = false;
+    uint32_t ports = 2;
+    uint64_t frames = 0;
+
+    // .fm2 playback position, current has the buttons of frame nextFrame - 1
+    size_t offset = 0;
+    uint64_t nextFrame = 0;
+    uint8_t current[2] = {};
+};
+
+// Writes the input latched on every frame as a binary movie
+class MovieWriter {
+public:
+    explicit MovieWriter(const char* path);
+
+    // The first latch of a frame counts, frames the game didn't read take the next one's input
+    void Record(uint64_t frame, const uint8_t buttons[2]);
+    // Writes the frame count, throws if any write failed
+    void Finish();
+
+private:
+    std::ofstream file;
+    std::string path;
+    uint64_t frames = 0;
+};
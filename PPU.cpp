@@ -0,0 +1,669 @@
+#include "PPU.h"
+
+#include "Counters.h"
+#include "Timeline.h"
+
+#include "FrameRenderer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+PPU::PPU(Cartridge& cartridge, InterruptLines& interrupts) :
+    cartridge(cartridge),
+    interrupts(interrupts),
+    nametables{},
+    palette{},
+    oam{},
+    snapshots(std::make_unique<FrameSnapshot[]>(2)),
+    recording(&snapshots[0]) {
+    SPDLOG_INFO("PPU created, but not initialized");
+}
+
+PPU::~PPU() = default;
+
+// https://www.nesdev.org/wiki/PPU_power_up_state
+void PPU::PowerOn() {
+    SPDLOG_INFO("PPU setting power on state");
+
+    mirroring = cartridge.GetMirroring();
+
+    std::memset(nametables, 0, sizeof(nametables));
+    std::memset(palette, 0, sizeof(palette));
+    std::memset(oam, 0, sizeof(oam));
+
+    ctrl = 0;
+    mask = 0;
+    status = 0;
+    oamAddr = 0;
+    readBuffer = 0;
+    openBus = 0;
+    v = t = 0;
+    x = 0;
+    w = false;
+
+    scanline = 0;
+    dot = 0;
+    frameNumber = 0;
+    lineStart = 0;
+
+    recording->events.clear();
+    immediateFrame = false;
+    StartScanline();
+}
+
+void PPU::SetPresentInterval(uint32_t interval) {
+    VERIFY(interval > 0, "Present interval must be at least 1");
+    presentInterval = interval;
+}
+
+void PPU::SetRenderThreads(size_t threads) {
+    FlushFrame();
+    renderer = threads ? std::make_unique<FrameRenderer>(threads) : nullptr;
+    SPDLOG_INFO("PPU rendering {}", threads ? fmt::format("deferred on {} threads", threads) : "immediate");
+}
+
+void PPU::SetCoverage(Coverage* coverage) {
+    // The renderer may still be marking into the previous one
+    FlushFrame();
+    this->coverage = coverage;
+    snapshots[0].coverage = coverage;
+    snapshots[1].coverage = coverage;
+}
+
+void PPU::FlushFrame() {
+    if (!pendingFrame) {
+        return;
+    }
+    {
+        TimelineScope scope("Render wait");
+        renderer->Wait();
+    }
+    CompleteFrame(*pendingFrame, true);
+    pendingFrame.reset();
+}
+
+void PPU::Reset() {
+    SPDLOG_INFO("PPU resetting");
+
+    ctrl = 0;
+    mask = 0;
+    readBuffer = 0;
+    x = 0;
+    w = false;
+    UpdateMirroring();
+}
+
+void PPU::UpdateMirroring() {
+    const auto cartridgeMirroring = cartridge.GetMirroring();
+    if (cartridgeMirroring != mirroring) {
+        // Like VRAM writes, lines the deferred renderer draws later would see the switch
+        BeforeMemoryWrite();
+        mirroring = cartridgeMirroring;
+    }
+}
+
+void PPU::Tick(size_t dots) {
+    size_t position = dot + dots;
+    while (true) {
+        if (dot < HBlankDot) {
+            if (position < HBlankDot) {
+                break;
+            }
+            dot = HBlankDot;
+            StartHBlank();
+        }
+        if (position < DotsPerScanline) {
+            break;
+        }
+
+        position -= DotsPerScanline;
+        dot = 0;
+        lineStart += DotsPerScanline;
+        EndScanline();
+
+        // Odd frames skip the last dot of the pre-render line while rendering
+        if (scanline == 0 && (frameNumber & 1) && IsRenderingEnabled()) {
+            position++;
+            lineStart--;
+        }
+    }
+    dot = static_cast<uint16_t>(position);
+}
+
+Scheduler::Task PPU::Process(const Scheduler& scheduler) {
+    while (true) {
+        // Everything but vblank waits for the CPU to touch the PPU or the cartridge
+        {
+            TimelineScope scope("PPU catch-up");
+            Tick(scheduler.Now() * 3 - (lineStart + dot));
+        }
+        co_await Scheduler::Yield{ NextVBlankCycle() };
+    }
+}
+
+uint64_t PPU::NextVBlankCycle() const {
+    // Vblank starts with the line, from the vblank line on it is next frame's
+    uint16_t lines = (VBlankScanline - scanline + ScanlinesPerFrame) % ScanlinesPerFrame;
+    uint64_t vblankStart = lineStart + (lines ? lines : ScanlinesPerFrame) * DotsPerScanline;
+    // The odd frame skip on the way may start it a dot earlier
+    if (scanline >= VBlankScanline) {
+        vblankStart--;
+    }
+    // Rounded down, waking up a cycle early only costs another sync
+    return vblankStart / 3;
+}
+
+void PPU::StartHBlank() {
+    if (scanline < FrameHeight) {
+        if (IsPresentedFrame() && (!renderer || immediateFrame)) {
+            TimelineScope scope("Render line");
+            RenderScanline(GetLiveMemory(), recording->lines[scanline], recording->GetEvents(recording->lines[scanline]),
+                scanline, frameOutput.Back().Line(scanline));
+            recording->events.clear();
+        }
+        if (IsRenderingEnabled()) {
+            EvaluateScanline(scanline);
+            IncrementY();
+            CopyHorizontal();
+        }
+    } else if (scanline == PreRenderScanline && IsRenderingEnabled()) {
+        CopyHorizontal();
+        CopyVertical();
+    }
+}
+
+void PPU::EndScanline() {
+    scanline++;
+    if (scanline == ScanlinesPerFrame) {
+        scanline = 0;
+    }
+
+    StartScanline();
+}
+
+void PPU::StartScanline() {
+    if (IsRecordingLine()) {
+        ScanlineState& state = recording->lines[scanline];
+        state.v = v;
+        state.x = x;
+        state.ctrl = ctrl;
+        state.mask = mask;
+        state.firstEvent = static_cast<uint16_t>(recording->events.size());
+        state.eventCount = 0;
+        std::ranges::copy(cartridge.GetChrBanks().banks, state.chr);
+    } else if (scanline == VBlankScanline) {
+        status |= Status_VBlank;
+        if (ctrl & Ctrl_NMIEnable) {
+            // The flag is set on dot 1
+            interrupts.SetNMI((lineStart + 1) / 3);
+        }
+
+        // The visible part of the frame is complete, hand it to the consumer
+        Counters::Count(Counter_Frames);
+        if (!renderer) {
+            CompleteFrame(frameNumber, IsPresentedFrame());
+        } else {
+            // The previous frame had a whole frame of emulation time to render
+            FlushFrame();
+            if (immediateFrame) {
+                CompleteFrame(frameNumber, true);
+                recording->events.clear();
+                immediateFrame = false;
+            } else if (IsPresentedFrame()) {
+                FinishSnapshot();
+                renderer->Submit(*recording, frameOutput.Back());
+                pendingFrame = frameNumber;
+                recording = recording == &snapshots[0] ? &snapshots[1] : &snapshots[0];
+                recording->events.clear();
+            } else {
+                CompleteFrame(frameNumber, false);
+            }
+        }
+        SPDLOG_DEBUG("PPU frame {} complete", frameNumber);
+        frameNumber++;
+    } else if (scanline == PreRenderScanline) {
+        status &= ~(Status_VBlank | Status_Sprite0Hit | Status_SpriteOverflow);
+    }
+}
+
+void PPU::CompleteFrame(uint64_t number, bool presented) {
+    TimelineScope scope("Frame publish");
+    Frame& frame = frameOutput.Back();
+    frame.number = number;
+    frame.presented = presented;
+    if (frameCallback) {
+        frameCallback(frame);
+    }
+    if (presented) {
+        frameOutput.Publish();
+    }
+}
+
+void PPU::FinishSnapshot() {
+    FrameSnapshot& snapshot = *recording;
+    snapshot.number = frameNumber;
+    snapshot.mirroring = mirroring;
+    std::memcpy(snapshot.nametables, nametables, sizeof(nametables));
+    std::memcpy(snapshot.palette, palette, sizeof(palette));
+    std::memcpy(snapshot.oam, oam, sizeof(oam));
+
+    // CHR RAM may be rewritten during vblank, point the lines at a copy of all of it. Banks
+    // switched away from during the frame are in the copy too.
+    if (!cartridge.GetChrBanks().writable) {
+        return;
+    }
+    const auto chrMemory = cartridge.GetChrMemory();
+    snapshot.chrRam.assign(chrMemory.begin(), chrMemory.end());
+    for (ScanlineState& state : snapshot.lines) {
+        for (const uint8_t*& lineBank : state.chr) {
+            if (!lineBank) {
+                continue;
+            }
+            const auto offset = lineBank - chrMemory.data();
+            ASSERT(offset >= 0 && static_cast<size_t>(offset) < chrMemory.size(), "CHR bank outside of CHR memory");
+            lineBank = snapshot.chrRam.data() + offset;
+        }
+    }
+}
+
+void PPU::RenderImmediately() {
+    // The back buffer is the previous frame's until it is delivered
+    FlushFrame();
+    immediateFrame = true;
+
+    // Memory didn't change since the lines were drawn, live memory is what they saw
+    TimelineScope scope("Render line");
+    const uint16_t drawn = std::min<uint16_t>(dot >= HBlankDot ? scanline + 1 : scanline, FrameHeight);
+    for (uint16_t line = 0; line < drawn; ++line) {
+        RenderScanline(GetLiveMemory(), recording->lines[line], recording->GetEvents(recording->lines[line]),
+            line, frameOutput.Back().Line(line));
+    }
+}
+
+void PPU::RenderScanline(const Memory& memory, const ScanlineState& state,
+    std::span<const ScanlineEvent> events, uint16_t line, Pixel* out) {
+    // Layers that are shown anywhere on the line need to be fetched
+    uint8_t lineMask = state.mask;
+    for (const ScanlineEvent& event : events) {
+        if (event.reg == PPURegister_MASK) {
+            lineMask |= event.value;
+        }
+    }
+
+    // Background pixels for 33 tiles so fine X can shift into the 33rd
+    // Each value is palette select << 2 | pattern value, 0 is transparent
+    uint8_t background[FrameWidth + 8] = {};
+    if (lineMask & Mask_ShowBackground) {
+        uint8_t ctrl = state.ctrl;
+        auto event = events.begin();
+        for (size_t tile = 0; tile < 33; ++tile) {
+            // Pattern table switches apply from the first tile starting after the write
+            for (; event != events.end() && event->dot + state.x <= tile * 8; ++event) {
+                if (event->reg == PPURegister_CTRL) {
+                    ctrl = event->value;
+                }
+            }
+
+            uint16_t address = CoarseXOffset(state.v, tile);
+            auto attribute = memory.nametables[NametableOffset(0x23C0 | (address & 0x0C00) | ((address >> 4) & 0x38) | ((address >> 2) & 0x07), memory.mirroring)];
+            auto attributeShift = ((address >> 4) & 0b100) | (address & 0b10);
+            uint8_t paletteSelect = ((attribute >> attributeShift) & 0b11) << 2;
+
+            auto [lower, upper] = FetchBackgroundRow(memory, state.chr, ctrl, address);
+            for (size_t col = 0; col < 8; ++col) {
+                auto bit = 7 - col;
+                uint8_t value = ((lower >> bit) & 1) | (((upper >> bit) & 1) << 1);
+                background[tile * 8 + col] = value ? (paletteSelect | value) : 0;
+            }
+        }
+    }
+    const uint8_t* backgroundLine = background + state.x;
+
+    // Sprite pixels, first opaque sprite in OAM order wins
+    // Each value is 0x10 | palette select << 2 | pattern value plus the flag below
+    constexpr uint8_t SpritePixel_Behind = 1 << 5;
+    uint8_t sprites[FrameWidth] = {};
+
+    uint8_t found[8];
+    size_t spriteCount = std::min<size_t>(EvaluateSprites(memory.oam, state.ctrl, line, found), 8);
+    for (size_t n = 0; n < spriteCount && (lineMask & Mask_ShowSprites); ++n) {
+        const uint8_t* sprite = &memory.oam[found[n] * 4];
+        uint8_t attributes = sprite[2];
+        uint8_t spriteX = sprite[3];
+
+        auto [lower, upper] = FetchSpriteRow(memory, state.chr, state.ctrl, sprite, line);
+        for (size_t col = 0; col < 8 && spriteX + col < FrameWidth; ++col) {
+            // Horizontal flip
+            auto bit = (attributes & 0x40) ? col : 7 - col;
+            uint8_t value = ((lower >> bit) & 1) | (((upper >> bit) & 1) << 1);
+            if (!value || sprites[spriteX + col]) {
+                continue;
+            }
+            sprites[spriteX + col] = 0x10 | ((attributes & 0b11) << 2) | value
+                | ((attributes & 0x20) ? SpritePixel_Behind : 0);
+        }
+    }
+
+    // Compose and resolve through palette RAM, mask writes apply from their dot on
+    uint8_t mask = state.mask;
+    auto event = events.begin();
+    for (size_t px = 0; px < FrameWidth; ++px) {
+        for (; event != events.end() && event->dot <= px; ++event) {
+            if (event->reg == PPURegister_MASK) {
+                mask = event->value;
+            }
+        }
+
+        uint8_t bg = (!(mask & Mask_ShowBackground) || (px < 8 && !(mask & Mask_ShowBackgroundLeft))) ? 0 : backgroundLine[px];
+        uint8_t sp = (!(mask & Mask_ShowSprites) || (px < 8 && !(mask & Mask_ShowSpritesLeft))) ? 0 : sprites[px];
+        uint8_t color = (sp && (!bg || !(sp & SpritePixel_Behind))) ? (sp & 0x1F) : bg;
+
+        // Rendering disabled shows the backdrop color
+        const uint8_t colorMask = (mask & Mask_Grayscale) ? 0x30 : 0x3F;
+        out[px] = (memory.palette[PaletteOffset(0x3F00 | color)] & colorMask) | ((mask & Mask_Emphasis) << 1);
+    }
+}
+
+void PPU::EvaluateScanline(uint16_t line) {
+    uint8_t found[8];
+    size_t spriteCount = EvaluateSprites(oam, ctrl, line, found);
+    if (spriteCount > 8) {
+        status |= Status_SpriteOverflow;
+    }
+
+    // Sprite 0 hit needs both layers and can only happen on the lines sprite 0 covers
+    constexpr uint8_t BothLayers = Mask_ShowBackground | Mask_ShowSprites;
+    if (spriteCount == 0 || found[0] != 0 || (mask & BothLayers) != BothLayers || (status & Status_Sprite0Hit)) {
+        return;
+    }
+
+    const Memory memory = GetLiveMemory();
+    const auto chr = cartridge.GetChrBanks();
+    const uint8_t attributes = oam[2];
+    const uint8_t spriteX = oam[3];
+    const bool clipLeft = !(mask & Mask_ShowBackgroundLeft) || !(mask & Mask_ShowSpritesLeft);
+    auto [spriteLower, spriteUpper] = FetchSpriteRow(memory, chr.banks, ctrl, oam, line);
+
+    // Only the one or two background tiles under sprite 0 are fetched
+    size_t fetchedTile = SIZE_MAX;
+    uint8_t backgroundLower = 0, backgroundUpper = 0;
+    for (size_t col = 0; col < 8 && spriteX + col < FrameWidth - 1; ++col) {
+        size_t px = spriteX + col;
+        if (px < 8 && clipLeft) {
+            continue;
+        }
+
+        auto spriteBit = (attributes & 0x40) ? col : 7 - col;
+        if (!(((spriteLower | spriteUpper) >> spriteBit) & 1)) {
+            continue;
+        }
+
+        size_t position = x + px;
+        if (position / 8 != fetchedTile) {
+            fetchedTile = position / 8;
+            std::tie(backgroundLower, backgroundUpper) = FetchBackgroundRow(memory, chr.banks, ctrl, CoarseXOffset(v, fetchedTile));
+        }
+        auto backgroundBit = 7 - position % 8;
+        if (((backgroundLower | backgroundUpper) >> backgroundBit) & 1) {
+            status |= Status_Sprite0Hit;
+            return;
+        }
+    }
+}
+
+size_t PPU::EvaluateSprites(const uint8_t* oam, uint8_t ctrl, uint16_t line, uint8_t (&found)[8]) {
+    const int spriteHeight = (ctrl & Ctrl_SpriteSize16) ? 16 : 8;
+    size_t spriteCount = 0;
+    for (size_t i = 0; i < 64; ++i) {
+        // Sprite data is delayed by one scanline
+        int row = line - (oam[i * 4] + 1);
+        if (row < 0 || row >= spriteHeight) {
+            continue;
+        }
+
+        if (spriteCount == 8) {
+            return 9;
+        }
+        found[spriteCount++] = static_cast<uint8_t>(i);
+    }
+    return spriteCount;
+}
+
+std::pair<uint8_t, uint8_t> PPU::FetchBackgroundRow(const Memory& memory, const uint8_t* const* chr,
+    uint8_t ctrl, uint16_t address) {
+    const PPUAddr patternTable = (ctrl & Ctrl_BackgroundTable) ? 0x1000 : 0x0000;
+    const uint16_t fineY = (address >> 12) & 0b111;
+    auto tileIndex = memory.nametables[NametableOffset(0x2000 | (address & 0x0FFF), memory.mirroring)];
+
+    PPUAddr patternAddr = patternTable + tileIndex * 16 + fineY;
+    return { ReadPattern(memory, chr, patternAddr), ReadPattern(memory, chr, patternAddr + 8) };
+}
+
+std::pair<uint8_t, uint8_t> PPU::FetchSpriteRow(const Memory& memory, const uint8_t* const* chr, uint8_t ctrl,
+    const uint8_t* sprite, uint16_t line) {
+    const int spriteHeight = (ctrl & Ctrl_SpriteSize16) ? 16 : 8;
+    int row = line - (sprite[0] + 1);
+    uint8_t tileIndex = sprite[1];
+    uint8_t attributes = sprite[2];
+
+    // Vertical flip
+    if (attributes & 0x80) {
+        row = spriteHeight - 1 - row;
+    }
+
+    PPUAddr patternAddr;
+    if (spriteHeight == 16) {
+        patternAddr = ((tileIndex & 1) * 0x1000) + (tileIndex & 0xFE) * 16 + (row & 0b1000) * 2 + (row & 0b111);
+    } else {
+        patternAddr = ((ctrl & Ctrl_SpriteTable) ? 0x1000 : 0x0000) + tileIndex * 16 + row;
+    }
+    return { ReadPattern(memory, chr, patternAddr), ReadPattern(memory, chr, patternAddr + 8) };
+}
+
+void PPU::IncrementY() {
+    if ((v & 0x7000) != 0x7000) {
+        // Increment fine Y
+        v += 0x1000;
+        return;
+    }
+
+    v &= ~0x7000;
+    uint16_t coarseY = (v & 0x03E0) >> 5;
+    if (coarseY == 29) {
+        // Wrap into the next vertical nametable
+        coarseY = 0;
+        v ^= 0x0800;
+    } else if (coarseY == 31) {
+        // Attribute rows wrap without switching nametables
+        coarseY = 0;
+    } else {
+        coarseY++;
+    }
+    v = (v & ~0x03E0) | (coarseY << 5);
+}
+
+uint8_t PPU::ReadRegister(Addr address) {
+    switch (0x2000 + (address & 0b111)) {
+    case PPURegister_STATUS: {
+        uint8_t value = (status & 0xE0) | (openBus & 0x1F);
+        status &= ~Status_VBlank;
+        w = false;
+        openBus = value;
+        return value;
+    }
+
+    case PPURegister_OAMDATA:
+        openBus = oam[oamAddr];
+        return openBus;
+
+    case PPURegister_DATA: {
+        uint8_t value;
+        if ((v & 0x3FFF) >= 0x3F00) {
+            // Palette reads are not buffered, but the buffer is filled with the nametable underneath
+            value = (ReadVRAM(v) & 0x3F) | (openBus & 0xC0);
+            readBuffer = ReadVRAM(v - 0x1000);
+        } else {
+            value = readBuffer;
+            readBuffer = ReadVRAM(v);
+        }
+        v = (v + ((ctrl & Ctrl_Increment32) ? 32 : 1)) & 0x7FFF;
+        openBus = value;
+        return value;
+    }
+
+    default:
+        // Write only registers return the open bus latch
+        return openBus;
+    }
+}
+
+uint8_t PPU::PeekRegister(Addr address) const {
+    switch (0x2000 + (address & 0b111)) {
+    case PPURegister_STATUS:
+        return (status & 0xE0) | (openBus & 0x1F);
+    case PPURegister_OAMDATA:
+        return oam[oamAddr];
+    case PPURegister_DATA:
+        return readBuffer;
+    default:
+        return openBus;
+    }
+}
+
+void PPU::WriteRegister(Addr address, uint8_t value) {
+    openBus = value;
+    const auto reg = static_cast<PPURegister>(0x2000 + (address & 0b111));
+
+    // Control and mask writes while a line is drawn change the rest of it
+    if ((reg == PPURegister_CTRL || reg == PPURegister_MASK) && IsRecordingLine() && dot < HBlankDot) {
+        recording->events.push_back({ dot, reg, value });
+        recording->lines[scanline].eventCount++;
+    }
+
+    switch (reg) {
+    case PPURegister_CTRL:
+        // Enabling NMI during vblank is an edge too
+        // https://www.nesdev.org/wiki/NMI
+        if ((status & Status_VBlank) && !(ctrl & Ctrl_NMIEnable) && (value & Ctrl_NMIEnable)) {
+            interrupts.SetNMI(GetCPUCycle());
+        }
+        ctrl = value;
+        t = (t & ~0x0C00) | ((value & Ctrl_Nametable) << 10);
+        break;
+
+    case PPURegister_MASK:
+        mask = value;
+        break;
+
+    case PPURegister_STATUS:
+        // Read only
+        break;
+
+    case PPURegister_OAMADDR:
+        oamAddr = value;
+        break;
+
+    case PPURegister_OAMDATA:
+        BeforeMemoryWrite();
+        oam[oamAddr++] = value;
+        break;
+
+    case PPURegister_SCROLL:
+        if (!w) {
+            t = (t & ~0x001F) | (value >> 3);
+            x = value & 0b111;
+        } else {
+            t = (t & ~0x73E0) | ((value & 0b111) << 12) | ((value & 0xF8) << 2);
+        }
+        w = !w;
+        break;
+
+    case PPURegister_ADDR:
+        if (!w) {
+            t = (t & 0x00FF) | ((value & 0x3F) << 8);
+        } else {
+            t = (t & 0xFF00) | value;
+            v = t;
+        }
+        w = !w;
+        break;
+
+    case PPURegister_DATA:
+        WriteVRAM(v, value);
+        v = (v + ((ctrl & Ctrl_Increment32) ? 32 : 1)) & 0x7FFF;
+        break;
+    }
+}
+
+void PPU::WriteOAMDMA(const uint8_t* page) {
+    BeforeMemoryWrite();
+    for (size_t i = 0; i < sizeof(oam); ++i) {
+        oam[(oamAddr + i) & 0xFF] = page[i];
+    }
+}
+
+void PPU::MarkChr(PPUAddr address, uint8_t flags) {
+    if constexpr (CoverageEnabled) {
+        if (coverage) {
+            coverage->MarkChr(cartridge.GetChrBanks().banks[address >> 10] + (address & 0x3FF), flags);
+        }
+    }
+}
+
+uint8_t PPU::ReadVRAM(PPUAddr address) {
+    address &= 0x3FFF;
+    if (address < 0x2000) {
+        MarkChr(address, CoverageFlag_Read);
+        return cartridge.ReadChr(address);
+    } else if (address < 0x3F00) {
+        return nametables[NametableOffset(address, mirroring)];
+    } else {
+        return palette[PaletteOffset(address)];
+    }
+}
+
+void PPU::WriteVRAM(PPUAddr address, uint8_t value) {
+    BeforeMemoryWrite();
+    address &= 0x3FFF;
+    if (address < 0x2000) {
+        MarkChr(address, CoverageFlag_Write);
+        cartridge.WriteChr(address, value);
+    } else if (address < 0x3F00) {
+        nametables[NametableOffset(address, mirroring)] = value;
+    } else {
+        palette[PaletteOffset(address)] = value;
+    }
+}
+
+// https://www.nesdev.org/wiki/Mirroring#Nametable_Mirroring
+uint16_t PPU::NametableOffset(PPUAddr address, Cartridge::Mirroring mirroring) {
+    uint16_t offset = (address - 0x2000) & 0x0FFF;
+    uint16_t table = offset / 0x400;
+    switch (mirroring) {
+    case Cartridge::Mirroring_Vertical:
+        table &= 1;
+        break;
+    case Cartridge::Mirroring_Horizontal:
+        table >>= 1;
+        break;
+    case Cartridge::Mirroring_FourScreen:
+        break;
+    case Cartridge::Mirroring_OneScreenLow:
+        table = 0;
+        break;
+    case Cartridge::Mirroring_OneScreenHigh:
+        table = 1;
+        break;
+    }
+    return table * 0x400 + (offset & 0x3FF);
+}
+
+// $3F10/$3F14/$3F18/$3F1C mirror $3F00/$3F04/$3F08/$3F0C
+uint8_t PPU::PaletteOffset(PPUAddr address) {
+    uint8_t offset = address & 0x1F;
+    if ((offset & 0x13) == 0x10) {
+        offset &= ~0x10;
+    }
+    return offset;
+}
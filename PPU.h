@@ -0,0 +1,283 @@
+#pragma once
+
+#include "pch.h"
+
+#include "Cartridge.h"
+#include "Coverage.h"
+#include "FrameBuffer.h"
+#include "Interrupts.h"
+#include "Scheduler.h"
+
+#include <functional>
+#include <optional>
+#include <span>
+
+class FrameRenderer;
+
+// Scanline based PPU. Vblank and NMI timing is exact to the dot, sprite 0 hit and sprite
+// overflow are evaluated for a whole line and set at dot 256 of it rather than on the pixel
+// they happen at. Pixels are produced one scanline at a time when the PPU clock reaches the
+// end of the visible part of a line.
+//
+// Pixels only depend on the state latched when a line starts plus the $2000/$2001 writes
+// during the line, so lines can also be rendered later from a snapshot, see SetRenderThreads.
+// Frames that write VRAM or OAM after lines were drawn are rendered line by line instead.
+// https://www.nesdev.org/wiki/PPU
+class PPU {
+public:
+    PPU(Cartridge& cartridge, InterruptLines& interrupts);
+    ~PPU();
+
+    void PowerOn();
+    void Reset();
+    // Picks up the nametable mirroring the cartridge switched to, after every cartridge write
+    void UpdateMirroring();
+
+    // Advance the PPU clock by the given number of dots (3 per CPU cycle on NTSC)
+    void Tick(size_t dots);
+    // The PPU as a coroutine of the scheduler, it keeps up with the master clock by itself
+    Scheduler::Task Process(const Scheduler& scheduler);
+
+    uint8_t ReadRegister(Addr address);
+    // Read a register without side effects, for tracing
+    uint8_t PeekRegister(Addr address) const;
+    void WriteRegister(Addr address, uint8_t value);
+
+    // $4014 OAM DMA, page is the 256 bytes read by the CPU
+    void WriteOAMDMA(const uint8_t* page);
+
+    uint16_t GetScanline() const { return scanline; }
+    uint16_t GetDot() const { return dot; }
+    uint64_t GetFrameNumber() const { return frameNumber; }
+
+    // Completed frames, latest first. The consumer side may be used from another thread.
+    TripleBuffer<Frame>& GetFrameOutput() { return frameOutput; }
+
+    // Only every n-th frame is rendered and published, the others keep all CPU visible
+    // side effects (vblank, sprite 0 hit, sprite overflow) but produce no pixels
+    void SetPresentInterval(uint32_t interval);
+
+    // Called on the emulation thread with every completed frame, right before it is published.
+    // Frames that are not presented have stale pixels. With deferred rendering a frame is
+    // delivered at the start of the next vblank, by FlushFrame, or once the next frame writes
+    // VRAM or OAM while it is drawn.
+    using FrameCallback = std::function<void(const Frame&)>;
+    void SetFrameCallback(FrameCallback callback) { frameCallback = std::move(callback); }
+
+    // 0 renders every line on the emulation thread as it completes. Otherwise frames are
+    // recorded as snapshots and rendered by that many worker threads while the emulation
+    // continues with the next frame. Frames writing VRAM or OAM mid-frame render immediately.
+    void SetRenderThreads(size_t threads);
+    // Wait for a frame still being rendered and deliver it
+    void FlushFrame();
+    // Mark the CHR bytes fetched and accessed through $2007, nullptr to stop. Only builds
+    // with NES2_COVERAGE call it.
+    void SetCoverage(Coverage* coverage);
+
+    enum PPURegister : Addr {
+        PPURegister_CTRL = 0x2000,
+        PPURegister_MASK = 0x2001,
+        PPURegister_STATUS = 0x2002,
+        PPURegister_OAMADDR = 0x2003,
+        PPURegister_OAMDATA = 0x2004,
+        PPURegister_SCROLL = 0x2005,
+        PPURegister_ADDR = 0x2006,
+        PPURegister_DATA = 0x2007
+    };
+
+    static constexpr uint16_t DotsPerScanline = 341;
+    static constexpr uint16_t ScanlinesPerFrame = 262;
+    static constexpr uint16_t VBlankScanline = 241;
+    static constexpr uint16_t PreRenderScanline = 261;
+    // Lines are rendered and the scroll is updated for the next line here
+    static constexpr uint16_t HBlankDot = 256;
+
+    // State latched when a visible line starts
+    struct ScanlineState {
+        uint16_t v = 0;
+        uint8_t x = 0;
+        uint8_t ctrl = 0;
+        uint8_t mask = 0;
+        // Range of the line's events in the owning list
+        uint16_t firstEvent = 0;
+        uint16_t eventCount = 0;
+        const uint8_t* chr[8] = {};
+    };
+
+    // A $2000 or $2001 write while the line was drawn, applies from pixel dot on
+    struct ScanlineEvent {
+        uint16_t dot;
+        PPURegister reg;
+        uint8_t value;
+    };
+
+    // The memory pixels are resolved from, live or from a snapshot
+    struct Memory {
+        const uint8_t* nametables;
+        const uint8_t* palette;
+        const uint8_t* oam;
+        Cartridge::Mirroring mirroring;
+        // Marks the pattern fetches, nullptr when not recording coverage
+        Coverage* coverage;
+    };
+
+    // Everything needed to render a frame after the emulation moved on
+    struct FrameSnapshot {
+        uint64_t number = 0;
+        ScanlineState lines[FrameHeight];
+        std::vector<ScanlineEvent> events;
+        Cartridge::Mirroring mirroring = Cartridge::Mirroring_Horizontal;
+        uint8_t nametables[4096];
+        uint8_t palette[32];
+        uint8_t oam[256];
+        // Copy of the CHR RAM at the end of the frame, CHR ROM is referenced directly
+        std::vector<uint8_t> chrRam;
+        Coverage* coverage = nullptr;
+
+        Memory GetMemory() const { return { nametables, palette, oam, mirroring, coverage }; }
+        std::span<const ScanlineEvent> GetEvents(const ScanlineState& state) const {
+            return { events.data() + state.firstEvent, state.eventCount };
+        }
+    };
+
+    // Pixels of one visible line. Pure, CPU visible side effects come from EvaluateScanline.
+    static void RenderScanline(const Memory& memory, const ScanlineState& state,
+        std::span<const ScanlineEvent> events, uint16_t line, Pixel* out);
+
+private:
+    enum CtrlFlags : uint8_t {
+        Ctrl_Nametable = 0b11,
+        Ctrl_Increment32 = 1 << 2,
+        Ctrl_SpriteTable = 1 << 3,
+        Ctrl_BackgroundTable = 1 << 4,
+        Ctrl_SpriteSize16 = 1 << 5,
+        Ctrl_NMIEnable = 1 << 7
+    };
+
+    enum MaskFlags : uint8_t {
+        Mask_Grayscale = 1 << 0,
+        Mask_ShowBackgroundLeft = 1 << 1,
+        Mask_ShowSpritesLeft = 1 << 2,
+        Mask_ShowBackground = 1 << 3,
+        Mask_ShowSprites = 1 << 4,
+        Mask_Emphasis = 0b111 << 5
+    };
+
+    enum StatusFlags : uint8_t {
+        Status_SpriteOverflow = 1 << 5,
+        Status_Sprite0Hit = 1 << 6,
+        Status_VBlank = 1 << 7
+    };
+
+    // CPU cycle of the current dot
+    uint64_t GetCPUCycle() const { return (lineStart + dot) / 3; }
+    // CPU cycle by which the PPU has to run to set the next vblank flag and NMI on time
+    uint64_t NextVBlankCycle() const;
+
+    bool IsRenderingEnabled() const { return mask & (Mask_ShowBackground | Mask_ShowSprites); }
+    // Emphasis bits positioned for Pixel
+    Pixel Emphasis() const { return (mask & Mask_Emphasis) << 1; }
+
+    void StartHBlank();
+    void EndScanline();
+    void StartScanline();
+
+    bool IsPresentedFrame() const { return frameNumber % presentInterval == 0; }
+    bool IsRecordingLine() const { return scanline < FrameHeight && IsPresentedFrame(); }
+
+    // Hands the back buffer to the frame callback and publishes it when presented
+    void CompleteFrame(uint64_t number, bool presented);
+    // Copies the memory of the finished frame into the snapshot being recorded
+    void FinishSnapshot();
+    // Before a write to VRAM or OAM. Lines the deferred renderer draws later would see it, so
+    // the frame falls back to rendering them as they complete.
+    void BeforeMemoryWrite() {
+        if (renderer && !immediateFrame && IsPresentedFrame() && scanline < VBlankScanline && (scanline || dot >= HBlankDot)) [[unlikely]] {
+            RenderImmediately();
+        }
+    }
+    void RenderImmediately();
+    Memory GetLiveMemory() const { return { nametables, palette, oam, mirroring, coverage }; }
+
+    // Side effects of rendering a scanline without producing pixels
+    void EvaluateScanline(uint16_t line);
+
+    // Up to 8 sprites on the line in OAM order, returns 9 on sprite overflow
+    static size_t EvaluateSprites(const uint8_t* oam, uint8_t ctrl, uint16_t line, uint8_t (&found)[8]);
+    // Pattern bit planes for the background tile at address, and for a sprite on the line
+    static std::pair<uint8_t, uint8_t> FetchBackgroundRow(const Memory& memory, const uint8_t* const* chr,
+        uint8_t ctrl, uint16_t address);
+    static std::pair<uint8_t, uint8_t> FetchSpriteRow(const Memory& memory, const uint8_t* const* chr, uint8_t ctrl,
+        const uint8_t* sprite, uint16_t line);
+    static uint8_t ReadPattern(const Memory& memory, const uint8_t* const* chr, PPUAddr address) {
+        const uint8_t* pattern = &chr[(address >> 10) & 0b111][address & 0x3FF];
+        if constexpr (CoverageEnabled) {
+            if (memory.coverage) {
+                memory.coverage->MarkChr(pattern, CoverageFlag_Read);
+            }
+        }
+        return *pattern;
+    }
+
+    // Scroll register updates, see: https://www.nesdev.org/wiki/PPU_scrolling
+    void IncrementY();
+    void CopyHorizontal() { v = (v & ~0x041F) | (t & 0x041F); }
+    void CopyVertical() { v = (v & ~0x7BE0) | (t & 0x7BE0); }
+    // Address of the tile the given number of tiles right of address, wrapping into the next nametable
+    static uint16_t CoarseXOffset(uint16_t address, size_t tiles) {
+        uint16_t coarseX = (address & 0x001F) + static_cast<uint16_t>(tiles);
+        address = (address & ~0x001F) | (coarseX & 0x001F);
+        return coarseX >= 32 ? address ^ 0x0400 : address;
+    }
+
+    uint8_t ReadVRAM(PPUAddr address);
+    void WriteVRAM(PPUAddr address, uint8_t value);
+    // $2007 access to CHR for the coverage
+    void MarkChr(PPUAddr address, uint8_t flags);
+    static uint16_t NametableOffset(PPUAddr address, Cartridge::Mirroring mirroring);
+    static uint8_t PaletteOffset(PPUAddr address);
+
+    Cartridge& cartridge;
+    InterruptLines& interrupts;
+    Cartridge::Mirroring mirroring = Cartridge::Mirroring_Horizontal;
+
+    // Internal memory
+    uint8_t nametables[4096]; // 2KB on the console, 4KB for four screen carts
+    uint8_t palette[32];
+    uint8_t oam[256];
+
+    // Registers
+    uint8_t ctrl = 0;
+    uint8_t mask = 0;
+    uint8_t status = 0;
+    uint8_t oamAddr = 0;
+    uint8_t readBuffer = 0; // $2007 read buffer
+    uint8_t openBus = 0;    // Last value written to any register
+
+    // Internal scroll registers
+    uint16_t v = 0;   // Current VRAM address
+    uint16_t t = 0;   // Temporary VRAM address
+    uint8_t x = 0;    // Fine X scroll
+    bool w = false;   // First/second write toggle
+
+    // Timing
+    uint16_t scanline = 0;
+    uint16_t dot = 0;
+    uint64_t frameNumber = 0;
+    // Dots since power on at dot 0 of the current line, three per CPU cycle
+    uint64_t lineStart = 0;
+    uint32_t presentInterval = 1;
+
+    TripleBuffer<Frame> frameOutput;
+    FrameCallback frameCallback;
+
+    // Line states are recorded into one snapshot while the renderer works on the other.
+    // Without a renderer only the current line's state and events are kept.
+    std::unique_ptr<FrameSnapshot[]> snapshots;
+    FrameSnapshot* recording = nullptr;
+    std::unique_ptr<FrameRenderer> renderer;
+    std::optional<uint64_t> pendingFrame;
+    // Rendered line by line on the emulation thread despite the renderer, see BeforeMemoryWrite
+    bool immediateFrame = false;
+    Coverage* coverage = nullptr;
+};
@@ -0,0 +1,124 @@
+#include "Palette.h"
+
+#include "SIMD.h"
+
+namespace {
+
+struct RGB {
+    uint8_t r, g, b;
+};
+
+// https://www.nesdev.org/wiki/PPU_palettes#2C02
+constexpr RGB BasePalette[64] = {
+    { 0x54, 0x54, 0x54 }, { 0x00, 0x1E, 0x74 }, { 0x08, 0x10, 0x90 }, { 0x30, 0x00, 0x88 },
+    { 0x44, 0x00, 0x64 }, { 0x5C, 0x00, 0x30 }, { 0x54, 0x04, 0x00 }, { 0x3C, 0x18, 0x00 },
+    { 0x20, 0x2A, 0x00 }, { 0x08, 0x3A, 0x00 }, { 0x00, 0x40, 0x00 }, { 0x00, 0x3C, 0x00 },
+    { 0x00, 0x32, 0x3C }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+
+    { 0x98, 0x96, 0x98 }, { 0x08, 0x4C, 0xC4 }, { 0x30, 0x32, 0xEC }, { 0x5C, 0x1E, 0xE4 },
+    { 0x88, 0x14, 0xB0 }, { 0xA0, 0x14, 0x64 }, { 0x98, 0x22, 0x20 }, { 0x78, 0x3C, 0x00 },
+    { 0x54, 0x5A, 0x00 }, { 0x28, 0x72, 0x00 }, { 0x08, 0x7C, 0x00 }, { 0x00, 0x76, 0x28 },
+    { 0x00, 0x66, 0x78 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+
+    { 0xEC, 0xEE, 0xEC }, { 0x4C, 0x9A, 0xEC }, { 0x78, 0x7C, 0xEC }, { 0xB0, 0x62, 0xEC },
+    { 0xE4, 0x54, 0xEC }, { 0xEC, 0x58, 0xB4 }, { 0xEC, 0x6A, 0x64 }, { 0xD4, 0x88, 0x20 },
+    { 0xA0, 0xAA, 0x00 }, { 0x74, 0xC4, 0x00 }, { 0x4C, 0xD0, 0x20 }, { 0x38, 0xCC, 0x6C },
+    { 0x38, 0xB4, 0xCC }, { 0x3C, 0x3C, 0x3C }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+
+    { 0xEC, 0xEE, 0xEC }, { 0xA8, 0xCC, 0xEC }, { 0xBC, 0xBC, 0xEC }, { 0xD4, 0xB2, 0xEC },
+    { 0xEC, 0xAE, 0xEC }, { 0xEC, 0xAE, 0xD4 }, { 0xEC, 0xB4, 0xB0 }, { 0xE4, 0xC4, 0x90 },
+    { 0xCC, 0xD2, 0x78 }, { 0xB4, 0xDE, 0x78 }, { 0xA8, 0xE2, 0x90 }, { 0x98, 0xE2, 0xB4 },
+    { 0xA0, 0xD6, 0xE4 }, { 0xA0, 0xA2, 0xA0 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }
+};
+
+// Each emphasis bit darkens the other two channels
+// https://www.nesdev.org/wiki/NTSC_video#Color_Tint_Bits
+constexpr double EmphasisAttenuation = 0.816328;
+
+#ifdef NES2_X86
+NES2_TARGET("avx2")
+void GatherRGBA8888AVX2(const uint32_t* lut, const Pixel* pixels, uint32_t* out, size_t count) {
+    const __m256i indexMask = _mm256_set1_epi32(PixelMask);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i packed = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i));
+        __m256i lower = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(packed)), indexMask);
+        __m256i upper = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(packed, 1)), indexMask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), lower, 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 8), _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), upper, 4));
+    }
+    for (; i < count; ++i) {
+        out[i] = lut[pixels[i] & PixelMask];
+    }
+}
+
+NES2_TARGET("avx2")
+void GatherRGB565AVX2(const uint32_t* lut, const Pixel* pixels, uint16_t* out, size_t count) {
+    const __m256i indexMask = _mm256_set1_epi32(PixelMask);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i packed = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i));
+        __m256i lower = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(packed)), indexMask);
+        __m256i upper = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(packed, 1)), indexMask);
+        lower = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), lower, 4);
+        upper = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), upper, 4);
+        // Packing works per 128 bit lane, restore pixel order afterwards
+        __m256i colors = _mm256_permute4x64_epi64(_mm256_packus_epi32(lower, upper), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), colors);
+    }
+    for (; i < count; ++i) {
+        out[i] = static_cast<uint16_t>(lut[pixels[i] & PixelMask]);
+    }
+}
+#endif
+
+} // namespace
+
+Palette::Palette() {
+    for (size_t i = 0; i < Entries; ++i) {
+        const RGB& base = BasePalette[i & PixelIndexMask];
+        const size_t emphasis = i >> 6; // Red, green, blue from bit 0
+
+        double scale[3] = { 1.0, 1.0, 1.0 };
+        for (size_t channel = 0; channel < 3; ++channel) {
+            if (emphasis & (1 << channel)) {
+                for (size_t other = 0; other < 3; ++other) {
+                    if (other != channel) {
+                        scale[other] *= EmphasisAttenuation;
+                    }
+                }
+            }
+        }
+
+        uint32_t r = static_cast<uint32_t>(base.r * scale[0] + 0.5);
+        uint32_t g = static_cast<uint32_t>(base.g * scale[1] + 0.5);
+        uint32_t b = static_cast<uint32_t>(base.b * scale[2] + 0.5);
+
+        rgba8888[i] = r | (g << 8) | (b << 16) | (0xFFu << 24);
+        rgb565[i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    }
+}
+
+void Palette::ToRGBA8888(const Pixel* pixels, uint32_t* out, size_t count) const {
+#ifdef NES2_X86
+    if (SIMD::HasAVX2()) {
+        GatherRGBA8888AVX2(rgba8888.data(), pixels, out, count);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = rgba8888[pixels[i] & PixelMask];
+    }
+}
+
+void Palette::ToRGB565(const Pixel* pixels, uint16_t* out, size_t count) const {
+#ifdef NES2_X86
+    if (SIMD::HasAVX2()) {
+        GatherRGB565AVX2(rgb565.data(), pixels, out, count);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<uint16_t>(rgb565[pixels[i] & PixelMask]);
+    }
+}
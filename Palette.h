@@ -0,0 +1,32 @@
+#pragma once
+
+#include "pch.h"
+
+#include "FrameBuffer.h"
+
+#include <array>
+
+// Converts PPU output (palette index plus emphasis bits) to RGB.
+//
+// Conversion is a separate stage so it only runs when a consumer needs RGB and can run on
+// the consumer thread. The lookup tables are immutable after construction, so one Palette
+// may be shared between threads.
+class Palette {
+public:
+    // Builds the lookup tables from the default 2C02 palette
+    Palette();
+
+    // Memory order R, G, B, A
+    void ToRGBA8888(const Pixel* pixels, uint32_t* out, size_t count) const;
+    void ToRGB565(const Pixel* pixels, uint16_t* out, size_t count) const;
+
+    void ToRGBA8888(const Frame& frame, uint32_t* out) const { ToRGBA8888(frame.pixels.data(), out, frame.pixels.size()); }
+    void ToRGB565(const Frame& frame, uint16_t* out) const { ToRGB565(frame.pixels.data(), out, frame.pixels.size()); }
+
+    static constexpr size_t Entries = PixelMask + 1;
+
+private:
+    // Both tables hold 32 bit entries so the AVX2 kernels can gather them directly
+    alignas(64) std::array<uint32_t, Entries> rgba8888;
+    alignas(64) std::array<uint32_t, Entries> rgb565;
+};
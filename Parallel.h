@@ -0,0 +1,29 @@
+#pragma once
+
+#include "pch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// Runs work(i) for every i below count on up to the given number of threads, the calling
+// thread included. Items are claimed one at a time so uneven work still spreads evenly.
+template <typename Work>
+void ParallelFor(size_t count, size_t threads, const Work& work) {
+    if (count == 0) {
+        return;
+    }
+    threads = std::clamp<size_t>(threads, 1, count);
+    std::atomic<size_t> next{ 0 };
+    auto worker = [&] {
+        for (size_t i = next++; i < count; i = next++) {
+            work(i);
+        }
+    };
+
+    std::vector<std::jthread> workers;
+    for (size_t i = 1; i < threads; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+}
@@ -0,0 +1,272 @@
+#include "Profiler.h"
+
+#include "Disassembler.h"
+#include "InstrTable.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <ranges>
+#include <tuple>
+
+namespace {
+
+void SaveText(const char* path, const std::string& text) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(text.data(), text.size());
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to write profile {}", path));
+    }
+}
+
+} // namespace
+
+Profiler::Profiler(Cartridge& cartridge, MMU& mmu) :
+    cartridge(cartridge),
+    mmu(mmu),
+    prgRom(cartridge.GetPrgRom()) {
+    VERIFY(prgRom.size() <= UINT32_MAX - 0x10000, "PRG ROM too large to profile", prgRom.size());
+    samples.resize(prgRom.size() + 0x10000);
+
+    // Vectors are read from the fixed bank like dump does, in the order their labels are preferred
+    // https://www.nesdev.org/wiki/CPU_memory_map
+    auto vector = [&](size_t fromEnd) {
+        return GetLocation(static_cast<Addr>(prgRom[prgRom.size() - fromEnd] | (prgRom[prgRom.size() - fromEnd + 1] << 8)));
+    };
+    vectorTargets = { { vector(4), "RESET" }, { vector(6), "NMI" }, { vector(2), "IRQ" } };
+    SPDLOG_INFO("Profiler tracking {} PRG ROM bytes", prgRom.size());
+}
+
+uint32_t Profiler::GetLocation(Addr address) const {
+    const size_t offset = cartridge.GetPrgRomOffset(address);
+    return static_cast<uint32_t>(offset != Mapper::NotPrgRom ? offset : prgRom.size() + address);
+}
+
+size_t Profiler::GetBank(uint32_t location) const {
+    return IsBanked() ? location / BankSize : 0;
+}
+
+Addr Profiler::GetAddress(uint32_t location) const {
+    if (!IsPrgRom(location)) {
+        return static_cast<Addr>(location - prgRom.size());
+    }
+    if (!IsBanked()) {
+        return static_cast<Addr>(0x10000 - prgRom.size() + location);
+    }
+    const bool fixed = GetBank(location) + 1 == prgRom.size() / BankSize;
+    return static_cast<Addr>((fixed ? 0xC000 : 0x8000) + location % BankSize);
+}
+
+std::string Profiler::GetLabel(uint32_t location) const {
+    for (auto [target, name] : vectorTargets) {
+        if (target == location) {
+            return std::string(name);
+        }
+    }
+    if (IsPrgRom(location) && IsBanked() && GetBank(location) + 1 != prgRom.size() / BankSize) {
+        return fmt::format("{:02X}:L_{:04X}", GetBank(location), GetAddress(location));
+    }
+    return fmt::format("L_{:04X}", GetAddress(location));
+}
+
+std::array<uint8_t, 3> Profiler::GetCode(uint32_t location) const {
+    std::array<uint8_t, 3> code{};
+    if (IsPrgRom(location)) {
+        // Instructions don't continue past the end of their bank
+        const size_t end = IsBanked() ? (GetBank(location) + 1) * BankSize : prgRom.size();
+        for (size_t i = 0; i < code.size() && location + i < end; ++i) {
+            code[i] = prgRom[location + i];
+        }
+    } else {
+        for (size_t i = 0; i < code.size(); ++i) {
+            code[i] = mmu.Peek(static_cast<Addr>(GetAddress(location) + i));
+        }
+    }
+    return code;
+}
+
+std::string Profiler::FormatInstruction(uint32_t location) const {
+    return Disassembler::FormatInstruction(GetCode(location), GetAddress(location));
+}
+
+void Profiler::EnsureRoot(Addr address) {
+    // Whatever runs first is the root of every call path, the reset handler after power on
+    if (stack.empty()) {
+        nodes.push_back({ NoParent, GetLocation(address), 0 });
+        stack.push_back({ 0, 0xFF });
+    }
+}
+
+void Profiler::Unwind(unsigned stackTop) {
+    // A live frame's return address is still on the stack, at or above its stack pointer
+    while (stack.size() > 1 && stack.back().stackPointer < stackTop) {
+        stack.pop_back();
+    }
+}
+
+void Profiler::Instruction(Addr address, uint64_t cycles) {
+    EnsureRoot(address);
+    Sample& sample = samples[GetLocation(address)];
+    sample.cycles += cycles;
+    sample.count++;
+    nodes[stack.back().node].cycles += cycles;
+    totalCycles += cycles;
+}
+
+void Profiler::Call(Addr address, uint8_t stackPointer, uint64_t cycles) {
+    EnsureRoot(address);
+    // Frames whose return address the new one overwrote were left without returning
+    Unwind(stackPointer + 1u);
+
+    const uint32_t location = GetLocation(address);
+    const uint32_t parent = stack.back().node;
+    auto [it, inserted] = children.try_emplace((uint64_t{ parent } << 32) | location, static_cast<uint32_t>(nodes.size()));
+    if (inserted) {
+        nodes.push_back({ parent, location, 0 });
+    }
+    stack.push_back({ it->second, stackPointer });
+    nodes[it->second].cycles += cycles;
+    totalCycles += cycles;
+}
+
+void Profiler::Return(uint8_t stackPointer) {
+    Unwind(stackPointer);
+}
+
+std::string Profiler::FormatFoldedStacks() const {
+    std::string out;
+    auto it = std::back_inserter(out);
+    std::vector<uint32_t> path;
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        if (!nodes[i].cycles) {
+            continue;
+        }
+        path.clear();
+        for (uint32_t node = i; node != NoParent; node = nodes[node].parent) {
+            path.push_back(node);
+        }
+        const char* separator = "";
+        for (auto node = path.rbegin(); node != path.rend(); ++node) {
+            out += separator;
+            out += GetLabel(nodes[*node].location);
+            separator = ";";
+        }
+        fmt::format_to(it, " {}\n", nodes[i].cycles);
+    }
+    return out;
+}
+
+std::string Profiler::FormatReport() const {
+    std::string out;
+    auto it = std::back_inserter(out);
+    auto percent = [&](uint64_t cycles) { return totalCycles ? 100.0 * cycles / totalCycles : 0.0; };
+    auto bank = [&](uint32_t location) { return IsPrgRom(location) ? fmt::format("{:02X}", GetBank(location)) : std::string("--"); };
+    auto line = [&](uint32_t location) {
+        const Sample& sample = samples[location];
+        fmt::format_to(it, "{:7.2f}% {:>12} {:>10}  {:<4}  {}\n", percent(sample.cycles), sample.cycles, sample.count,
+            bank(location), FormatInstruction(location));
+    };
+    fmt::format_to(it, "{} cycles profiled\n", totalCycles);
+
+    // Children are created after their parents, so one backwards pass sums up the call tree.
+    // Recursive calls only count towards the outermost call of the routine.
+    std::vector<uint64_t> inclusive(nodes.size());
+    for (size_t i = nodes.size(); i-- > 0;) {
+        inclusive[i] += nodes[i].cycles;
+        if (nodes[i].parent != NoParent) {
+            inclusive[nodes[i].parent] += inclusive[i];
+        }
+    }
+    struct Routine {
+        uint32_t location;
+        uint64_t self = 0;
+        uint64_t total = 0;
+    };
+    std::unordered_map<uint32_t, Routine> routineMap;
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        Routine& routine = routineMap.try_emplace(nodes[i].location, Routine{ nodes[i].location }).first->second;
+        routine.self += nodes[i].cycles;
+        bool outermost = true;
+        for (uint32_t node = nodes[i].parent; node != NoParent && outermost; node = nodes[node].parent) {
+            outermost = nodes[node].location != nodes[i].location;
+        }
+        if (outermost) {
+            routine.total += inclusive[i];
+        }
+    }
+    std::vector<Routine> routines;
+    for (const auto& [location, routine] : routineMap) {
+        routines.push_back(routine);
+    }
+    std::ranges::sort(routines, [](const Routine& a, const Routine& b) { return std::tie(b.self, a.location) < std::tie(a.self, b.location); });
+    out += "\nHottest routines, cycles in the routine itself and including what it calls\n";
+    out += "  percent         self  percent        total  routine\n";
+    for (const Routine& routine : routines | std::views::take(ReportCount)) {
+        fmt::format_to(it, "{:7.2f}% {:>12} {:7.2f}% {:>12}  {}\n", percent(routine.self), routine.self,
+            percent(routine.total), routine.total, GetLabel(routine.location));
+    }
+
+    std::vector<uint32_t> instructions;
+    for (uint32_t location = 0; location < samples.size(); ++location) {
+        if (samples[location].count) {
+            instructions.push_back(location);
+        }
+    }
+    std::ranges::sort(instructions, [&](uint32_t a, uint32_t b) { return std::tie(samples[b].cycles, a) < std::tie(samples[a].cycles, b); });
+    out += "\nHottest instructions\n";
+    out += "  percent       cycles      count  bank  code\n";
+    for (uint32_t location : instructions | std::views::take(ReportCount)) {
+        line(location);
+    }
+
+    // A loop runs from the target of a backward branch or jump to the branch, within its bank
+    struct Loop {
+        uint32_t start;
+        uint32_t end;
+        uint64_t cycles;
+    };
+    std::vector<Loop> loops;
+    for (uint32_t location : instructions) {
+        const std::array<uint8_t, 3> code = GetCode(location);
+        const InstrData& instr = InstrDataTable[code[0]];
+        const Addr address = GetAddress(location);
+        Addr target;
+        if (instr.mode == Addr_Relative) {
+            target = static_cast<Addr>(address + 2 + static_cast<int8_t>(code[1]));
+        } else if (code[0] == OP_JMP_ABS) {
+            target = static_cast<Addr>(code[1] | (code[2] << 8));
+        } else {
+            continue;
+        }
+        const uint32_t regionStart = !IsPrgRom(location) ? static_cast<uint32_t>(prgRom.size())
+            : static_cast<uint32_t>(GetBank(location) * BankSize);
+        const uint32_t distance = static_cast<uint32_t>(address - target);
+        if (target > address || distance > location - regionStart || !samples[location - distance].count) {
+            continue;
+        }
+        Loop loop{ location - distance, location + static_cast<uint32_t>(AddrModeDataTable[instr.mode].size), 0 };
+        for (uint32_t i = loop.start; i < loop.end; ++i) {
+            loop.cycles += samples[i].cycles;
+        }
+        loops.push_back(loop);
+    }
+    std::ranges::sort(loops, [](const Loop& a, const Loop& b) { return std::tie(b.cycles, a.start) < std::tie(a.cycles, b.start); });
+    out += "\nHottest loops\n";
+    out += "  percent       cycles      count  bank  code\n";
+    for (const Loop& loop : loops | std::views::take(ReportCount)) {
+        fmt::format_to(it, "; {} to {:04X}, {:.2f}% of cycles\n", GetLabel(loop.start), GetAddress(loop.end - 1), percent(loop.cycles));
+        for (uint32_t location = loop.start; location < loop.end;
+             location += static_cast<uint32_t>(AddrModeDataTable[InstrDataTable[GetCode(location)[0]].mode].size)) {
+            line(location);
+        }
+    }
+    return out;
+}
+
+void Profiler::SaveFoldedStacks(const char* path) const {
+    SaveText(path, FormatFoldedStacks());
+}
+
+void Profiler::SaveReport(const char* path) const {
+    SaveText(path, FormatReport());
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "pch.h"
+
+#include "Cartridge.h"
+#include "MMU.h"
+
+#include <array>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The CPU only calls into the profiler when built with NES2_PROFILER, without it the hooks
+// and their checks are compiled out
+#ifdef NES2_PROFILER
+constexpr bool ProfilerEnabled = true;
+#else
+constexpr bool ProfilerEnabled = false;
+#endif
+
+// Attributes emulated CPU cycles to the code that spent them.
+//
+// Code is keyed by where it lives: PRG ROM by offset, so the same address in different banks
+// counts separately, anything else by address. Cycles are counted per instruction in a flat
+// array, and per call path in a call tree grown from a shadow stack of JSR, BRK and interrupts.
+// Returns unwind the shadow stack by the stack pointer rather than by frame, so code that
+// drops return addresses or jumps through RTS tables doesn't desync it.
+class Profiler {
+public:
+    Profiler(Cartridge& cartridge, MMU& mmu);
+
+    // The instruction at address took the cycles, DMA it caused included
+    void Instruction(Addr address, uint64_t cycles);
+    // Entered a subroutine or handler at address, stack pointer after pushing the return.
+    // Cycles spent getting there count towards the callee.
+    void Call(Addr address, uint8_t stackPointer, uint64_t cycles = 0);
+    // Returned from a subroutine or handler, stack pointer after pulling
+    void Return(uint8_t stackPointer);
+
+    // Brendan Gregg's folded stacks, one "RESET;caller;callee cycles" line per call path,
+    // input for flamegraph.pl
+    // https://github.com/brendangregg/FlameGraph#2-fold-stacks
+    void SaveFoldedStacks(const char* path) const;
+    // Hottest routines, instructions and loops, code listed as dump lists it
+    void SaveReport(const char* path) const;
+
+private:
+    static constexpr size_t BankSize = 16384;
+    static constexpr uint32_t NoParent = UINT32_MAX;
+    static constexpr size_t ReportCount = 20;
+
+    struct Sample {
+        uint64_t cycles;
+        uint64_t count;
+    };
+
+    // A call path, cycles spent in the function itself
+    struct Node {
+        uint32_t parent;
+        uint32_t location;
+        uint64_t cycles;
+    };
+
+    struct Frame {
+        uint32_t node;
+        uint8_t stackPointer;
+    };
+
+    // PRG ROM offset, or past the end of PRG ROM by address
+    uint32_t GetLocation(Addr address) const;
+    bool IsPrgRom(uint32_t location) const { return location < prgRom.size(); }
+    // Bank and address the location is listed at by dump
+    size_t GetBank(uint32_t location) const;
+    Addr GetAddress(uint32_t location) const;
+    // RESET, NMI and IRQ for the vector targets, like dump, L_XXXX otherwise. Switchable bank
+    // labels are prefixed by their bank as the address alone is ambiguous.
+    std::string GetLabel(uint32_t location) const;
+    // The instruction at location, listed as dump lists it
+    std::string FormatInstruction(uint32_t location) const;
+    std::array<uint8_t, 3> GetCode(uint32_t location) const;
+    bool IsBanked() const { return prgRom.size() > 2 * BankSize; }
+
+    // Drops the frames whose return address has been pulled
+    void Unwind(unsigned stackTop);
+    void EnsureRoot(Addr address);
+
+    std::string FormatFoldedStacks() const;
+    std::string FormatReport() const;
+
+    Cartridge& cartridge;
+    MMU& mmu;
+    std::span<const uint8_t> prgRom;
+    // Indexed by location
+    std::vector<Sample> samples;
+    uint64_t totalCycles = 0;
+
+    std::vector<Node> nodes;
+    // Node of every call path by parent node and callee location
+    std::unordered_map<uint64_t, uint32_t> children;
+    std::vector<Frame> stack;
+    std::vector<std::pair<uint32_t, std::string_view>> vectorTargets;
+};
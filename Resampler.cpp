@@ -0,0 +1,153 @@
+#include "Resampler.h"
+
+#include "SIMD.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace {
+
+// Output scale for a mixer level of 1.0
+constexpr float SampleScale = 32767.0f;
+
+// Windowed sinc impulses, one per sub-sample phase, each summing to 1 so that integrating
+// them gives a unit step
+struct StepKernel {
+    alignas(16) float taps[Resampler::Phases][Resampler::KernelWidth];
+
+    StepKernel() {
+        // Cut off a little below Nyquist, the Blackman window keeps the stop band clean
+        constexpr double Cutoff = 0.45;
+        constexpr double HalfWidth = Resampler::KernelWidth / 2.0;
+        constexpr double Pi = std::numbers::pi;
+
+        for (size_t phase = 0; phase < Resampler::Phases; ++phase) {
+            double offset = static_cast<double>(phase) / Resampler::Phases;
+            double values[Resampler::KernelWidth];
+            double sum = 0.0;
+            for (size_t tap = 0; tap < Resampler::KernelWidth; ++tap) {
+                double t = tap - offset - (HalfWidth - 0.5);
+                double x = 2.0 * Cutoff * t;
+                double sinc = x == 0.0 ? 1.0 : std::sin(Pi * x) / (Pi * x);
+                double window = 0.42 + 0.5 * std::cos(Pi * t / HalfWidth) + 0.08 * std::cos(2.0 * Pi * t / HalfWidth);
+                values[tap] = sinc * std::max(window, 0.0);
+                sum += values[tap];
+            }
+            for (size_t tap = 0; tap < Resampler::KernelWidth; ++tap) {
+                taps[phase][tap] = static_cast<float>(values[tap] / sum);
+            }
+        }
+    }
+};
+
+const StepKernel& GetStepKernel() {
+    static const StepKernel kernel;
+    return kernel;
+}
+
+} // namespace
+
+Resampler::Resampler(double sampleRate, double clockRate) : clockRate(clockRate) {
+    SetSampleRate(sampleRate);
+    Reset(0);
+}
+
+void Resampler::SetSampleRate(double rate) {
+    VERIFY(rate > 0, "Sample rate must be positive");
+    sampleRate = rate;
+    clocksPerSample = clockRate / (sampleRate * rateAdjust);
+
+    constexpr double HighPassHz = 90.0;
+    leak = static_cast<float>(std::exp(-2.0 * std::numbers::pi * HighPassHz / sampleRate));
+}
+
+void Resampler::SetRateAdjust(double factor) {
+    VERIFY(factor > 0.9 && factor < 1.1, "Rate adjust out of range", factor);
+    rateAdjust = factor;
+    clocksPerSample = clockRate / (sampleRate * rateAdjust);
+}
+
+void Resampler::Reset(uint64_t time) {
+    frameStart = static_cast<double>(time);
+    std::ranges::fill(deltas, 0.0f);
+    integrator = 0.0f;
+    samples.clear();
+}
+
+void Resampler::AddDelta(uint64_t time, float delta) {
+    const double position = (static_cast<double>(time) - frameStart) / clocksPerSample;
+    const size_t index = static_cast<size_t>(position);
+    const size_t phase = std::min(static_cast<size_t>((position - index) * Phases), Phases - 1);
+
+    if (index + KernelWidth > deltas.size()) {
+        deltas.resize(index + KernelWidth + 1024);
+    }
+
+    const float* taps = GetStepKernel().taps[phase];
+    float* out = &deltas[index];
+#ifdef NES2_X86
+    const __m128 scale = _mm_set1_ps(delta * SampleScale);
+    for (size_t i = 0; i < KernelWidth; i += 4) {
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_load_ps(taps + i), scale));
+        _mm_storeu_ps(out + i, sum);
+    }
+#else
+    for (size_t i = 0; i < KernelWidth; ++i) {
+        out[i] += taps[i] * delta * SampleScale;
+    }
+#endif
+}
+
+void Resampler::EndFrame(uint64_t time) {
+    const double end = (static_cast<double>(time) - frameStart) / clocksPerSample;
+    const size_t count = static_cast<size_t>(std::max(end, 0.0));
+    if (!count) {
+        return;
+    }
+    if (count + KernelWidth > deltas.size()) {
+        deltas.resize(count + KernelWidth);
+    }
+
+    const size_t offset = samples.size();
+    samples.resize(offset + count);
+    Integrate(deltas.data(), samples.data() + offset, count);
+
+    // Kernel tails reaching past the completed samples move to the front
+    std::copy(deltas.begin() + count, deltas.end(), deltas.begin());
+    std::fill(deltas.end() - count, deltas.end(), 0.0f);
+    frameStart += count * clocksPerSample;
+}
+
+void Resampler::TakeSamples(std::vector<int16_t>& out) {
+    out.swap(samples);
+    samples.clear();
+}
+
+void Resampler::Integrate(const float* in, int16_t* out, size_t count) {
+    size_t i = 0;
+#ifdef NES2_X86
+    // Leaky prefix sum of four deltas at a time: y[j] = x[j] + leak * y[j - 1]
+    const float leak2 = leak * leak;
+    const __m128 leak1v = _mm_set1_ps(leak);
+    const __m128 leak2v = _mm_set1_ps(leak2);
+    const __m128 carryScale = _mm_setr_ps(leak, leak2, leak2 * leak, leak2 * leak2);
+    __m128 carry = _mm_set1_ps(integrator);
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(in + i);
+        x = _mm_add_ps(x, _mm_mul_ps(leak1v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4))));
+        x = _mm_add_ps(x, _mm_mul_ps(leak2v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8))));
+        x = _mm_add_ps(x, _mm_mul_ps(carry, carryScale));
+        carry = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+
+        // Round and saturate to 16 bits
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(x), _mm_setzero_si128());
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+    integrator = _mm_cvtss_f32(carry);
+#endif
+    for (; i < count; ++i) {
+        integrator = in[i] + leak * integrator;
+        out[i] = static_cast<int16_t>(std::clamp(std::lrint(integrator), -32768L, 32767L));
+    }
+}
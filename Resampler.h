@@ -0,0 +1,57 @@
+#pragma once
+
+#include "pch.h"
+
+// Turns the piecewise constant APU output, given as level changes at CPU clock times,
+// into 16-bit samples at the host rate.
+//
+// Each change adds a band-limited step (BLEP) into a buffer of per sample deltas: a
+// windowed sinc impulse at the change's sub-sample phase, scaled by the change. Integrating
+// the buffer gives the band-limited output directly at the host rate, so no CPU rate
+// samples are ever produced and the cost scales with the number of changes.
+// https://www.nesdev.org/wiki/APU_Mixer#Emulation
+class Resampler {
+public:
+    static constexpr double NTSCClockRate = 1789773.0;
+
+    Resampler(double sampleRate = 48000.0, double clockRate = NTSCClockRate);
+
+    void SetSampleRate(double sampleRate);
+    double GetSampleRate() const { return sampleRate; }
+    // Scales the output rate by a factor close to 1 to follow a playback clock, takes
+    // effect from the next EndFrame
+    void SetRateAdjust(double factor);
+    void Reset(uint64_t time);
+
+    // The output level changes by delta at the given clock time, times must not go before
+    // the last EndFrame
+    void AddDelta(uint64_t time, float delta);
+    // Completes all samples that end before the given clock time
+    void EndFrame(uint64_t time);
+
+    // Moves the completed samples to out, replacing its contents
+    void TakeSamples(std::vector<int16_t>& out);
+    size_t GetSampleCount() const { return samples.size(); }
+
+    // Sub-sample phases of the step kernel and its length in samples
+    static constexpr size_t Phases = 64;
+    static constexpr size_t KernelWidth = 16;
+
+private:
+    // Running sum over the deltas into samples, with a leak that acts as the 90Hz high pass
+    void Integrate(const float* deltas, int16_t* out, size_t count);
+
+    double clockRate;
+    double sampleRate;
+    double rateAdjust = 1.0;
+    double clocksPerSample;
+
+    double frameStart = 0.0; // Clock time of deltas[0]
+    // Sized for the longest frame plus the kernel tail, grown on demand
+    std::vector<float> deltas;
+
+    float leak = 0.0f;
+    float integrator = 0.0f;
+
+    std::vector<int16_t> samples;
+};
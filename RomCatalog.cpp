@@ -0,0 +1,155 @@
+#include "RomCatalog.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+struct ScannedFile {
+    std::string path;
+    uint64_t size;
+    int64_t modifiedTime;
+};
+
+constexpr size_t ReadChunkSize = 1 << 20;
+
+bool IsRomFile(const std::filesystem::directory_entry& file) {
+    std::string extension = file.path().extension().string();
+    std::ranges::transform(extension, extension.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+    return extension == ".nes" && file.is_regular_file();
+}
+
+// Reads the header and streams PRG and CHR through the hashes, false if it isn't a valid iNES file
+bool HashRom(const std::string& path, RomCatalogEntry& entry, std::vector<uint8_t>& buffer) {
+    std::ifstream file(path, std::ios::binary);
+    file.read(reinterpret_cast<char*>(&entry.header), sizeof(entry.header));
+    if (!file || !entry.header.IsValid()) {
+        SPDLOG_WARN("Skipping {}, not an iNES file", path);
+        return false;
+    }
+    if (entry.header.hasTrainer()) {
+        file.seekg(512, std::ios::cur);
+    }
+
+    entry.prgCRC = entry.chrCRC = entry.romCRC = 0;
+    SHA1 sha1;
+    auto hash = [&](uint64_t size, uint32_t& crc) {
+        while (size) {
+            const size_t count = static_cast<size_t>(std::min<uint64_t>(size, buffer.size()));
+            file.read(reinterpret_cast<char*>(buffer.data()), count);
+            if (static_cast<size_t>(file.gcount()) != count) {
+                return false;
+            }
+            const std::span<const uint8_t> chunk(buffer.data(), count);
+            crc = CRC32(chunk, crc);
+            entry.romCRC = CRC32(chunk, entry.romCRC);
+            sha1.Update(chunk);
+            size -= count;
+        }
+        return true;
+    };
+    if (!hash(entry.header.GetPrgRomSize(), entry.prgCRC) || !hash(entry.header.GetChrRomSize(), entry.chrCRC)) {
+        SPDLOG_WARN("Skipping {}, shorter than its header says", path);
+        return false;
+    }
+    entry.romSHA1 = sha1.Final();
+    return true;
+}
+
+} // namespace
+
+RomCatalog RomCatalog::Scan(const std::filesystem::path& directory, size_t threads, const RomIndex* previous) {
+    std::vector<ScannedFile> files;
+    for (const auto& file : std::filesystem::recursive_directory_iterator(directory, std::filesystem::directory_options::skip_permission_denied)) {
+        if (IsRomFile(file)) {
+            files.push_back({ file.path().generic_string(), file.file_size(), file.last_write_time().time_since_epoch().count() });
+        }
+    }
+    std::ranges::sort(files, {}, &ScannedFile::path);
+
+    std::vector<RomCatalogEntry> scanned(files.size());
+    std::vector<uint8_t> valid(files.size());
+    std::atomic<size_t> hashed{ 0 };
+    ParallelFor(files.size(), threads, [&](size_t i) {
+        const ScannedFile& file = files[i];
+        const RomCatalogEntry* cached = previous ? previous->Find(file.path) : nullptr;
+        if (cached && cached->fileSize == file.size && cached->modifiedTime == file.modifiedTime) {
+            scanned[i] = *cached;
+            valid[i] = true;
+            return;
+        }
+
+        thread_local std::vector<uint8_t> buffer(ReadChunkSize);
+        valid[i] = HashRom(file.path, scanned[i], buffer);
+        scanned[i].fileSize = file.size;
+        scanned[i].modifiedTime = file.modifiedTime;
+        hashed++;
+    });
+
+    RomCatalog catalog;
+    catalog.hashed = hashed;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!valid[i]) {
+            continue;
+        }
+        VERIFY(catalog.paths.size() + files[i].path.size() <= UINT32_MAX, "ROM catalog paths over 4GB");
+        RomCatalogEntry& entry = catalog.entries.emplace_back(scanned[i]);
+        entry.pathOffset = static_cast<uint32_t>(catalog.paths.size());
+        entry.pathLength = static_cast<uint32_t>(files[i].path.size());
+        catalog.paths += files[i].path;
+    }
+    return catalog;
+}
+
+void RomCatalog::Save(const char* path) const {
+    // Written next to the destination and moved over it, an index mapped by a reader stays intact
+    const std::string temporary = std::string(path) + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error(fmt::format("Failed to create ROM index {}", temporary));
+        }
+
+        RomIndex::FileHeader header;
+        std::memcpy(header.magic, RomIndex::Magic, sizeof(header.magic));
+        header.version = RomIndex::Version;
+        header.count = entries.size();
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(RomCatalogEntry));
+        file.write(paths.data(), paths.size());
+        if (!file) {
+            throw std::runtime_error(fmt::format("Failed to write ROM index {}", temporary));
+        }
+    }
+    std::filesystem::rename(temporary, path);
+}
+
+RomIndex::RomIndex(const char* path) : file(path) {
+    const uint8_t* data = file.GetData();
+    const size_t size = file.GetSize();
+
+    FileHeader header;
+    VERIFY(size >= sizeof(header), "ROM index is truncated", path);
+    std::memcpy(&header, data, sizeof(header));
+    VERIFY(std::equal(std::begin(header.magic), std::end(header.magic), std::begin(Magic)), "Not a ROM index", path);
+    VERIFY(header.version == Version, "Unsupported ROM index version", header.version);
+    VERIFY(header.count <= (size - sizeof(header)) / sizeof(RomCatalogEntry), "ROM index is truncated", path);
+
+    // The header keeps the entries 8 byte aligned within the page aligned mapping
+    entries = { reinterpret_cast<const RomCatalogEntry*>(data + sizeof(header)), header.count };
+    const size_t pathsOffset = sizeof(header) + entries.size_bytes();
+    paths = { reinterpret_cast<const char*>(data + pathsOffset), size - pathsOffset };
+    for (const RomCatalogEntry& entry : entries) {
+        VERIFY(uint64_t{ entry.pathOffset } + entry.pathLength <= paths.size(), "ROM index path out of range", path);
+    }
+}
+
+const RomCatalogEntry* RomIndex::Find(std::string_view path) const {
+    auto it = std::ranges::lower_bound(entries, path, {}, [&](const RomCatalogEntry& entry) { return GetPath(entry); });
+    return it != entries.end() && GetPath(*it) == path ? &*it : nullptr;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "pch.h"
+
+#include "Checksum.h"
+#include "MappedFile.h"
+#include "iNES.h"
+
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+
+// One ROM of a catalog. Fixed size and trivially copyable so an index file is used in place.
+struct RomCatalogEntry {
+    uint32_t pathOffset; // Into the catalog's path strings
+    uint32_t pathLength;
+    uint64_t fileSize;
+    int64_t modifiedTime; // Entries are only rehashed when size or modification time change
+    // The raw header, decoded on demand by its accessors
+    iNES::Header header;
+    // Of the ROM contents, trainer and header excluded. Whole ROM is PRG followed by CHR,
+    // as ROM databases list it.
+    uint32_t prgCRC;
+    uint32_t chrCRC;
+    uint32_t romCRC;
+    SHA1::Digest romSHA1;
+};
+static_assert(sizeof(RomCatalogEntry) == 72);
+static_assert(std::is_trivially_copyable_v<RomCatalogEntry>);
+
+class RomIndex;
+
+// Header and hashes of every .nes file in a directory tree
+class RomCatalog {
+public:
+    // Scans the directory on up to the given number of threads, reading only headers and the
+    // data to hash. Entries in the previous index with the same path, size and modification
+    // time are taken over without opening the file. Files that aren't valid iNES are skipped.
+    static RomCatalog Scan(const std::filesystem::path& directory, size_t threads, const RomIndex* previous = nullptr);
+
+    // Writes the index file, see RomIndex
+    void Save(const char* path) const;
+
+    std::span<const RomCatalogEntry> GetEntries() const { return entries; }
+    std::string_view GetPath(const RomCatalogEntry& entry) const { return { paths.data() + entry.pathOffset, entry.pathLength }; }
+
+    // Files the scan had to read rather than take over from the previous index
+    size_t GetHashedCount() const { return hashed; }
+
+private:
+    // Entries sorted by path
+    std::vector<RomCatalogEntry> entries;
+    std::string paths;
+    size_t hashed = 0;
+};
+
+// A saved catalog mapped into memory, lookups read the file in place.
+//
+// File layout, little endian: the FileHeader, entries sorted by path, then the path strings.
+class RomIndex {
+public:
+    explicit RomIndex(const char* path);
+
+    std::span<const RomCatalogEntry> GetEntries() const { return entries; }
+    std::string_view GetPath(const RomCatalogEntry& entry) const { return paths.substr(entry.pathOffset, entry.pathLength); }
+    // Binary search by path as it was scanned, nullptr if not in the index
+    const RomCatalogEntry* Find(std::string_view path) const;
+
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t count;
+    };
+    static constexpr char Magic[4] = { 'N', 'E', 'S', 'I' };
+    static constexpr uint32_t Version = 1;
+
+private:
+    MappedFile file;
+    std::span<const RomCatalogEntry> entries;
+    std::string_view paths;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+// Host SIMD support. Kernels are compiled for their instruction set with NES2_TARGET and
+// selected at runtime, so the rest of the build stays at the baseline ISA.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define NES2_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define NES2_TARGET(isa) __attribute__((target(isa)))
+#else
+#define NES2_TARGET(isa)
+#endif
+
+namespace SIMD {
+
+inline bool HasAVX2() {
+#if defined(NES2_X86) && (defined(__GNUC__) || defined(__clang__))
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    return hasAVX2;
+#elif defined(NES2_X86) && defined(_MSC_VER)
+    static const bool hasAVX2 = [] {
+        int info[4];
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }();
+    return hasAVX2;
+#else
+    return false;
+#endif
+}
+
+} // namespace SIMD
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "pch.h"
+
+#include <algorithm>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+
+// Runs the PPU and APU as coroutines against the CPU clock, the coroutine execution engine.
+//
+// The CPU is the master clock and runs ahead without ticking anything. A component only runs
+// when the CPU is about to touch it on the bus, or when the CPU reaches a deadline the component
+// set for something it must do on time by itself, like raising NMI. It then catches up to the
+// CPU clock in one go, picks its next deadline and suspends until the next sync.
+class Scheduler {
+public:
+    static constexpr uint64_t Never = UINT64_MAX;
+
+    // A component's coroutine, suspended whenever it has caught up with the master clock
+    class Task {
+    public:
+        struct promise_type {
+            uint64_t deadline = 0;
+
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            // Components start running on the first sync
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() { deadline = Never; }
+            void unhandled_exception() { std::rethrow_exception(std::current_exception()); }
+        };
+
+        Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+        Task& operator=(Task&& other) noexcept {
+            std::swap(handle, other.handle);
+            return *this;
+        }
+        ~Task() {
+            if (handle) {
+                handle.destroy();
+            }
+        }
+
+        void Resume() {
+            if (!handle.done()) {
+                handle.resume();
+            }
+        }
+        uint64_t GetDeadline() const { return handle.promise().deadline; }
+
+    private:
+        explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    // co_await in a component once it has caught up, it runs again by the given master cycle at the latest
+    struct Yield {
+        uint64_t deadline;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<Task::promise_type> handle) const noexcept {
+            handle.promise().deadline = deadline;
+        }
+        void await_resume() const noexcept {}
+    };
+
+    // Replace the components and restart the master clock at 0
+    void Start(std::vector<Task> components) {
+        tasks = std::move(components);
+        now = 0;
+        Sync();
+    }
+
+    uint64_t Now() const { return now; }
+
+    // Called by the CPU as its clock advances, runs the components once a deadline is reached
+    void Advance(uint64_t cycles) {
+        now += cycles;
+        if (now >= deadline) {
+            Sync();
+        }
+    }
+
+    // Bring every component up to the master clock, before any bus access to one of them
+    void Sync() {
+        VERIFY(!syncing, "Scheduler sync from within a component");
+        syncing = true;
+        deadline = Never;
+        for (Task& task : tasks) {
+            task.Resume();
+            deadline = std::min(deadline, task.GetDeadline());
+        }
+        syncing = false;
+    }
+
+private:
+    std::vector<Task> tasks;
+    uint64_t now = 0;
+    uint64_t deadline = Never;
+    bool syncing = false;
+};
@@ -1,25 +1,56 @@
 #include "SimpleMapper.h"
 
+#include <algorithm>
+
 void SimpleMapper::Write(uint16_t address, uint8_t value) {
+    if (address >= 0x6000 && address < 0x8000 && !prgRam.empty()) {
+        prgRam[(address - 0x6000) % prgRam.size()] = value;
+        return;
+    }
     throw std::runtime_error("SimpleMapper::Write: Unhandled address");
 }
 
 uint8_t SimpleMapper::Read(uint16_t address) {
     if (address >= 0x8000) {
-        return prgRom->at((address - 0x8000) % 0x4000);
+        return (*prgRom)[GetPrgRomOffset(address)];
+    } else if (address >= 0x6000 && !prgRam.empty()) {
+        return prgRam[(address - 0x6000) % prgRam.size()];
     } else {
         SPDLOG_WARN("SimpleMapper::Read: Unhandled address");
     }
     return 0;
 }
 
-uint8_t SimpleMapper::ReadChr(uint16_t address)
-{
-    return 0;
+size_t SimpleMapper::GetPrgRomOffset(uint16_t address) {
+    // 16KB PRG ROM is mirrored at $C000
+    return address >= 0x8000 ? (address - 0x8000) % prgRom->size() : NotPrgRom;
+}
+
+uint8_t SimpleMapper::ReadChr(uint16_t address) {
+    if (!chrRam.empty()) {
+        return chrRam[address % chrRam.size()];
+    }
+    return (*chrRom)[address % chrRom->size()];
 }
 
 void SimpleMapper::WriteChr(uint16_t address, uint8_t value) {
-    
+    if (!chrRam.empty()) {
+        chrRam[address % chrRam.size()] = value;
+    }
+}
+
+Mapper::ChrBanks SimpleMapper::GetChrBanks() {
+    const bool writable = !chrRam.empty();
+    const RomBank& chr = writable ? chrRam : *chrRom;
+    ChrBanks chrBanks{ {}, writable };
+    for (size_t i = 0; i < 8; ++i) {
+        chrBanks.banks[i] = chr.data() + (i * 0x400) % chr.size();
+    }
+    return chrBanks;
+}
+
+std::span<const uint8_t> SimpleMapper::GetChrMemory() {
+    return chrRam.empty() ? std::span<const uint8_t>(*chrRom) : std::span<const uint8_t>(chrRam);
 }
 
 void SimpleMapper::PowerOn() {
@@ -32,4 +63,11 @@ void SimpleMapper::Reset() {
 
 void SimpleMapper::LoadFromINES(const iNES &ines) {
     prgRom = &ines.GetPrgRom();
+    chrRom = &ines.GetChrRom();
+    if (chrRom->empty()) {
+        chrRam.resize(0x2000);
+    }
+    // Family Basic boards have PRG RAM at $6000, test ROMs report their results there
+    const size_t prgRamSize = ines.GetHeader().GetPrgRamSize() + ines.GetHeader().GetPrgNvramSize();
+    prgRam.resize(std::min<size_t>(prgRamSize, 0x2000));
 }
\ No newline at end of file
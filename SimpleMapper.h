@@ -9,9 +9,12 @@ class SimpleMapper : public Mapper {
 public:
     void Write(uint16_t address, uint8_t value);
     uint8_t Read(uint16_t address);
+    size_t GetPrgRomOffset(uint16_t address);
 
     uint8_t ReadChr(uint16_t address);
     void WriteChr(uint16_t address, uint8_t value);
+    ChrBanks GetChrBanks();
+    std::span<const uint8_t> GetChrMemory();
 
     void PowerOn();
     void Reset();
@@ -19,4 +22,9 @@ public:
     void LoadFromINES(const iNES& ines);
 private:
     const RomBank* prgRom;
+    const RomBank* chrRom;
+    // Boards without CHR ROM have 8KB of CHR RAM instead
+    std::vector<uint8_t> chrRam;
+    // Up to 8KB of PRG RAM at $6000-$7FFF, mirrored when smaller
+    std::vector<uint8_t> prgRam;
 };
\ No newline at end of file
@@ -3,8 +3,11 @@
 #include "System.h"
 
 System::System() :
-    cpu(mmu),
-    mmu(cartridge) {
+    cpu(std::in_place_index<CPUCore_Fast>, mmu, ppu, apu, interrupts),
+    mmu(cartridge, ppu, apu, controllers),
+    ppu(cartridge, interrupts),
+    apu(cartridge, interrupts) {
+    std::visit([&](auto& cpu) { cpu.SetDebugger(&debugger); }, cpu);
     SPDLOG_INFO("System created");
 }
 
@@ -23,7 +26,51 @@ void System::LoadCartridge(const char *path) {
 void System::Run() {
     SPDLOG_INFO("System running");
     running = true;
-    cpu.Run();
+    std::visit([](auto& cpu) { cpu.Run(); }, cpu);
+    // Components lag behind the CPU in between syncs
+    if (engine == ExecutionEngine_Coroutine) {
+        scheduler.Sync();
+    }
+    // Deliver the last frame if it is still being rendered
+    ppu.FlushFrame();
+    running = false;
+}
+
+void System::Stop() {
+    std::visit([](auto& cpu) { cpu.Pause(); }, cpu);
+}
+
+void System::SetCPUCore(CPUCore core) {
+    VERIFY(!running, "Cannot change the CPU core while system is running");
+
+    if (core == CPUCore_Cycle) {
+        cpu.emplace<CPUCore_Cycle>(mmu, ppu, apu, interrupts);
+    } else {
+        cpu.emplace<CPUCore_Fast>(mmu, ppu, apu, interrupts);
+    }
+    std::visit([&](auto& cpu) { cpu.SetDebugger(&debugger); }, cpu);
+    SPDLOG_INFO("System using the {} CPU core", core == CPUCore_Cycle ? "cycle stepped" : "instruction stepped");
+}
+
+void System::SetExecutionEngine(ExecutionEngine engine) {
+    VERIFY(!running, "Cannot change the execution engine while system is running");
+
+    this->engine = engine;
+    SPDLOG_INFO("System using the {} execution engine", engine == ExecutionEngine_Coroutine ? "coroutine" : "lockstep");
+}
+
+void System::SetProfilerEnabled(bool enabled) {
+    VERIFY(!running, "Cannot change profiling while system is running");
+    VERIFY(!enabled || ProfilerEnabled, "Built without the profiler, configure with -DNES2_PROFILER=ON");
+
+    profilerEnabled = enabled;
+}
+
+void System::SetCoverageEnabled(bool enabled) {
+    VERIFY(!running, "Cannot change coverage while system is running");
+    VERIFY(!enabled || CoverageEnabled, "Built without coverage, configure with -DNES2_COVERAGE=ON");
+
+    coverageEnabled = enabled;
 }
 
 void System::PowerOn() {
@@ -32,19 +79,51 @@ void System::PowerOn() {
 
     SPDLOG_INFO("System setting power on state");
 
+    interrupts.Reset();
     cartridge.PowerOn();
+    ppu.PowerOn();
+    apu.PowerOn();
     mmu.PowerOn();
-    
+    controllers.PowerOn();
+
+    // The master clock starts with the CPU's, the CPU's power on sequence already goes through it
+    Scheduler* master = nullptr;
+    if (engine == ExecutionEngine_Coroutine) {
+        std::vector<Scheduler::Task> components;
+        components.push_back(ppu.Process(scheduler));
+        components.push_back(apu.Process(scheduler));
+        scheduler.Start(std::move(components));
+        master = &scheduler;
+    }
+    mmu.SetScheduler(master);
+    std::visit([&](auto& cpu) { cpu.SetScheduler(master); }, cpu);
+
+    // A fresh profile for every power on, taking the cartridge's current PRG ROM
+    profiler = profilerEnabled ? std::make_unique<Profiler>(cartridge, mmu) : nullptr;
+    std::visit([&](auto& cpu) { cpu.SetProfiler(profiler.get()); }, cpu);
+    // Same for the coverage, the PPU lets go of the old one before it is destroyed
+    std::unique_ptr<Coverage> previousCoverage = std::move(coverage);
+    coverage = coverageEnabled ? std::make_unique<Coverage>(cartridge) : nullptr;
+    std::visit([&](auto& cpu) { cpu.SetCoverage(coverage.get()); }, cpu);
+    ppu.SetCoverage(coverage.get());
+
     // Power on CPU last since it will implicitly read from the MMU
-    cpu.PowerOn();
+    std::visit([](auto& cpu) { cpu.PowerOn(); }, cpu);
 
     SPDLOG_INFO("System powered on");
 }
 
 void System::Reset() {
+    // Like bus writes, the components catch up before their registers change and their
+    // deadlines are taken again after
+    mmu.Sync();
+    interrupts.Reset();
     cartridge.Reset();
+    ppu.Reset();
+    apu.Reset();
     mmu.Reset();
+    mmu.Sync();
 
     // Reset CPU last since it will implicitly read from the MMU
-    cpu.Reset();
+    std::visit([](auto& cpu) { cpu.Reset(); }, cpu);
 }
@@ -2,9 +2,26 @@
 
 #include "pch.h"
 
+#include "APU.h"
 #include "CPU.h"
+#include "Debugger.h"
+#include "Interrupts.h"
 #include "MMU.h"
+#include "PPU.h"
+#include "Profiler.h"
 #include "Cartridge.h"
+#include "Controllers.h"
+#include "Scheduler.h"
+
+#include <memory>
+#include <variant>
+
+// Lockstep ticks the PPU and APU after every CPU step. Coroutine runs them as coroutines that
+// catch up with the CPU only when it accesses them or reaches one of their deadlines, see Scheduler.
+enum ExecutionEngine : uint8_t {
+    ExecutionEngine_Lockstep,
+    ExecutionEngine_Coroutine
+};
 
 class System {
 public:
@@ -12,17 +29,79 @@ public:
     ~System();
 
     void LoadCartridge(const char* path);
+    // Runs until stopped, calling it again resumes
     void Run();
+    // Stop running after the current instruction, may be called from callbacks during Run
+    void Stop();
 
     void PowerOn();
     void Reset();
 
+    // Replaces the CPU, call before the other CPU settings
+    void SetCPUCore(CPUCore core);
+    // Takes effect on the next power on
+    void SetExecutionEngine(ExecutionEngine engine);
+    // Profile from the next power on, only in builds with NES2_PROFILER
+    void SetProfilerEnabled(bool enabled);
+    // nullptr unless enabled
+    const Profiler* GetProfiler() const { return profiler.get(); }
+    // Record coverage from the next power on, only in builds with NES2_COVERAGE
+    void SetCoverageEnabled(bool enabled);
+    // nullptr unless enabled
+    const Coverage* GetCoverage() const { return coverage.get(); }
+    // Breakpoints and watchpoints on the CPU, kept across CPU core changes and power cycles
+    Debugger& GetDebugger() { return debugger; }
+    // Input, held buttons and the movie are kept across power cycles
+    Controllers& GetControllers() { return controllers; }
+
+    // Completed frames for a consumer thread, see TripleBuffer
+    TripleBuffer<Frame>& GetFrameOutput() { return ppu.GetFrameOutput(); }
+    void SetFrameCallback(PPU::FrameCallback callback) { ppu.SetFrameCallback(std::move(callback)); }
+    void SetPresentInterval(uint32_t interval) { ppu.SetPresentInterval(interval); }
+    void SetRenderThreads(size_t threads) { ppu.SetRenderThreads(threads); }
+
+    void SetSampleCallback(APU::SampleCallback callback) { apu.SetSampleCallback(std::move(callback)); }
+    void SetSampleRate(double sampleRate) { apu.SetSampleRate(sampleRate); }
+    void SetRateAdjust(double factor) { apu.SetRateAdjust(factor); }
+
+    void SetNESTestLogEnabled(bool enabled) {
+        std::visit([&](auto& cpu) { cpu.SetNESTestLogEnabled(enabled); }, cpu);
+    }
+    // Trace every instruction to the writer, nullptr to stop
+    void SetTraceWriter(TraceWriter* writer) {
+        std::visit([&](auto& cpu) { cpu.SetTraceWriter(writer); }, cpu);
+    }
+    void SetEntryPoint(std::optional<Addr> address) {
+        std::visit([&](auto& cpu) { cpu.SetEntryPoint(address); }, cpu);
+    }
+    uint64_t GetCPUCycles() const {
+        return std::visit([](const auto& cpu) { return cpu.GetCycles(); }, cpu);
+    }
+    std::optional<Addr> GetCPUJamAddress() const {
+        return std::visit([](const auto& cpu) { return cpu.GetJamAddress(); }, cpu);
+    }
+    CPUSpin GetCPUSpin() const {
+        return std::visit([](const auto& cpu) { return cpu.GetSpin(); }, cpu);
+    }
+    // CPU memory without the side effects of reading I/O registers
+    uint8_t PeekMemory(Addr address) { return mmu.Peek(address); }
+
 private:
-    CPU cpu;
+    InterruptLines interrupts;
+    Debugger debugger;
+    // Indexed by CPUCore
+    std::variant<CPU<CPUCore_Fast>, CPU<CPUCore_Cycle>> cpu;
     MMU mmu;
-    //PPU ppu;
-    //APU apu;
+    PPU ppu;
+    APU apu;
+    Controllers controllers;
     Cartridge cartridge;
+    Scheduler scheduler;
+    ExecutionEngine engine = ExecutionEngine_Lockstep;
+    bool profilerEnabled = false;
+    std::unique_ptr<Profiler> profiler;
+    bool coverageEnabled = false;
+    std::unique_ptr<Coverage> coverage;
     //iNES ines;
 
     bool running = false;
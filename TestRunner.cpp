@@ -0,0 +1,268 @@
+#include "TestRunner.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+namespace {
+
+enum TestAddr : Addr {
+    TestAddr_Status    = 0x6000,
+    TestAddr_Signature = 0x6001,
+    TestAddr_Text      = 0x6004,
+    TestAddr_TextEnd   = 0x8000
+};
+constexpr uint8_t Signature[3] = { 0xDE, 0xB0, 0x61 };
+constexpr uint8_t StatusRunning = 0x80;
+constexpr uint8_t StatusReset = 0x81;
+
+// The ROM asks to be reset no sooner than 100ms later
+constexpr uint64_t ResetDelayFrames = 6;
+// NTSC, 341 dots by 262 lines at 3 dots per CPU cycle
+constexpr uint64_t CPUCyclesPerFrame = 29781;
+
+bool HasSignature(System& system) {
+    for (Addr i = 0; i < sizeof(Signature); ++i) {
+        if (system.PeekMemory(TestAddr_Signature + i) != Signature[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Up to the terminating zero, without the trailing line break
+std::string ReadText(System& system) {
+    std::string text;
+    for (Addr address = TestAddr_Text; address < TestAddr_TextEnd; ++address) {
+        const char c = static_cast<char>(system.PeekMemory(address));
+        if (!c) {
+            break;
+        }
+        text += c;
+    }
+    while (!text.empty() && (text.back() == '\n' || text.back() == ' ')) {
+        text.pop_back();
+    }
+    return text;
+}
+
+std::string EscapeJSON(std::string_view text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += fmt::format("\\u{:04x}", static_cast<int>(c));
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+std::string EscapeXML(std::string_view text) {
+    std::string out;
+    for (char c : text) {
+        switch (c) {
+        case '&': out += "&amp;"; break;
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '"': out += "&quot;"; break;
+        default:
+            // XML 1.0 has no escape for the other control characters
+            if (static_cast<unsigned char>(c) >= 0x20 || c == '\n' || c == '\t') {
+                out += c;
+            }
+        }
+    }
+    return out;
+}
+
+std::ofstream OpenReport(const char* path) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to open test report {}", path));
+    }
+    return file;
+}
+
+void CloseReport(std::ofstream& file, const char* path) {
+    file.close();
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to write test report {}", path));
+    }
+}
+
+} // namespace
+
+std::vector<std::string> TestRunner::FindRoms(const std::filesystem::path& directory) {
+    std::vector<std::string> paths;
+    for (const auto& file : std::filesystem::recursive_directory_iterator(directory, std::filesystem::directory_options::skip_permission_denied)) {
+        std::string extension = file.path().extension().string();
+        std::ranges::transform(extension, extension.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+        if (extension == ".nes" && file.is_regular_file()) {
+            paths.push_back(file.path().generic_string());
+        }
+    }
+    std::ranges::sort(paths);
+    return paths;
+}
+
+std::vector<TestResult> TestRunner::Run(const std::vector<std::string>& paths) const {
+    std::vector<TestResult> results(paths.size());
+    const size_t jobs = settings.jobs ? settings.jobs : std::max(1u, std::thread::hardware_concurrency());
+    ParallelFor(paths.size(), jobs, [&](size_t i) {
+        results[i] = RunOne(paths[i]);
+    });
+    return results;
+}
+
+TestResult TestRunner::RunOne(const std::string& path) const {
+    using Clock = std::chrono::steady_clock;
+    const auto startTime = Clock::now();
+
+    TestResult result;
+    result.path = path;
+    try {
+        System system;
+        system.SetCPUCore(settings.cpuCore);
+        system.SetExecutionEngine(settings.engine);
+        system.SetNESTestLogEnabled(false);
+        system.LoadCartridge(path.c_str());
+
+        // Finished the moment the result is written
+        bool done = false;
+        std::optional<uint64_t> resetFrame;
+        auto finish = [&](TestStatus status, std::string message) {
+            result.status = status;
+            result.message = std::move(message);
+            done = true;
+            system.Stop();
+        };
+
+        system.GetDebugger().Add(Debugger::Breakpoint::Parse(fmt::format("{:04X}", +TestAddr_Status), Access_Write));
+        system.GetDebugger().SetHitCallback([&](const Debugger::Hit& hit) {
+            if (done || !HasSignature(system)) {
+                return;
+            }
+            if (hit.value < StatusRunning) {
+                result.code = hit.value;
+                finish(hit.value ? TestStatus_Failed : TestStatus_Passed, ReadText(system));
+            } else if (hit.value == StatusReset && !resetFrame) {
+                resetFrame = result.frames + ResetDelayFrames;
+            }
+        });
+
+        system.SetFrameCallback([&](const Frame&) {
+            if (done) {
+                return;
+            }
+            ++result.frames;
+            // Whatever the ROM printed so far tells where it got stuck
+            auto describe = [&](std::string reason) {
+                const std::string text = HasSignature(system) ? ReadText(system) : std::string{};
+                return text.empty() ? reason : fmt::format("{}\n{}", reason, text);
+            };
+
+            if (auto jam = system.GetCPUJamAddress()) {
+                finish(TestStatus_Hung, describe(fmt::format("CPU jammed by KIL ${:02X} at ${:04X}", system.PeekMemory(*jam), *jam)));
+            } else if (const CPUSpin spin = system.GetCPUSpin(); spin.cycles >= settings.hangFrames * CPUCyclesPerFrame) {
+                finish(TestStatus_Hung, describe(fmt::format("CPU spinning at ${:04X} for {} cycles", spin.address, spin.cycles)));
+            } else if (result.frames >= settings.frameBudget) {
+                finish(TestStatus_TimedOut, describe(fmt::format("No result after {} frames", result.frames)));
+            } else if (resetFrame && result.frames >= *resetFrame) {
+                // Reset once back out of Run, not in the middle of an instruction
+                system.Stop();
+            }
+        });
+
+        system.PowerOn();
+        system.Run();
+        while (!done) {
+            VERIFY(resetFrame, "Test ROM stopped without a result");
+            resetFrame.reset();
+            system.Reset();
+            system.Run();
+        }
+    } catch (const std::exception& e) {
+        result.status = TestStatus_Error;
+        result.message = e.what();
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+    return result;
+}
+
+const char* TestRunner::GetStatusName(TestStatus status) {
+    switch (status) {
+    case TestStatus_Passed: return "passed";
+    case TestStatus_Failed: return "failed";
+    case TestStatus_Hung: return "hung";
+    case TestStatus_TimedOut: return "timed out";
+    case TestStatus_Error: return "error";
+    }
+    return "unknown";
+}
+
+void TestRunner::SaveJUnit(const std::vector<TestResult>& results, const char* path) {
+    std::ofstream file = OpenReport(path);
+    size_t failures = 0;
+    size_t errors = 0;
+    double seconds = 0;
+    for (const TestResult& result : results) {
+        failures += result.status == TestStatus_Failed || result.status == TestStatus_Hung || result.status == TestStatus_TimedOut;
+        errors += result.status == TestStatus_Error;
+        seconds += result.seconds;
+    }
+
+    file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    file << fmt::format("<testsuite name=\"nes2\" tests=\"{}\" failures=\"{}\" errors=\"{}\" time=\"{:.3f}\">\n",
+        results.size(), failures, errors, seconds);
+    for (const TestResult& result : results) {
+        file << fmt::format("  <testcase classname=\"{}\" name=\"{}\" time=\"{:.3f}\">",
+            EscapeXML(std::filesystem::path(result.path).parent_path().generic_string()),
+            EscapeXML(std::filesystem::path(result.path).filename().string()), result.seconds);
+        const std::string message = EscapeXML(result.message);
+        switch (result.status) {
+        case TestStatus_Passed:
+            if (!message.empty()) {
+                file << fmt::format("\n    <system-out>{}</system-out>\n  ", message);
+            }
+            break;
+        case TestStatus_Error:
+            file << fmt::format("\n    <error message=\"{}\"/>\n  ", message);
+            break;
+        default:
+            file << fmt::format("\n    <failure message=\"{} ({} frames)\" type=\"{}\">{}</failure>\n  ",
+                result.status == TestStatus_Failed ? fmt::format("Result code {}", result.code) : GetStatusName(result.status),
+                result.frames, GetStatusName(result.status), message);
+        }
+        file << "</testcase>\n";
+    }
+    file << "</testsuite>\n";
+    CloseReport(file, path);
+}
+
+void TestRunner::SaveJSON(const std::vector<TestResult>& results, const char* path) {
+    std::ofstream file = OpenReport(path);
+    size_t counts[TestStatus_Error + 1] = {};
+    for (const TestResult& result : results) {
+        counts[result.status]++;
+    }
+
+    file << fmt::format("{{\"total\":{},\"passed\":{},\"failed\":{},\"hung\":{},\"timedOut\":{},\"errors\":{},\"results\":[",
+        results.size(), counts[TestStatus_Passed], counts[TestStatus_Failed], counts[TestStatus_Hung],
+        counts[TestStatus_TimedOut], counts[TestStatus_Error]);
+    const char* separator = "\n";
+    for (const TestResult& result : results) {
+        file << fmt::format("{}{{\"path\":\"{}\",\"status\":\"{}\",\"code\":{},\"frames\":{},\"seconds\":{:.3f},\"message\":\"{}\"}}",
+            separator, EscapeJSON(result.path), GetStatusName(result.status), result.code, result.frames, result.seconds,
+            EscapeJSON(result.message));
+        separator = ",\n";
+    }
+    file << "\n]}\n";
+    CloseReport(file, path);
+}
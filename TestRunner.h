@@ -0,0 +1,58 @@
+#pragma once
+
+#include "pch.h"
+
+#include "System.h"
+
+#include <filesystem>
+#include <string>
+
+enum TestStatus : uint8_t {
+    TestStatus_Passed,
+    TestStatus_Failed,   // Reported a result code other than 0
+    TestStatus_Hung,     // Jammed or spinning with nothing left to break the loop
+    TestStatus_TimedOut, // No result within the frame budget
+    TestStatus_Error     // Didn't load or the emulator threw
+};
+
+struct TestResult {
+    std::string path;
+    TestStatus status = TestStatus_Error;
+    uint8_t code = 0;
+    // The ROM's text output, or what went wrong
+    std::string message;
+    uint64_t frames = 0;
+    double seconds = 0;
+};
+
+struct TestRunSettings {
+    CPUCore cpuCore = CPUCore_Fast;
+    ExecutionEngine engine = ExecutionEngine_Lockstep;
+    uint64_t frameBudget = 3600;
+    // Frames of a spin no interrupt broke before it counts as a hang
+    uint64_t hangFrames = 10;
+    // 0 for one per hardware thread
+    size_t jobs = 0;
+};
+
+// Runs test ROMs headless, each on its own System, and takes their result from the protocol of
+// blargg's test ROMs: $6000 holds $80 while running, $81 to ask for a reset and the result code
+// below $80 once done, with $DE $B0 $61 at $6001 marking it valid and text from $6004 on.
+class TestRunner {
+public:
+    explicit TestRunner(const TestRunSettings& settings) : settings(settings) {}
+
+    // Every .nes file in the directory tree, sorted
+    static std::vector<std::string> FindRoms(const std::filesystem::path& directory);
+
+    // Runs the ROMs on the worker threads, results are in the order of the paths
+    std::vector<TestResult> Run(const std::vector<std::string>& paths) const;
+    TestResult RunOne(const std::string& path) const;
+
+    static const char* GetStatusName(TestStatus status);
+    static void SaveJUnit(const std::vector<TestResult>& results, const char* path);
+    static void SaveJSON(const std::vector<TestResult>& results, const char* path);
+
+private:
+    TestRunSettings settings;
+};
@@ -0,0 +1,148 @@
+#include "Timeline.h"
+
+#include <array>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Nanoseconds of the first Start, the trace's zero
+std::atomic<uint64_t> epoch{ 0 };
+
+} // namespace
+
+struct Timeline::Chunk {
+    static constexpr size_t Capacity = 4096;
+
+    std::array<Event, Capacity> events;
+    // Events written so far, released after each one
+    std::atomic<size_t> count{ 0 };
+    std::atomic<Chunk*> next{ nullptr };
+};
+
+struct Timeline::Buffer {
+    uint32_t threadId;
+    // Guarded by the registry's mutex
+    std::string threadName;
+    Chunk head;
+    // Only touched by the owning thread
+    Chunk* tail = &head;
+
+    explicit Buffer(uint32_t threadId) : threadId(threadId) {}
+    ~Buffer() {
+        Chunk* chunk = head.next.load(std::memory_order_relaxed);
+        while (chunk) {
+            Chunk* next = chunk->next.load(std::memory_order_relaxed);
+            delete chunk;
+            chunk = next;
+        }
+    }
+};
+
+// Buffers are never freed, a thread's events stay in the trace after it exits
+struct Timeline::Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+
+    static Registry& Get() {
+        static Registry registry;
+        return registry;
+    }
+};
+
+void Timeline::Start() {
+    uint64_t zero = 0;
+    epoch.compare_exchange_strong(zero, Now(), std::memory_order_relaxed);
+    recording.store(true, std::memory_order_relaxed);
+}
+
+Timeline::Buffer& Timeline::GetBuffer() {
+    // A plain pointer, unlike an object with a destructor it needs no guard on every access
+    static thread_local Buffer* buffer = nullptr;
+    if (!buffer) [[unlikely]] {
+        buffer = &AcquireBuffer();
+    }
+    return *buffer;
+}
+
+Timeline::Buffer& Timeline::AcquireBuffer() {
+    Registry& registry = Registry::Get();
+    std::lock_guard lock(registry.mutex);
+    const uint32_t threadId = static_cast<uint32_t>(registry.buffers.size() + 1);
+    return *registry.buffers.emplace_back(std::make_unique<Buffer>(threadId));
+}
+
+void Timeline::SetThreadName(std::string_view name) {
+    if constexpr (TimelineEnabled) {
+        Buffer& buffer = GetBuffer();
+        std::lock_guard lock(Registry::Get().mutex);
+        buffer.threadName = name;
+    }
+}
+
+void Timeline::Record(const char* name, uint64_t begin, uint64_t end) {
+    Buffer& buffer = GetBuffer();
+    Chunk* chunk = buffer.tail;
+    size_t count = chunk->count.load(std::memory_order_relaxed);
+    if (count == Chunk::Capacity) [[unlikely]] {
+        Chunk* next = new Chunk;
+        chunk->next.store(next, std::memory_order_release);
+        buffer.tail = chunk = next;
+        count = 0;
+    }
+    chunk->events[count] = { name, begin, end };
+    chunk->count.store(count + 1, std::memory_order_release);
+}
+
+void Timeline::Save(const char* path) {
+    recording.store(false, std::memory_order_relaxed);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to open timeline {}", path));
+    }
+
+    // Trace timestamps are in microseconds, fractions keep the nanoseconds
+    const uint64_t zero = epoch.load(std::memory_order_relaxed);
+    auto microseconds = [](uint64_t nanoseconds) { return nanoseconds / 1000.0; };
+
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    auto it = std::back_inserter(out);
+    const char* separator = "";
+    size_t events = 0;
+
+    Registry& registry = Registry::Get();
+    std::lock_guard lock(registry.mutex);
+    for (const auto& buffer : registry.buffers) {
+        if (!buffer->threadName.empty()) {
+            fmt::format_to(it, "{}\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+                separator, buffer->threadId, buffer->threadName);
+            separator = ",";
+        }
+        for (const Chunk* chunk = &buffer->head; chunk; chunk = chunk->next.load(std::memory_order_acquire)) {
+            const size_t count = chunk->count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < count; ++i) {
+                const Event& event = chunk->events[i];
+                // Scopes begun before the first Start would have negative timestamps
+                if (event.begin < zero) {
+                    continue;
+                }
+                fmt::format_to(it, "{}\n{{\"name\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":1,\"tid\":{}}}",
+                    separator, event.name, microseconds(event.begin - zero), microseconds(event.end - event.begin), buffer->threadId);
+                separator = ",";
+                ++events;
+            }
+        }
+    }
+    out += "\n]}\n";
+
+    file << out;
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to write timeline {}", path));
+    }
+    SPDLOG_INFO("Saved {} timeline events of {} threads to {}", events, registry.buffers.size(), path);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "pch.h"
+
+#include <atomic>
+#include <chrono>
+#include <string_view>
+
+// The components only record scopes when built with NES2_TIMELINE, without it every
+// TimelineScope is compiled out
+#ifdef NES2_TIMELINE
+constexpr bool TimelineEnabled = true;
+#else
+constexpr bool TimelineEnabled = false;
+#endif
+
+// Wall clock timeline of what each thread spent its time on, saved in the Chrome trace event
+// format that Perfetto and chrome://tracing open.
+// https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+//
+// Each thread appends completed scopes to its own list of fixed size chunks. Only the owning
+// thread writes a chunk and publishes the event count with a release store, so recording takes
+// no lock and Save reads every thread's events while they keep running.
+class Timeline {
+public:
+    // Scopes are recorded from here on, timestamps count from the first call
+    static void Start();
+    static bool IsRecording() {
+        return TimelineEnabled && recording.load(std::memory_order_relaxed);
+    }
+    // Label of the calling thread in the viewer
+    static void SetThreadName(std::string_view name);
+    // Stops recording and writes every thread's events so far
+    static void Save(const char* path);
+
+    static uint64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // The name must outlive the timeline, scopes pass string literals
+    static void Record(const char* name, uint64_t begin, uint64_t end);
+
+private:
+    struct Event {
+        const char* name;
+        uint64_t begin;
+        uint64_t end;
+    };
+    struct Chunk;
+    struct Buffer;
+    struct Registry;
+
+    static Buffer& GetBuffer();
+    // Allocates the calling thread's buffer, kept after the thread exits
+    static Buffer& AcquireBuffer();
+
+    static inline std::atomic<bool> recording{ false };
+};
+
+// Records the time from construction to destruction on the calling thread's timeline
+class TimelineScope {
+public:
+    explicit TimelineScope(const char* name) {
+        if constexpr (TimelineEnabled) {
+            if (Timeline::IsRecording()) {
+                this->name = name;
+                begin = Timeline::Now();
+            }
+        }
+    }
+    ~TimelineScope() {
+        if constexpr (TimelineEnabled) {
+            if (name) {
+                Timeline::Record(name, begin, Timeline::Now());
+            }
+        }
+    }
+    TimelineScope(const TimelineScope&) = delete;
+    TimelineScope& operator=(const TimelineScope&) = delete;
+
+private:
+    const char* name = nullptr;
+    uint64_t begin = 0;
+};
@@ -0,0 +1,260 @@
+#include "Trace.h"
+
+#include "Disassembler.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+constexpr uint32_t DotsPerScanline = 341;
+constexpr uint32_t DotsPerFrame = DotsPerScanline * 262;
+
+void PutVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint16_t ZigZag(uint16_t value) {
+    return static_cast<uint16_t>((value << 1) ^ (static_cast<int16_t>(value) >> 15));
+}
+
+uint16_t UnZigZag(uint16_t value) {
+    return static_cast<uint16_t>((value >> 1) ^ -(value & 1));
+}
+
+uint32_t PackInstruction(const TraceRecord& record) {
+    return record.bytes[0] | record.bytes[1] << 8 | record.bytes[2] << 16 | static_cast<uint32_t>(record.size) << 24;
+}
+
+uint32_t GetPPUPosition(const TraceRecord& record) {
+    return record.scanline * DotsPerScanline + record.dot;
+}
+
+// Where the PPU is 3 dots per cycle on from the previous record
+uint32_t GetExpectedPPUPosition(const TraceRecord& previous, uint64_t cycles) {
+    return static_cast<uint32_t>((GetPPUPosition(previous) + cycles % DotsPerFrame * 3) % DotsPerFrame);
+}
+
+class BlockDecoder {
+public:
+    explicit BlockDecoder(std::span<const uint8_t> data) : data(data) {}
+
+    uint8_t Byte() {
+        if (position == data.size()) {
+            throw std::runtime_error("Trace block is corrupt");
+        }
+        return data[position++];
+    }
+    uint64_t Varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const uint8_t byte = Byte();
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Trace block is corrupt");
+    }
+    bool AtEnd() const { return position == data.size(); }
+
+private:
+    std::span<const uint8_t> data;
+    size_t position = 0;
+};
+
+} // namespace
+
+void EncodeTraceBlock(std::span<const TraceRecord> records, TraceInstructionTable& instructions, std::vector<uint8_t>& out) {
+    instructions.assign(0x10000, 0);
+    TraceRecord previous{};
+    for (const TraceRecord& record : records) {
+        const uint64_t cycles = record.cycle - previous.cycle;
+        const uint16_t pcDelta = static_cast<uint16_t>(record.pc - (previous.pc + previous.size));
+        const uint32_t instruction = PackInstruction(record);
+        const uint32_t ppuPosition = GetPPUPosition(record);
+
+        uint8_t mask = (record.a != previous.a ? TraceChange_A : 0) | (record.x != previous.x ? TraceChange_X : 0) |
+            (record.y != previous.y ? TraceChange_Y : 0) | (record.p != previous.p ? TraceChange_P : 0) |
+            (record.s != previous.s ? TraceChange_S : 0) | (pcDelta ? TraceChange_PC : 0) |
+            (instructions[record.pc] != instruction ? TraceChange_Bytes : 0);
+        const uint8_t mask2 = (ppuPosition != GetExpectedPPUPosition(previous, cycles) ? TraceChange2_PPU : 0) |
+            (record.frame != previous.frame ? TraceChange2_Frame : 0);
+        if (mask2) {
+            mask |= TraceChange_Mask2;
+        }
+
+        out.push_back(mask);
+        if (mask2) {
+            out.push_back(mask2);
+        }
+        PutVarint(out, cycles);
+        if (mask & TraceChange_PC) {
+            PutVarint(out, ZigZag(pcDelta));
+        }
+        if (mask & TraceChange_Bytes) {
+            out.push_back(record.size);
+            out.insert(out.end(), record.bytes, record.bytes + std::min<size_t>(record.size, 3));
+            instructions[record.pc] = instruction;
+        }
+        for (const auto& [change, value] : { std::pair{ TraceChange_A, record.a }, { TraceChange_X, record.x },
+                 { TraceChange_Y, record.y }, { TraceChange_P, record.p }, { TraceChange_S, record.s } }) {
+            if (mask & change) {
+                out.push_back(value);
+            }
+        }
+        if (mask2 & TraceChange2_PPU) {
+            PutVarint(out, ppuPosition);
+        }
+        if (mask2 & TraceChange2_Frame) {
+            PutVarint(out, record.frame - previous.frame);
+        }
+        previous = record;
+    }
+}
+
+void DecodeTraceBlock(std::span<const uint8_t> data, size_t count, TraceInstructionTable& instructions, std::vector<TraceRecord>& records) {
+    instructions.assign(0x10000, 0);
+    records.resize(count);
+    BlockDecoder decoder(data);
+    TraceRecord previous{};
+    for (TraceRecord& record : records) {
+        record = previous;
+        const uint8_t mask = decoder.Byte();
+        const uint8_t mask2 = mask & TraceChange_Mask2 ? decoder.Byte() : 0;
+        const uint64_t cycles = decoder.Varint();
+        record.cycle = previous.cycle + cycles;
+        record.pc = previous.pc + previous.size;
+        if (mask & TraceChange_PC) {
+            record.pc += UnZigZag(static_cast<uint16_t>(decoder.Varint()));
+        }
+
+        uint32_t instruction = instructions[record.pc];
+        if (mask & TraceChange_Bytes) {
+            instruction = static_cast<uint32_t>(decoder.Byte()) << 24;
+            for (uint32_t i = 0; i < std::min<uint32_t>(instruction >> 24, 3); ++i) {
+                instruction |= static_cast<uint32_t>(decoder.Byte()) << (i * 8);
+            }
+            instructions[record.pc] = instruction;
+        }
+        record.bytes[0] = static_cast<uint8_t>(instruction);
+        record.bytes[1] = static_cast<uint8_t>(instruction >> 8);
+        record.bytes[2] = static_cast<uint8_t>(instruction >> 16);
+        record.size = static_cast<uint8_t>(instruction >> 24);
+
+        for (const auto& [change, value] : { std::pair{ TraceChange_A, &record.a }, { TraceChange_X, &record.x },
+                 { TraceChange_Y, &record.y }, { TraceChange_P, &record.p }, { TraceChange_S, &record.s } }) {
+            if (mask & change) {
+                *value = decoder.Byte();
+            }
+        }
+
+        const uint32_t ppuPosition = mask2 & TraceChange2_PPU ? static_cast<uint32_t>(decoder.Varint()) : GetExpectedPPUPosition(previous, cycles);
+        record.scanline = static_cast<uint16_t>(ppuPosition / DotsPerScanline);
+        record.dot = static_cast<uint16_t>(ppuPosition % DotsPerScanline);
+        if (mask2 & TraceChange2_Frame) {
+            record.frame = previous.frame + decoder.Varint();
+        }
+        previous = record;
+    }
+    if (!decoder.AtEnd()) {
+        throw std::runtime_error("Trace block is corrupt");
+    }
+}
+
+std::string FormatTraceRecord(const TraceRecord& record) {
+    std::string out = Disassembler::FormatInstruction({ record.bytes, std::clamp<size_t>(record.size, 1, 3) }, record.pc);
+    fmt::format_to(std::back_inserter(out), "{:{}}A:{:02X} X:{:02X} Y:{:02X} P:{:02X} SP:{:02X} PPU:{:3d},{:3d} CYC:{}",
+        "", out.size() < 48 ? 48 - out.size() : 1, record.a, record.x, record.y, record.p, record.s,
+        record.scanline, record.dot, record.cycle);
+    return out;
+}
+
+TraceWriter::TraceWriter(const char* path) : file(path, std::ios::binary), path(path), current(buffers[0].records.get()) {
+    if (!file) {
+        throw std::runtime_error(fmt::format("Failed to open trace {}", path));
+    }
+    TraceFileHeader header{ {}, TraceVersion, BlockRecords, 0 };
+    std::copy(std::begin(TraceMagic), std::end(TraceMagic), header.magic);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writer = std::thread(&TraceWriter::WriterLoop, this);
+}
+
+TraceWriter::~TraceWriter() {
+    // Without Finish the file is left without the rest and the index
+    if (writer.joinable()) {
+        Stop(0);
+    }
+}
+
+void TraceWriter::Submit() {
+    const uint64_t block = submitted.load(std::memory_order_relaxed);
+    buffers[block % BufferCount].count = count;
+    submitted.store(block + 1, std::memory_order_release);
+    submitted.notify_one();
+
+    // Wait for the writer thread when it is a whole set of buffers behind
+    uint64_t done;
+    while (block + 1 - (done = written.load(std::memory_order_acquire)) == BufferCount) {
+        written.wait(done, std::memory_order_acquire);
+    }
+    current = buffers[(block + 1) % BufferCount].records.get();
+    count = 0;
+}
+
+void TraceWriter::Finish() {
+    Stop(count);
+
+    TraceFileFooter footer{ static_cast<uint64_t>(file.tellp()), index.size() };
+    file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(TraceBlockIndex));
+    file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+    file.close();
+    if (failed || !file) {
+        throw std::runtime_error(fmt::format("Failed to write trace {}", path));
+    }
+    SPDLOG_INFO("Trace of {} instructions in {} blocks written to {}", records, index.size(), path);
+}
+
+void TraceWriter::Stop(uint32_t lastCount) {
+    const uint64_t block = submitted.load(std::memory_order_relaxed);
+    buffers[block % BufferCount].count = lastCount;
+    submitted.store((block + 1) | StopFlag, std::memory_order_release);
+    submitted.notify_one();
+    writer.join();
+}
+
+void TraceWriter::WriterLoop() {
+    uint64_t next = 0;
+    while (true) {
+        const uint64_t state = submitted.load(std::memory_order_acquire);
+        if (next < (state & ~StopFlag)) {
+            WriteBlock(buffers[next % BufferCount]);
+            written.store(++next, std::memory_order_release);
+            written.notify_one();
+            continue;
+        }
+        if (state & StopFlag) {
+            return;
+        }
+        submitted.wait(state, std::memory_order_acquire);
+    }
+}
+
+void TraceWriter::WriteBlock(const Buffer& buffer) {
+    if (!buffer.count || failed) {
+        return;
+    }
+    const std::span<const TraceRecord> block(buffer.records.get(), buffer.count);
+    encoded.clear();
+    EncodeTraceBlock(block, instructions, encoded);
+
+    index.push_back({ static_cast<uint64_t>(file.tellp()), static_cast<uint32_t>(encoded.size()), buffer.count,
+        records, block.front().cycle, block.front().frame });
+    records += buffer.count;
+    file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    failed = !file;
+}
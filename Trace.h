@@ -0,0 +1,145 @@
+#pragma once
+
+#include "pch.h"
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+// CPU state before an instruction, the fields of a nestest.log line plus the PPU frame
+struct TraceRecord {
+    uint64_t cycle; // CPU cycles since power on, CYC
+    uint64_t frame; // PPU frames since power on, bumped at the start of vblank
+    Addr pc;
+    uint8_t bytes[3]; // Opcode and operands, unused ones 0
+    uint8_t size;     // Bytes of the instruction
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t p;
+    uint8_t s;
+    uint8_t reserved;
+    uint16_t scanline; // PPU position, PPU:scanline,dot
+    uint16_t dot;
+};
+
+// File layout, little endian: the header, the blocks, the block index and the footer.
+//
+// A block holds up to blockRecords records, each stored as what changed since the previous one
+// so a typical instruction takes 2-3 bytes instead of a full register dump:
+//   - A change mask byte, TraceChange, with a second one after it for TraceChange2 changes
+//   - The cycle delta as a varint
+//   - For a PC that doesn't follow the previous instruction, the zigzag varint of the difference
+//   - For bytes that differ from the last instruction at the same PC in the block, the size and bytes
+//   - The changed registers, A, X, Y, P and S in that order
+//   - For a PPU position that isn't 3 dots per cycle on from the previous one, the varint of
+//     scanline * 341 + dot
+//   - For a new frame, the varint of the frame delta
+// The first record of a block is encoded against an all zero record, so every block decodes on
+// its own. The index has an entry per block with the first cycle and frame for seeking.
+struct TraceFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t blockRecords;
+    uint32_t reserved;
+};
+struct TraceBlockIndex {
+    uint64_t offset;      // In the file
+    uint32_t size;        // Encoded bytes
+    uint32_t records;
+    uint64_t firstRecord; // Records before the block
+    uint64_t firstCycle;
+    uint64_t firstFrame;
+};
+struct TraceFileFooter {
+    uint64_t indexOffset;
+    uint64_t blockCount;
+};
+constexpr char TraceMagic[4] = { 'N', 'T', 'R', 'C' };
+constexpr uint32_t TraceVersion = 2;
+
+enum TraceChange : uint8_t {
+    TraceChange_A      = 0x01,
+    TraceChange_X      = 0x02,
+    TraceChange_Y      = 0x04,
+    TraceChange_P      = 0x08,
+    TraceChange_S      = 0x10,
+    TraceChange_PC     = 0x20,
+    TraceChange_Bytes  = 0x40,
+    TraceChange_Mask2  = 0x80 // A TraceChange2 byte follows
+};
+enum TraceChange2 : uint8_t {
+    TraceChange2_PPU   = 0x01,
+    TraceChange2_Frame = 0x02
+};
+
+// Last instruction bytes and size seen at every PC, the encoder and decoder keep the same one
+using TraceInstructionTable = std::vector<uint32_t>;
+
+void EncodeTraceBlock(std::span<const TraceRecord> records, TraceInstructionTable& instructions, std::vector<uint8_t>& out);
+// Throws if the block is corrupt
+void DecodeTraceBlock(std::span<const uint8_t> data, size_t count, TraceInstructionTable& instructions, std::vector<TraceRecord>& records);
+
+// The record as a nestest.log line, with the instruction disassembled but without the
+// memory values nestest.log adds to it
+std::string FormatTraceRecord(const TraceRecord& record);
+
+// Writes trace records in the binary format. The emulation thread only copies records into
+// block buffers, a writer thread encodes and writes the full ones.
+class TraceWriter {
+public:
+    explicit TraceWriter(const char* path);
+    ~TraceWriter();
+
+    void Write(const TraceRecord& record) {
+        current[count] = record;
+        if (++count == BlockRecords) [[unlikely]] {
+            Submit();
+        }
+    }
+    // Writes the rest and the index, throws if any write failed. The file is unreadable
+    // without it.
+    void Finish();
+
+private:
+    static constexpr uint32_t BlockRecords = 1 << 16;
+    static constexpr size_t BufferCount = 4;
+
+    struct Buffer {
+        std::unique_ptr<TraceRecord[]> records{ new TraceRecord[BlockRecords] };
+        uint32_t count = 0;
+    };
+
+    static constexpr uint64_t StopFlag = 1ull << 63;
+
+    // Hands the current buffer to the writer thread and waits for a free one
+    void Submit();
+    // Hands over the current buffer as the last one and waits for the writer thread to finish
+    void Stop(uint32_t lastCount);
+    void WriterLoop();
+    void WriteBlock(const Buffer& buffer);
+
+    std::ofstream file;
+    std::string path;
+
+    Buffer buffers[BufferCount];
+    TraceRecord* current;
+    uint32_t count = 0;
+
+    // Buffers handed over, with StopFlag once the last one is, and buffers written. The writer
+    // thread sleeps on the first and the emulation thread on the second when all are full.
+    std::atomic<uint64_t> submitted{ 0 };
+    std::atomic<uint64_t> written{ 0 };
+    std::thread writer;
+
+    // Writer thread only
+    TraceInstructionTable instructions;
+    std::vector<uint8_t> encoded;
+    std::vector<TraceBlockIndex> index;
+    uint64_t records = 0;
+    bool failed = false;
+};
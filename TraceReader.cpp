@@ -0,0 +1,265 @@
+#include "TraceReader.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iterator>
+#include <optional>
+
+namespace {
+
+int HexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Exactly digits hex digits at pos
+bool ParseHex(std::string_view text, size_t pos, size_t digits, uint32_t& value) {
+    if (pos + digits > text.size()) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < digits; ++i) {
+        const int digit = HexDigit(text[pos + i]);
+        if (digit < 0) {
+            return false;
+        }
+        value = value << 4 | static_cast<uint32_t>(digit);
+    }
+    return true;
+}
+
+// Decimal after any padding, moves pos past it
+template <typename T>
+bool ParseDecimal(std::string_view text, size_t& pos, T& value) {
+    while (pos < text.size() && text[pos] == ' ') {
+        ++pos;
+    }
+    const auto [end, error] = std::from_chars(text.data() + pos, text.data() + text.size(), value);
+    if (error != std::errc()) {
+        return false;
+    }
+    pos = static_cast<size_t>(end - text.data());
+    return true;
+}
+
+} // namespace
+
+TraceReader::TraceReader(const char* path) : file(path) {
+    file.AdviseSequential();
+
+    TraceFileHeader header{};
+    if (file.GetSize() >= sizeof(header)) {
+        std::memcpy(&header, file.GetData(), sizeof(header));
+        binary = std::equal(std::begin(TraceMagic), std::end(TraceMagic), header.magic);
+    }
+    if (!binary) {
+        return;
+    }
+    if (header.version != TraceVersion) {
+        throw std::runtime_error(fmt::format("Trace {} has version {}, expected {}", path, header.version, TraceVersion));
+    }
+
+    TraceFileFooter footer{};
+    if (file.GetSize() >= sizeof(header) + sizeof(footer)) {
+        std::memcpy(&footer, file.GetData() + file.GetSize() - sizeof(footer), sizeof(footer));
+    }
+    const size_t indexEnd = file.GetSize() - sizeof(footer);
+    if (footer.indexOffset < sizeof(header) || footer.indexOffset > indexEnd ||
+        (indexEnd - footer.indexOffset) % sizeof(TraceBlockIndex) ||
+        footer.blockCount != (indexEnd - footer.indexOffset) / sizeof(TraceBlockIndex)) {
+        throw std::runtime_error(fmt::format("Trace {} has no index, it is truncated or wasn't finished", path));
+    }
+    index.resize(footer.blockCount);
+    std::memcpy(index.data(), file.GetData() + footer.indexOffset, index.size() * sizeof(TraceBlockIndex));
+    for (const TraceBlockIndex& entry : index) {
+        if (entry.offset + entry.size > footer.indexOffset) {
+            throw std::runtime_error(fmt::format("Trace {} has a block past its end", path));
+        }
+    }
+    position.offset = sizeof(header);
+}
+
+bool TraceReader::Next(TraceEntry& entry) {
+    if (binary) {
+        if (!LoadBlock(position.line)) {
+            return false;
+        }
+        const TraceBlockIndex& current = index[block];
+        entry.record = records[position.line - current.firstRecord];
+        entry.fields = TraceField_All;
+        entry.line = ++position.line;
+        entry.text = {};
+        position.offset = current.offset + current.size;
+        return true;
+    }
+
+    const char* data = reinterpret_cast<const char*>(file.GetData());
+    while (position.offset < file.GetSize()) {
+        const char* begin = data + position.offset;
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', file.GetSize() - position.offset));
+        const char* end = newline ? newline : data + file.GetSize();
+        position.offset = static_cast<size_t>(end - data) + (newline != nullptr);
+        ++position.line;
+
+        std::string_view text(begin, end);
+        if (text.ends_with('\r')) {
+            text.remove_suffix(1);
+        }
+        if (ParseLine(text, entry)) {
+            entry.line = position.line;
+            entry.text = text;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TraceReader::SeekCycle(uint64_t cycle) {
+    if (binary) {
+        // The last block starting at or before the cycle
+        const auto next = std::ranges::upper_bound(index, cycle, {}, &TraceBlockIndex::firstCycle);
+        position.line = next == index.begin() ? 0 : std::prev(next)->firstRecord;
+    }
+    SkipUntil([&](const TraceEntry& entry) { return (entry.fields & TraceField_Cycle) && entry.record.cycle >= cycle; });
+}
+
+void TraceReader::SeekFrame(uint64_t frame) {
+    if (!binary) {
+        throw std::runtime_error("Only binary traces have frames");
+    }
+    const auto next = std::ranges::upper_bound(index, frame, {}, &TraceBlockIndex::firstFrame);
+    position.line = next == index.begin() ? 0 : std::prev(next)->firstRecord;
+    SkipUntil([&](const TraceEntry& entry) { return entry.record.frame >= frame; });
+}
+
+template <typename Predicate>
+void TraceReader::SkipUntil(Predicate predicate) {
+    TraceEntry entry;
+    Position before = position;
+    while (Next(entry) && !predicate(entry)) {
+        before = position;
+    }
+    position = before;
+}
+
+bool TraceReader::LoadBlock(uint64_t line) {
+    if (block < index.size() && line - index[block].firstRecord < index[block].records) [[likely]] {
+        return true;
+    }
+    const auto next = std::ranges::upper_bound(index, line, {}, &TraceBlockIndex::firstRecord);
+    if (next == index.begin() || line - std::prev(next)->firstRecord >= std::prev(next)->records) {
+        return false;
+    }
+    block = static_cast<size_t>(std::prev(next) - index.begin());
+    const TraceBlockIndex& current = index[block];
+    DecodeTraceBlock({ file.GetData() + current.offset, current.size }, current.records, instructions, records);
+    return true;
+}
+
+bool TraceReader::ParseLine(std::string_view text, TraceEntry& entry) {
+    TraceRecord& record = entry.record;
+    record = {};
+    entry.fields = 0;
+
+    uint32_t value = 0;
+    if (!ParseHex(text, 0, 4, value) || text.size() < 5 || text[4] != ' ') {
+        return false;
+    }
+    record.pc = static_cast<Addr>(value);
+    entry.fields |= TraceField_PC;
+
+    // Up to three bytes after the address, a mnemonic that looks like hex is never followed by a space
+    size_t pos = 6;
+    while (record.size < 3 && ParseHex(text, pos, 2, value) && (pos + 2 == text.size() || text[pos + 2] == ' ')) {
+        record.bytes[record.size++] = static_cast<uint8_t>(value);
+        pos += 3;
+    }
+    if (record.size) {
+        entry.fields |= TraceField_Bytes;
+    }
+
+    size_t registers = text.find(" A:", std::min(pos, text.size()));
+    if (registers == std::string_view::npos) {
+        return true;
+    }
+    pos = registers + 1;
+
+    std::optional<uint64_t> cycle;
+    std::optional<int> oldScanline;
+    while (pos < text.size()) {
+        if (text[pos] == ' ') {
+            ++pos;
+            continue;
+        }
+        const size_t colon = text.find(':', pos);
+        const size_t space = text.find(' ', pos);
+        if (colon == std::string_view::npos || colon > space) {
+            // Not a key:value pair
+            pos = space == std::string_view::npos ? text.size() : space;
+            continue;
+        }
+        const std::string_view key = text.substr(pos, colon - pos);
+        pos = colon + 1;
+
+        auto parseRegister = [&](uint8_t& target, TraceField field) {
+            if (ParseHex(text, pos, 2, value)) {
+                target = static_cast<uint8_t>(value);
+                entry.fields |= field;
+                pos += 2;
+            }
+        };
+        if (key == "A") {
+            parseRegister(record.a, TraceField_A);
+        } else if (key == "X") {
+            parseRegister(record.x, TraceField_X);
+        } else if (key == "Y") {
+            parseRegister(record.y, TraceField_Y);
+        } else if (key == "P") {
+            parseRegister(record.p, TraceField_P);
+        } else if (key == "SP") {
+            parseRegister(record.s, TraceField_SP);
+        } else if (key == "PPU") {
+            int scanline = 0;
+            int dot = 0;
+            if (ParseDecimal(text, pos, scanline) && pos < text.size() && text[pos] == ',' && ParseDecimal(text, ++pos, dot)) {
+                // Some emulators number the pre-render line -1
+                record.scanline = static_cast<uint16_t>(scanline < 0 ? 261 : scanline);
+                record.dot = static_cast<uint16_t>(dot);
+                entry.fields |= TraceField_PPU;
+            }
+        } else if (key == "CYC") {
+            uint64_t parsed = 0;
+            if (ParseDecimal(text, pos, parsed)) {
+                cycle = parsed;
+            }
+        } else if (key == "SL") {
+            int parsed = 0;
+            if (ParseDecimal(text, pos, parsed)) {
+                oldScanline = parsed;
+            }
+        }
+        // Skip whatever is left of the value, and unknown keys
+        while (pos < text.size() && text[pos] != ' ') {
+            ++pos;
+        }
+    }
+
+    if (oldScanline && cycle && !(entry.fields & TraceField_PPU)) {
+        record.scanline = static_cast<uint16_t>(*oldScanline < 0 ? 261 : *oldScanline);
+        record.dot = static_cast<uint16_t>(*cycle);
+        entry.fields |= TraceField_PPU;
+    } else if (cycle) {
+        record.cycle = *cycle;
+        entry.fields |= TraceField_Cycle;
+    }
+    return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "pch.h"
+
+#include "MappedFile.h"
+#include "Trace.h"
+
+#include <string_view>
+
+// Fields an entry has, text traces of other emulators leave some out
+enum TraceField : uint16_t {
+    TraceField_PC    = 0x001,
+    TraceField_Bytes = 0x002,
+    TraceField_A     = 0x004,
+    TraceField_X     = 0x008,
+    TraceField_Y     = 0x010,
+    TraceField_P     = 0x020,
+    TraceField_SP    = 0x040,
+    TraceField_PPU   = 0x080,
+    TraceField_Cycle = 0x100,
+    TraceField_All   = 0x1FF
+};
+
+struct TraceEntry {
+    TraceRecord record;
+    uint16_t fields;       // TraceFields present, all of them for binary traces
+    uint64_t line;         // Line of a text trace or record of a binary one, from 1
+    std::string_view text; // The line of a text trace, empty for binary ones
+};
+
+// Reads a trace front to back from a mapping of the whole file, either the binary format of
+// TraceWriter or text in the nestest.log format, told apart by the binary header. Binary traces
+// are decoded a block at a time. Text lines that don't start with an address are skipped.
+//
+// Text is parsed for "PPPP  OO OO OO" at the start of the line and the registers as "key:value"
+// pairs starting at " A:" in any order: A, X, Y, P and SP in hex, PPU as "scanline,dot" and CYC
+// in decimal. Old logs with SL for the scanline have the dot in CYC instead.
+class TraceReader {
+public:
+    explicit TraceReader(const char* path);
+
+    bool IsBinary() const { return binary; }
+
+    // The next entry, false at the end of the trace. Entries' text stays valid with the reader.
+    bool Next(TraceEntry& entry);
+
+    // For looking ahead, Seek back to a position from Tell. Offset is how far into the file
+    // the entries before it were read.
+    struct Position {
+        size_t offset;
+        uint64_t line;
+    };
+    Position Tell() const { return position; }
+    void Seek(Position position) { this->position = position; }
+    // Skip to the first entry at or after the CPU cycle. Binary traces jump to its block through
+    // the index, text ones are read on from the current position.
+    void SeekCycle(uint64_t cycle);
+    // Same for the first entry of a PPU frame, binary traces only
+    void SeekFrame(uint64_t frame);
+
+    size_t GetSize() const { return file.GetSize(); }
+
+private:
+    static bool ParseLine(std::string_view text, TraceEntry& entry);
+    // Decode the block with the record at the line, false past the end
+    bool LoadBlock(uint64_t line);
+    // Read on until the first entry matching
+    template <typename Predicate>
+    void SkipUntil(Predicate predicate);
+
+    MappedFile file;
+    bool binary = false;
+    Position position{ 0, 0 };
+
+    // Binary traces
+    std::vector<TraceBlockIndex> index;
+    size_t block = SIZE_MAX; // Decoded into records
+    std::vector<TraceRecord> records;
+    TraceInstructionTable instructions;
+};
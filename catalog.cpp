@@ -0,0 +1,76 @@
+#include "pch.h"
+
+#include "RomCatalog.h"
+
+#include <cstring>
+#include <optional>
+#include <thread>
+
+namespace {
+
+const char* Usage =
+    "Usage: catalog <index> [options]\n"
+    "  --scan <directory>  Scan the directory tree and write the index, unchanged files keep their entries\n"
+    "  --threads <n>       Scan on n threads (default hardware concurrency)\n"
+    "  --find <rom>        Print the entry of one ROM, by its path as scanned, instead of all\n";
+
+void PrintEntry(const RomCatalogEntry& entry, std::string_view path) {
+    const iNES::Header& header = entry.header;
+    std::string sha1;
+    for (uint8_t byte : entry.romSHA1) {
+        sha1 += fmt::format("{:02x}", byte);
+    }
+    fmt::print("{:08X} {} {:>4}.{:<2} {:>5}KB {:>5}KB {:<5} {}\n", entry.romCRC, sha1, header.GetMapperNumber(), header.GetSubmapper(),
+        header.GetPrgRomSize() / 1024, header.GetChrRomSize() / 1024, header.IsNES2() ? "NES2" : "iNES", path);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    VERIFY(argc >= 2, Usage);
+    const char* indexPath = argv[1];
+    const char* scanPath = nullptr;
+    const char* findPath = nullptr;
+    size_t threads = std::thread::hardware_concurrency();
+    for (int i = 2; i < argc; ++i) {
+        VERIFY(i + 1 < argc, "Missing value for option", argv[i], Usage);
+        if (!std::strcmp(argv[i], "--scan")) {
+            scanPath = argv[++i];
+        } else if (!std::strcmp(argv[i], "--threads")) {
+            threads = std::stoul(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--find")) {
+            findPath = argv[++i];
+        } else {
+            VERIFY(false, "Unexpected argument", argv[i], Usage);
+        }
+    }
+
+    if (scanPath) {
+        RomCatalog catalog;
+        {
+            // The previous index has to be unmapped before it is replaced
+            std::optional<RomIndex> previous;
+            if (std::filesystem::exists(indexPath)) {
+                previous.emplace(indexPath);
+            }
+            catalog = RomCatalog::Scan(scanPath, threads, previous ? &*previous : nullptr);
+        }
+        catalog.Save(indexPath);
+        fmt::print(stderr, "{} ROMs indexed, {} files read\n", catalog.GetEntries().size(), catalog.GetHashedCount());
+    }
+
+    RomIndex index(indexPath);
+    if (findPath) {
+        const RomCatalogEntry* entry = index.Find(findPath);
+        if (!entry) {
+            fmt::print(stderr, "{} is not in the index\n", findPath);
+            return 1;
+        }
+        PrintEntry(*entry, index.GetPath(*entry));
+    } else if (!scanPath) {
+        for (const RomCatalogEntry& entry : index.GetEntries()) {
+            PrintEntry(entry, index.GetPath(entry));
+        }
+    }
+    return 0;
+}
@@ -1,40 +1,49 @@
-#include "InstrTable.h"
-
 #include "pch.h"
 
+#include "Coverage.h"
+#include "Disassembler.h"
 #include "iNES.h"
 
-#include <filesystem>
-#include <cstdint>
-#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
 
 int main(int argc, char *argv[]) {
-    VERIFY(argc == 2, "Usage: {} <rom>", argv[0]);
-    iNES ines(argv[1]);
-    
-    auto prg_rom = ines.GetPrgRom();
-    
-    size_t pc = 0;
-    while (pc < prg_rom.size()) {
-        auto opcode = prg_rom[pc];
-        auto instrData = InstrDataTable[opcode];
-        auto addrData = AddrModeDataTable[instrData.mode];
-        switch (addrData.size) {
-        case 0:
-            fmt::print(fmt::runtime(addrData.fmt), instrData.mnemonic);
-            break;
-        case 1:
-            fmt::print(fmt::runtime(addrData.fmt), instrData.mnemonic, prg_rom[pc + 1]);
-            break;
-        case 2:
-            fmt::print(fmt::runtime(addrData.fmt), instrData.mnemonic, prg_rom[pc + 1], prg_rom[pc + 2]);
-            break;
-        case 3:
-            fmt::print(fmt::runtime(addrData.fmt), instrData.mnemonic, prg_rom[pc + 1], prg_rom[pc + 2], prg_rom[pc + 3]);
-            break;
+    const char* usage = "Usage: dump <rom> [--threads <n>] [--coverage <file>]";
+    VERIFY(argc >= 2, usage);
+    size_t threads = std::thread::hardware_concurrency();
+    const char* coveragePath = nullptr;
+    for (int i = 2; i < argc; ++i) {
+        VERIFY(i + 1 < argc, usage);
+        if (!std::strcmp(argv[i], "--threads")) {
+            threads = std::stoul(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--coverage")) {
+            coveragePath = argv[++i];
+        } else {
+            VERIFY(false, usage);
         }
-        pc += addrData.size;
     }
 
+    iNES ines(argv[1]);
+
+    Disassembler disassembler(ines.GetPrgRom());
+    CoverageMap coverage;
+    if (coveragePath) {
+        // nes2 --coverage of the same ROM
+        coverage = CoverageMap::Load(coveragePath);
+        disassembler.SetCoverage(coverage.prg);
+    }
+    disassembler.Analyze(threads);
+    const std::string listing = disassembler.Format(threads);
+
+    // One write for the whole listing
+    std::fwrite(listing.data(), 1, listing.size(), stdout);
+
+    fmt::print(stderr, "{} banks, {} of {} bytes traced as code\n", disassembler.GetBankCount(),
+        disassembler.GetCodeBytes(), ines.GetPrgRom().size());
+    if (coveragePath) {
+        fmt::print(stderr, "{} bytes executed\n", disassembler.GetExecutedBytes());
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -22,25 +22,30 @@ iNES::iNES(const char *path) {
     file.read(reinterpret_cast<char *>(&header), sizeof(header));
 
     VERIFY(file, "Failed to read header");
+    if (!header.IsValid()) {
+        throw std::runtime_error("Not an iNES file");
+    }
 
     if (header.hasTrainer()) {
         file.read(reinterpret_cast<char *>(&trainer), sizeof(trainer));
         VERIFY(file, "Failed to read trainer");
     }
 
-    if (header.prgRomChunks == 0) {
+    auto prgRomSize = header.GetPrgRomSize();
+    if (prgRomSize == 0) {
         throw std::runtime_error("PRG ROM size is zero");
     }
+    if (prgRomSize + header.GetChrRomSize() > MaxRomSize) {
+        throw std::runtime_error("ROM is too large");
+    }
 
     // Read the PRG ROM
-    auto prgRomSize = header.prgRomChunks * PrgRomChunkSize;
     prgRom.resize(prgRomSize);
     file.read(reinterpret_cast<char*>(prgRom.data()), prgRomSize);
     VERIFY(file, "Failed to read PRG ROM");
 
     // Read the CHR ROM
-    if (header.chrRomChunks > 0) {
-        auto chrRomSize = header.chrRomChunks * ChrRomChunkSize;
+    if (auto chrRomSize = header.GetChrRomSize()) {
         chrRom.resize(chrRomSize);
         file.read(reinterpret_cast<char*>(chrRom.data()), chrRomSize);
         VERIFY(file, "Failed to read CHR ROM");
@@ -2,13 +2,14 @@
 
 #include "pch.h"
 
+#include <algorithm>
+#include <iterator>
+
 using RomBank = std::vector<uint8_t>;
 
 class iNES {
     const size_t MinRomSize = 16 + 16384;
     const size_t MaxRomSize = 64 * 1024 * 1024;
-    const size_t PrgRomChunkSize = 16384;
-    const size_t ChrRomChunkSize = 8192;
 
     static constexpr const char Preamble[4] = { 'N', 'E', 'S', '\x1A' };
 
@@ -18,9 +19,9 @@ public:
             Flags6_None                = 0,
 
             Flags6_IsVerticalMirroring = 1 << 0,
-            Flags6_HasPersistentMemory = 1 << 2,
-            Flags6_Has512ByteTrainer   = 1 << 3,
-            Flags6_HasFourScreenVRAM   = 1 << 4,
+            Flags6_HasPersistentMemory = 1 << 1,
+            Flags6_Has512ByteTrainer   = 1 << 2,
+            Flags6_HasFourScreenVRAM   = 1 << 3,
             Flags6_MapperLowerNybble   = 0b1111 << 4
         };
         enum Flags7 : uint8_t {
@@ -32,36 +33,129 @@ public:
             Flags7_MapperUpperNybble   = 0b1111 << 4,
         };
 
-        enum MapperType : uint8_t {
+        // https://www.nesdev.org/wiki/NES_2.0#Timing
+        enum Timing : uint8_t {
+            Timing_NTSC,
+            Timing_PAL,
+            Timing_MultipleRegion,
+            Timing_Dendy
+        };
+
+        enum MapperType : uint16_t {
             MapperType_NROM = 0,
             MapperType_MMC1 = 1
         };
         auto format_as(MapperType f) { return fmt::underlying(f); }
 
+        // Fields by their iNES names, NES 2.0 reuses bytes 8-15
+        // https://www.nesdev.org/wiki/NES_2.0
         char name[4];
         uint8_t prgRomChunks;
         uint8_t chrRomChunks;
         uint8_t mapper1;
         uint8_t mapper2;
-        uint8_t prgRamSize;
-        uint8_t tvSystem1;
-        uint8_t tvSystem2;
-        char unused[5];
+        uint8_t prgRamSize; // NES 2.0: mapper bits 8-11 and submapper
+        uint8_t tvSystem1;  // NES 2.0: PRG and CHR ROM size MSBs
+        uint8_t tvSystem2;  // NES 2.0: PRG RAM and NVRAM shift counts
+        char unused[5];     // NES 2.0: CHR RAM shift counts, timing, system type, misc ROMs, expansion device
+
+        bool IsValid() const {
+            return std::equal(std::begin(name), std::end(name), std::begin(Preamble));
+        }
+
+        bool IsNES2() const {
+            return (mapper2 & Flags7_NES2Format) == 0b10 << 2;
+        }
 
         bool hasTrainer() const {
             return mapper1 & Flags6_Has512ByteTrainer;
         }
 
+        bool IsVerticalMirroring() const {
+            return mapper1 & Flags6_IsVerticalMirroring;
+        }
+
+        bool HasFourScreenVRAM() const {
+            return mapper1 & Flags6_HasFourScreenVRAM;
+        }
+
+        bool HasPersistentMemory() const {
+            return mapper1 & Flags6_HasPersistentMemory;
+        }
+
         bool HasPlayChoice10Data() const {
             return mapper2 & Flags7_HasPlayChoice10Data;
         }
 
         MapperType GetMapper() const {
-            uint8_t upperNybble = mapper2 & Flags7_MapperUpperNybble;
-            uint8_t lowerNybble = (mapper1 & Flags6_MapperLowerNybble) >> 4;
-            return static_cast<MapperType>(upperNybble | lowerNybble);
+            return static_cast<MapperType>(GetMapperNumber());
+        }
+
+        // Up to 12 bits with NES 2.0
+        uint16_t GetMapperNumber() const {
+            uint16_t lowerNybble = (mapper1 & Flags6_MapperLowerNybble) >> 4;
+            if (IsNES2()) {
+                return static_cast<uint16_t>(((prgRamSize & 0x0F) << 8) | (mapper2 & Flags7_MapperUpperNybble) | lowerNybble);
+            }
+            // Old dumps have junk like "DiskDude!" from byte 7 on, upper nybble included
+            // https://www.nesdev.org/wiki/INES#Variant_comparison
+            if (std::any_of(std::begin(unused) + 1, std::end(unused), [](char c) { return c != 0; })) {
+                return lowerNybble;
+            }
+            return static_cast<uint16_t>((mapper2 & Flags7_MapperUpperNybble) | lowerNybble);
+        }
+
+        uint8_t GetSubmapper() const {
+            return IsNES2() ? prgRamSize >> 4 : 0;
+        }
+
+        // Sizes in bytes, NES 2.0 sizes have 4 more bits or an exponent-multiplier form
+        uint64_t GetPrgRomSize() const {
+            return IsNES2() ? GetNES2RomSize(prgRomChunks, tvSystem1 & 0x0F, 16384) : prgRomChunks * uint64_t{ 16384 };
+        }
+
+        uint64_t GetChrRomSize() const {
+            return IsNES2() ? GetNES2RomSize(chrRomChunks, tvSystem1 >> 4, 8192) : chrRomChunks * uint64_t{ 8192 };
+        }
+
+        // Volatile and battery backed RAM, iNES only has a volatile PRG RAM size where 0 means 8KB
+        uint32_t GetPrgRamSize() const {
+            return IsNES2() ? GetNES2RamSize(tvSystem2 & 0x0F) : (prgRamSize ? prgRamSize : 1) * 8192u;
+        }
+
+        uint32_t GetPrgNvramSize() const {
+            return IsNES2() ? GetNES2RamSize(tvSystem2 >> 4) : 0;
+        }
+
+        uint32_t GetChrRamSize() const {
+            return IsNES2() ? GetNES2RamSize(unused[0] & 0x0F) : chrRomChunks ? 0u : 8192u;
+        }
+
+        uint32_t GetChrNvramSize() const {
+            return IsNES2() ? GetNES2RamSize(static_cast<uint8_t>(unused[0]) >> 4) : 0;
+        }
+
+        Timing GetTiming() const {
+            if (IsNES2()) {
+                return static_cast<Timing>(unused[1] & 0b11);
+            }
+            return tvSystem1 & 1 ? Timing_PAL : Timing_NTSC;
+        }
+
+    private:
+        static uint64_t GetNES2RomSize(uint8_t lsb, uint8_t msb, uint64_t unit) {
+            if (msb == 0x0F) {
+                // 2^E * (MM * 2 + 1) from EEEEEEMM
+                return (uint64_t{ 1 } << (lsb >> 2)) * ((lsb & 0b11) * 2 + 1);
+            }
+            return ((uint64_t{ msb } << 8) | lsb) * unit;
+        }
+
+        static uint32_t GetNES2RamSize(uint8_t shift) {
+            return shift ? 64u << shift : 0;
         }
     };
+    static_assert(sizeof(Header) == 16);
 
 private:
     Header header;
@@ -74,4 +168,6 @@ public:
     ~iNES();
     const Header& GetHeader() const { return header; }
     const RomBank& GetPrgRom() const { return prgRom; }
+    // Empty if the cartridge uses CHR RAM
+    const RomBank& GetChrRom() const { return chrRom; }
 };
\ No newline at end of file
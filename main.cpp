@@ -1,21 +1,530 @@
 #include "pch.h"
 
+#include "AudioOutput.h"
+#include "Counters.h"
+#include "FrameHash.h"
+#include "HostStats.h"
 #include "System.h"
+#include "TestRunner.h"
+#include "Timeline.h"
 
-int main(int argc, char** argv) {
-    spdlog::set_level(spdlog::level::trace); 
+#include <chrono>
+#include <cstring>
 
-    VERIFY(argc == 2, "Usage: nes <rom>");
+namespace {
 
-    System system;
-    system.LoadCartridge(argv[1]);
+const char* Usage =
+    "Usage: nes <rom> [options]\n"
+    "       nes --test-roms <dir> [--jobs <n>] [--junit <file>] [--json <file>] [--frames <n>] [--cpu <core>]\n"
+    "           [--engine <engine>]\n"
+    "  --frames <n>         Stop after n frames\n"
+    "  --nestest            Start at $C000 instead of the reset vector, for nestest's automated mode\n"
+    "  --cpu <core>         'fast' instruction stepped CPU (default) or 'cycle' stepped for bus timing accuracy\n"
+    "  --compare-cores      Run --frames frames on both CPU cores and report the first frame that differs\n"
+    "  --compare-render     Same for immediate and deferred rendering on --render-threads threads (default 2)\n"
+    "  --engine <engine>    'lockstep' ticks PPU and APU after every CPU step (default), 'coroutine' runs them\n"
+    "                       as coroutines synced when the CPU accesses them\n"
+    "  --present <n>        Only render every n-th frame, others keep side effects but skip pixels\n"
+    "  --render-threads <n> Render frames on n worker threads, overlapped with emulation (default 0)\n"
+    "  --hash <mode>        Hash frames over 'indices' (default) or 'rgb'\n"
+    "  --hash-out <file>    Write per frame hashes to file\n"
+    "  --golden <file>      Compare per frame hashes against file, stop at the first divergence\n"
+    "  --wav <file>         Write audio to a WAV file\n"
+    "  --raw <file>         Write audio as raw signed 16-bit little endian mono\n"
+    "  --pipe <command>     Play audio in real time by piping raw samples to a command\n"
+    "  --sample-rate <hz>   Audio sample rate (default 48000)\n"
+    "  --profile <prefix>   Write cycles per call path to <prefix>.folded for flame graphs and the hottest\n"
+    "                       routines, instructions and loops to <prefix>.txt, needs -DNES2_PROFILER=ON\n"
+    "  --counters <file>    Write instruction, bus, mapper, DMA, interrupt and frame counts as JSON lines\n"
+    "                       at exit, needs -DNES2_COUNTERS=ON\n"
+    "  --counters-interval <n>\n"
+    "                       Also write counts every n frames\n"
+    "  --host-stats <n>     Measure host time per frame and, on Linux, hardware counters over every n frames\n"
+    "  --timeline <file>    Write what the emulation, render and audio threads spent their time on as a\n"
+    "                       Chrome trace for Perfetto at exit, needs -DNES2_TIMELINE=ON\n"
+    "  --coverage <file>    Write which PRG ROM, CHR and RAM bytes were executed, read and written at exit,\n"
+    "                       for dump --coverage, needs -DNES2_COVERAGE=ON\n"
+    "  --trace <file>       Write the CPU state before every instruction in the binary trace format, for\n"
+    "                       tracediff against a reference log\n"
+    "  --movie <file>       Play the input of a movie, binary or FCEUX .fm2, headless and unthrottled, for\n"
+    "                       as many frames as it has unless --frames or --golden say otherwise\n"
+    "  --record <file>      Write the input --movie plays as a binary movie, e.g. to convert an .fm2\n"
+    "  --break <spec>       Stop before executing an address, spec is <addr>[-<last>][:<cond>...] in hex\n"
+    "                       with conditions A, X, Y, S, P or value=<hex> and hits=<n>, e.g. C123:X=00:hits=2\n"
+    "  --watch-read <spec>  Stop after the instruction reading an address, value is the byte read\n"
+    "  --watch-write <spec> Stop after the instruction writing an address, value is the byte written\n"
+    "  --test-roms <dir>    Run every .nes file in the directory tree headless in parallel and report the\n"
+    "                       result each posts at $6000, hangs, or no result within --frames (default 3600)\n"
+    "  --jobs <n>           ROMs run at the same time, one per hardware thread by default\n"
+    "  --junit <file>       Write the test ROM results as JUnit XML\n"
+    "  --json <file>        Write the test ROM results as JSON\n";
+
+struct Options {
+    const char* romPath = nullptr;
+    uint64_t frames = 0;
+    bool nestest = false;
+    CPUCore cpuCore = CPUCore_Fast;
+    bool compareCores = false;
+    bool compareRender = false;
+    ExecutionEngine engine = ExecutionEngine_Lockstep;
+    uint32_t presentInterval = 1;
+    size_t renderThreads = 0;
+    FrameHasher::Mode hashMode = FrameHasher::Mode_Indices;
+    const char* hashOutPath = nullptr;
+    const char* goldenPath = nullptr;
+    const char* wavPath = nullptr;
+    const char* rawPath = nullptr;
+    const char* pipeCommand = nullptr;
+    uint32_t sampleRate = 48000;
+    const char* profilePrefix = nullptr;
+    const char* countersPath = nullptr;
+    uint64_t countersInterval = 0;
+    uint32_t hostStatsFrames = 0;
+    const char* timelinePath = nullptr;
+    const char* coveragePath = nullptr;
+    const char* tracePath = nullptr;
+    const char* moviePath = nullptr;
+    const char* recordPath = nullptr;
+    std::vector<Debugger::Breakpoint> breakpoints;
+    const char* testRomsPath = nullptr;
+    size_t jobs = 0;
+    const char* junitPath = nullptr;
+    const char* jsonPath = nullptr;
+
+    bool HasAudio() const { return wavPath || rawPath || pipeCommand; }
+    // Any frame based option runs headless, without the per instruction log
+    bool IsComparing() const { return compareCores || compareRender; }
+    bool IsHeadless() const { return frames || hashOutPath || goldenPath || HasAudio() || IsComparing() || hostStatsFrames || moviePath; }
+};
+
+Options ParseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        auto isOption = [&](const char* name) {
+            if (std::strcmp(argv[i], name) != 0) {
+                return false;
+            }
+            VERIFY(i + 1 < argc, "Missing value for option", name, Usage);
+            return true;
+        };
+
+        if (!std::strcmp(argv[i], "--nestest")) {
+            options.nestest = true;
+        } else if (!std::strcmp(argv[i], "--compare-cores")) {
+            options.compareCores = true;
+        } else if (!std::strcmp(argv[i], "--compare-render")) {
+            options.compareRender = true;
+        } else if (isOption("--cpu")) {
+            const char* core = argv[++i];
+            VERIFY(!std::strcmp(core, "fast") || !std::strcmp(core, "cycle"), "Unknown CPU core", core, Usage);
+            options.cpuCore = std::strcmp(core, "cycle") ? CPUCore_Fast : CPUCore_Cycle;
+        } else if (isOption("--engine")) {
+            const char* engine = argv[++i];
+            VERIFY(!std::strcmp(engine, "lockstep") || !std::strcmp(engine, "coroutine"), "Unknown execution engine", engine, Usage);
+            options.engine = std::strcmp(engine, "coroutine") ? ExecutionEngine_Lockstep : ExecutionEngine_Coroutine;
+        } else if (isOption("--frames")) {
+            options.frames = std::stoull(argv[++i]);
+        } else if (isOption("--present")) {
+            options.presentInterval = static_cast<uint32_t>(std::stoul(argv[++i]));
+            VERIFY(options.presentInterval > 0, "Present interval must be at least 1");
+        } else if (isOption("--render-threads")) {
+            options.renderThreads = std::stoul(argv[++i]);
+        } else if (isOption("--hash")) {
+            const char* mode = argv[++i];
+            VERIFY(!std::strcmp(mode, "indices") || !std::strcmp(mode, "rgb"), "Unknown hash mode", mode, Usage);
+            options.hashMode = std::strcmp(mode, "rgb") ? FrameHasher::Mode_Indices : FrameHasher::Mode_RGB;
+        } else if (isOption("--hash-out")) {
+            options.hashOutPath = argv[++i];
+        } else if (isOption("--golden")) {
+            options.goldenPath = argv[++i];
+        } else if (isOption("--wav")) {
+            options.wavPath = argv[++i];
+        } else if (isOption("--raw")) {
+            options.rawPath = argv[++i];
+        } else if (isOption("--pipe")) {
+            options.pipeCommand = argv[++i];
+        } else if (isOption("--profile")) {
+            options.profilePrefix = argv[++i];
+            VERIFY(ProfilerEnabled, "--profile needs a build configured with -DNES2_PROFILER=ON");
+        } else if (isOption("--counters")) {
+            options.countersPath = argv[++i];
+            VERIFY(CountersEnabled, "--counters needs a build configured with -DNES2_COUNTERS=ON");
+        } else if (isOption("--counters-interval")) {
+            options.countersInterval = std::stoull(argv[++i]);
+        } else if (isOption("--host-stats")) {
+            options.hostStatsFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+            VERIFY(options.hostStatsFrames > 0, "Host stats need at least one frame per sample");
+        } else if (isOption("--timeline")) {
+            options.timelinePath = argv[++i];
+            VERIFY(TimelineEnabled, "--timeline needs a build configured with -DNES2_TIMELINE=ON");
+        } else if (isOption("--coverage")) {
+            options.coveragePath = argv[++i];
+            VERIFY(CoverageEnabled, "--coverage needs a build configured with -DNES2_COVERAGE=ON");
+        } else if (isOption("--trace")) {
+            options.tracePath = argv[++i];
+        } else if (isOption("--movie")) {
+            options.moviePath = argv[++i];
+        } else if (isOption("--record")) {
+            options.recordPath = argv[++i];
+        } else if (isOption("--break")) {
+            options.breakpoints.push_back(Debugger::Breakpoint::Parse(argv[++i], Access_Execute));
+        } else if (isOption("--watch-read")) {
+            options.breakpoints.push_back(Debugger::Breakpoint::Parse(argv[++i], Access_Read));
+        } else if (isOption("--watch-write")) {
+            options.breakpoints.push_back(Debugger::Breakpoint::Parse(argv[++i], Access_Write));
+        } else if (isOption("--test-roms")) {
+            options.testRomsPath = argv[++i];
+        } else if (isOption("--jobs")) {
+            options.jobs = std::stoul(argv[++i]);
+        } else if (isOption("--junit")) {
+            options.junitPath = argv[++i];
+        } else if (isOption("--json")) {
+            options.jsonPath = argv[++i];
+        } else if (isOption("--sample-rate")) {
+            options.sampleRate = static_cast<uint32_t>(std::stoul(argv[++i]));
+            VERIFY(options.sampleRate >= 8000 && options.sampleRate <= 192000, "Unsupported sample rate", options.sampleRate);
+        } else {
+            VERIFY(options.romPath == nullptr && argv[i][0] != '-', "Unexpected argument", argv[i], Usage);
+            options.romPath = argv[i];
+        }
+    }
+    VERIFY((options.romPath != nullptr) != (options.testRomsPath != nullptr), Usage);
+    VERIFY(options.testRomsPath || (!options.jobs && !options.junitPath && !options.jsonPath),
+        "--jobs, --junit and --json need --test-roms");
+    VERIFY(!options.IsComparing() || options.frames, "--compare-cores and --compare-render need --frames");
+    VERIFY(!options.compareCores || !options.compareRender, "--compare-cores can't be combined with --compare-render");
+    VERIFY(!options.IsComparing() || !options.profilePrefix, "--profile can't be combined with comparisons");
+    VERIFY(!options.IsComparing() || !options.countersPath, "--counters can't be combined with comparisons");
+    VERIFY(!options.countersInterval || options.countersPath, "--counters-interval needs --counters");
+    VERIFY(!options.IsComparing() || !options.hostStatsFrames, "--host-stats can't be combined with comparisons");
+    VERIFY(!options.IsComparing() || !options.timelinePath, "--timeline can't be combined with comparisons");
+    VERIFY(!options.IsComparing() || !options.coveragePath, "--coverage can't be combined with comparisons");
+    VERIFY(!options.IsComparing() || !options.tracePath, "--trace can't be combined with comparisons");
+    VERIFY(!options.IsComparing() || !options.moviePath, "--movie can't be combined with comparisons");
+    VERIFY(!options.IsComparing() || !options.recordPath, "--record can't be combined with comparisons");
+    VERIFY(!options.recordPath || options.moviePath, "--record needs --movie, there is no live input to record");
+    VERIFY(!options.IsComparing() || options.breakpoints.empty(), "Breakpoints can't be combined with comparisons");
+    VERIFY((options.wavPath != nullptr) + (options.rawPath != nullptr) + (options.pipeCommand != nullptr) <= 1,
+        "Only one audio output can be used at a time");
+    return options;
+}
+
+void SetUp(System& system, const Options& options, CPUCore core) {
+    system.SetCPUCore(core);
+    system.SetExecutionEngine(options.engine);
+    system.SetProfilerEnabled(options.profilePrefix != nullptr);
+    system.SetCoverageEnabled(options.coveragePath != nullptr);
+    system.LoadCartridge(options.romPath);
+
+    if (options.IsHeadless()) {
+        system.SetNESTestLogEnabled(false);
+    }
+    if (options.nestest) {
+        system.SetEntryPoint(0xC000);
+    }
+    system.SetPresentInterval(options.presentInterval);
+    system.SetRenderThreads(options.renderThreads);
+
+    for (const Debugger::Breakpoint& breakpoint : options.breakpoints) {
+        system.GetDebugger().Add(breakpoint);
+    }
+    system.GetDebugger().SetHitCallback([&system](const Debugger::Hit& hit) {
+        SPDLOG_INFO("Breakpoint: {}", Debugger::Format(hit));
+        system.Stop();
+    });
 
     system.PowerOn();
-    //system.Init();
+}
 
-    //system.Execute();
+std::unique_ptr<AudioOutput> CreateAudioOutput(const Options& options) {
+    std::unique_ptr<AudioSink> sink;
+    if (options.wavPath) {
+        sink = std::make_unique<WavSink>(options.wavPath, options.sampleRate);
+    } else if (options.rawPath) {
+        sink = std::make_unique<RawSink>(options.rawPath);
+    } else if (options.pipeCommand) {
+        sink = std::make_unique<PipeSink>(options.pipeCommand);
+    } else {
+        return nullptr;
+    }
+    // Only the player consumes samples at a fixed rate, files take them as fast as they come
+    return std::make_unique<AudioOutput>(std::move(sink), options.pipeCommand != nullptr);
+}
+
+// Hashes every presented frame and checks it against the golden file, returns the process exit code
+int RunHeadless(System& system, const Options& options, CounterLog* counterLog, HostStats* hostStats) {
+    GoldenHashes golden;
+    if (options.goldenPath) {
+        golden.Load(options.goldenPath);
+    }
+
+    // Without an explicit frame count run as far as the golden file goes
+    uint64_t frameLimit = options.frames;
+    if (!frameLimit && !golden.Empty()) {
+        frameLimit = golden.LastFrame() + 1;
+    }
+
+    FrameHasher hasher(options.hashMode);
+    GoldenHashes produced;
+    uint64_t framesRun = 0;
+    std::optional<uint64_t> divergentFrame;
+
+    auto audio = CreateAudioOutput(options);
+    if (audio) {
+        system.SetSampleRate(options.sampleRate);
+        system.SetSampleCallback([&](std::span<const int16_t> samples) {
+            audio->Push(samples);
+            system.SetRateAdjust(audio->GetRateAdjust());
+        });
+    }
+
+    // A real-time player needs emulation paced to the NTSC frame rate
+    // https://www.nesdev.org/wiki/Cycle_reference_chart
+    using Clock = std::chrono::steady_clock;
+    const auto frameDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / 60.0988));
+    const auto startTime = Clock::now();
+
+    system.SetFrameCallback([&](const Frame& frame) {
+        // Deferred rendering can still deliver frames after stopping
+        if (frameLimit && frame.number >= frameLimit) {
+            return;
+        }
+
+        if (options.pipeCommand) {
+            std::this_thread::sleep_until(startTime + frameDuration * (frame.number + 1));
+        }
+
+        framesRun++;
+        if (frameLimit && framesRun >= frameLimit) {
+            system.Stop();
+        }
+        if (counterLog && options.countersInterval && framesRun % options.countersInterval == 0) {
+            counterLog->Write();
+        }
+        if (hostStats) {
+            hostStats->Frame(system.GetCPUCycles());
+        }
+
+        // Skipped frames have no pixels to hash
+        if (!frame.presented) {
+            return;
+        }
+
+        auto hash = hasher.Hash(frame);
+        if (options.hashOutPath) {
+            produced.Set(frame.number, hash);
+        }
+
+        auto expected = golden.Get(frame.number);
+        if (expected && *expected != hash) {
+            SPDLOG_ERROR("First divergent frame {}: expected {:016x}, got {:016x}", frame.number, *expected, hash);
+            divergentFrame = frame.number;
+            system.Stop();
+        }
+    });
 
     system.Run();
+    // Flushes the remaining samples and finishes the file, throws if the sink failed
+    if (audio) {
+        audio->Close();
+    }
+    audio.reset();
+
+    if (options.hashOutPath) {
+        produced.Save(options.hashOutPath);
+    }
 
+    if (divergentFrame) {
+        return 1;
+    }
+    if (!golden.Empty() && framesRun <= golden.LastFrame()) {
+        SPDLOG_ERROR("Emulation stopped after {} frames, golden file expects {}", framesRun, golden.LastFrame() + 1);
+        return 1;
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+    SPDLOG_INFO("{} frames run{} in {:.2f}s, {:.0f}x real time", framesRun, golden.Empty() ? "" : ", all match golden hashes",
+        seconds, seconds > 0 ? framesRun / 60.0988 / seconds : 0.0);
     return 0;
-}
\ No newline at end of file
+}
+
+// Runs the same frames on both CPU cores, or with immediate and deferred rendering, and reports
+// the first frame they differ on, returns the process exit code
+int Compare(const Options& options) {
+    auto run = [&](CPUCore core, size_t renderThreads) {
+        Options runOptions = options;
+        runOptions.renderThreads = renderThreads;
+        System system;
+        SetUp(system, runOptions, core);
+
+        FrameHasher hasher(options.hashMode);
+        GoldenHashes hashes;
+        system.SetFrameCallback([&](const Frame& frame) {
+            if (frame.number >= options.frames) {
+                return;
+            }
+            if (frame.presented) {
+                hashes.Set(frame.number, hasher.Hash(frame));
+            }
+            if (frame.number + 1 == options.frames) {
+                system.Stop();
+            }
+        });
+        system.Run();
+        return hashes;
+    };
+
+    const char* names[2] = { "fast", "cycle" };
+    GoldenHashes expected;
+    GoldenHashes actual;
+    if (options.compareCores) {
+        expected = run(CPUCore_Fast, options.renderThreads);
+        actual = run(CPUCore_Cycle, options.renderThreads);
+    } else {
+        names[0] = "immediate";
+        names[1] = "deferred";
+        expected = run(options.cpuCore, 0);
+        actual = run(options.cpuCore, options.renderThreads ? options.renderThreads : 2);
+    }
+
+    for (uint64_t frame = 0; frame < options.frames; ++frame) {
+        auto first = expected.Get(frame);
+        auto second = actual.Get(frame);
+        if (first != second) {
+            SPDLOG_ERROR("First frame the {} and {} runs differ on {}: {:016x}, {:016x}",
+                names[0], names[1], frame, first.value_or(0), second.value_or(0));
+            return 1;
+        }
+    }
+    SPDLOG_INFO("{} frames match on the {} and {} runs", options.frames, names[0], names[1]);
+    return 0;
+}
+
+// Runs the test ROMs in the directory, returns the process exit code
+int RunTestRoms(const Options& options) {
+    TestRunSettings settings;
+    settings.cpuCore = options.cpuCore;
+    settings.engine = options.engine;
+    if (options.frames) {
+        settings.frameBudget = options.frames;
+    }
+    settings.jobs = options.jobs;
+
+    const std::vector<std::string> paths = TestRunner::FindRoms(options.testRomsPath);
+    VERIFY(!paths.empty(), "No .nes files in", options.testRomsPath);
+
+    // The emulators' own logging would drown out the results
+    spdlog::set_level(spdlog::level::warn);
+    const auto startTime = std::chrono::steady_clock::now();
+    const std::vector<TestResult> results = TestRunner(settings).Run(paths);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    spdlog::set_level(spdlog::level::info);
+
+    size_t passed = 0;
+    for (const TestResult& result : results) {
+        if (result.status == TestStatus_Passed) {
+            ++passed;
+            SPDLOG_INFO("passed {} in {} frames", result.path, result.frames);
+        } else {
+            SPDLOG_ERROR("{} {} in {} frames: {}", TestRunner::GetStatusName(result.status), result.path, result.frames, result.message);
+        }
+    }
+    if (options.junitPath) {
+        TestRunner::SaveJUnit(results, options.junitPath);
+    }
+    if (options.jsonPath) {
+        TestRunner::SaveJSON(results, options.jsonPath);
+    }
+
+    SPDLOG_INFO("{} of {} test ROMs passed in {:.2f}s", passed, results.size(), seconds);
+    return passed == results.size() ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    auto options = ParseOptions(argc, argv);
+
+    spdlog::set_level(options.IsHeadless() ? spdlog::level::info : spdlog::level::trace);
+
+    if (options.IsComparing()) {
+        return Compare(options);
+    }
+    if (options.testRomsPath) {
+        return RunTestRoms(options);
+    }
+
+    System system;
+    SetUp(system, options, options.cpuCore);
+    //system.Init();
+
+    //system.Execute();
+
+    std::unique_ptr<Movie> movie;
+    if (options.moviePath) {
+        movie = std::make_unique<Movie>(options.moviePath);
+        system.GetControllers().SetMovie(movie.get());
+        // The whole movie unless told otherwise
+        if (!options.frames && !options.goldenPath) {
+            options.frames = movie->GetFrameCount();
+        }
+    }
+    std::unique_ptr<MovieWriter> recorder;
+    if (options.recordPath) {
+        recorder = std::make_unique<MovieWriter>(options.recordPath);
+        system.GetControllers().SetRecorder(recorder.get());
+    }
+
+    std::unique_ptr<TraceWriter> traceWriter;
+    if (options.tracePath) {
+        traceWriter = std::make_unique<TraceWriter>(options.tracePath);
+        system.SetTraceWriter(traceWriter.get());
+    }
+
+    std::unique_ptr<CounterLog> counterLog;
+    if (options.countersPath) {
+        counterLog = std::make_unique<CounterLog>(options.countersPath);
+    }
+
+    // Counts the thread emulating from here on
+    std::unique_ptr<HostStats> hostStats;
+    if (options.hostStatsFrames) {
+        hostStats = std::make_unique<HostStats>(options.hostStatsFrames);
+    }
+
+    if (options.timelinePath) {
+        Timeline::SetThreadName("Emulation");
+        Timeline::Start();
+    }
+
+    int result = 0;
+    if (options.IsHeadless()) {
+        result = RunHeadless(system, options, counterLog.get(), hostStats.get());
+    } else {
+        system.Run();
+    }
+
+    if (recorder) {
+        recorder->Finish();
+    }
+    if (traceWriter) {
+        traceWriter->Finish();
+    }
+    if (hostStats) {
+        hostStats->LogReport();
+    }
+    if (counterLog) {
+        counterLog->Write();
+    }
+    if (options.profilePrefix) {
+        system.GetProfiler()->SaveFoldedStacks(fmt::format("{}.folded", options.profilePrefix).c_str());
+        system.GetProfiler()->SaveReport(fmt::format("{}.txt", options.profilePrefix).c_str());
+    }
+    if (options.coveragePath) {
+        system.GetCoverage()->GetMap().Save(options.coveragePath);
+    }
+    if (options.timelinePath) {
+        Timeline::Save(options.timelinePath);
+    }
+    return result;
+}
@@ -0,0 +1,203 @@
+#include "pch.h"
+
+#include "TraceReader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <optional>
+#include <string>
+
+namespace {
+
+const char* Usage =
+    "Usage: tracediff <trace> <reference> [options]\n"
+    "  --max <n>          Report the first n divergences (default 10)\n"
+    "  --context <n>      Instructions shown before and after each divergence (default 3)\n"
+    "  --ignore <fields>  Fields not to compare, comma separated: pc, bytes, a, x, y, p, sp, ppu, cyc\n"
+    "  --cycle <n>        Start both traces at CPU cycle n, binary traces seek there through their index\n"
+    "  --frame <n>        Start both traces at the start of PPU frame n of the first trace, which has to be\n"
+    "                     binary\n";
+
+struct FieldName {
+    TraceField field;
+    std::string_view name;
+};
+constexpr FieldName FieldNames[] = {
+    { TraceField_PC, "pc" },
+    { TraceField_Bytes, "bytes" },
+    { TraceField_A, "a" },
+    { TraceField_X, "x" },
+    { TraceField_Y, "y" },
+    { TraceField_P, "p" },
+    { TraceField_SP, "sp" },
+    { TraceField_PPU, "ppu" },
+    { TraceField_Cycle, "cyc" },
+};
+
+uint16_t ParseFields(std::string_view list) {
+    uint16_t fields = 0;
+    while (!list.empty()) {
+        const size_t comma = list.find(',');
+        const std::string_view name = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+        const auto field = std::ranges::find(FieldNames, name, &FieldName::name);
+        VERIFY(field != std::end(FieldNames), "Unknown trace field", name, Usage);
+        fields |= field->field;
+    }
+    return fields;
+}
+
+std::string FormatFields(uint16_t fields) {
+    std::string out;
+    for (const FieldName& field : FieldNames) {
+        if (fields & field.field) {
+            out += out.empty() ? "" : ", ";
+            out += field.name;
+        }
+    }
+    return out;
+}
+
+// Fields that differ, out of the compared ones both entries have
+uint16_t Compare(const TraceEntry& ours, const TraceEntry& reference, uint16_t compared) {
+    const uint16_t fields = ours.fields & reference.fields & compared;
+    const TraceRecord& a = ours.record;
+    const TraceRecord& b = reference.record;
+    uint16_t differing = 0;
+    auto check = [&](TraceField field, bool equal) {
+        if ((fields & field) && !equal) {
+            differing |= field;
+        }
+    };
+    check(TraceField_PC, a.pc == b.pc);
+    check(TraceField_Bytes, a.size == b.size && std::equal(a.bytes, a.bytes + a.size, b.bytes));
+    check(TraceField_A, a.a == b.a);
+    check(TraceField_X, a.x == b.x);
+    check(TraceField_Y, a.y == b.y);
+    check(TraceField_P, a.p == b.p);
+    check(TraceField_SP, a.s == b.s);
+    check(TraceField_PPU, a.scanline == b.scanline && a.dot == b.dot);
+    check(TraceField_Cycle, a.cycle == b.cycle);
+    return differing;
+}
+
+void PrintEntry(std::string_view marker, std::string_view source, const TraceEntry& entry) {
+    // Binary records have no text of their own
+    fmt::print("{} {:<9} {:>9}  {}\n", marker, source, entry.line, entry.text.empty() ? FormatTraceRecord(entry.record) : std::string(entry.text));
+}
+
+void PrintPair(std::string_view marker, const TraceEntry& ours, const TraceEntry& reference) {
+    PrintEntry(marker, "trace", ours);
+    PrintEntry(marker, "reference", reference);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    VERIFY(argc >= 3, Usage);
+    uint64_t maxDivergences = 10;
+    size_t context = 3;
+    uint16_t compared = TraceField_All;
+    std::optional<uint64_t> startCycle;
+    std::optional<uint64_t> startFrame;
+    for (int i = 3; i < argc; ++i) {
+        VERIFY(i + 1 < argc, "Missing value for option", argv[i], Usage);
+        if (!std::strcmp(argv[i], "--max")) {
+            maxDivergences = std::stoull(argv[++i]);
+            VERIFY(maxDivergences > 0, "Report at least one divergence");
+        } else if (!std::strcmp(argv[i], "--context")) {
+            context = std::stoul(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--ignore")) {
+            compared &= ~ParseFields(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--cycle")) {
+            startCycle = std::stoull(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--frame")) {
+            startFrame = std::stoull(argv[++i]);
+        } else {
+            VERIFY(false, "Unexpected argument", argv[i], Usage);
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    TraceReader ours(argv[1]);
+    TraceReader reference(argv[2]);
+    VERIFY(!startCycle || !startFrame, "Start at either a cycle or a frame", Usage);
+    if (startFrame) {
+        // The reference starts at the same cycle, text traces have no frames
+        ours.SeekFrame(*startFrame);
+        const TraceReader::Position start = ours.Tell();
+        TraceEntry first;
+        if (!ours.Next(first)) {
+            throw std::runtime_error(fmt::format("{} ends before frame {}", argv[1], *startFrame));
+        }
+        startCycle = first.record.cycle;
+        ours.Seek(start);
+    }
+    if (startCycle) {
+        ours.SeekCycle(*startCycle);
+        reference.SeekCycle(*startCycle);
+    }
+
+    // The last instructions before the current one, for the context of a divergence
+    std::deque<std::pair<TraceEntry, TraceEntry>> history;
+    uint64_t instructions = 0;
+    uint64_t divergences = 0;
+    bool lengthsDiffer = false;
+    TraceEntry a;
+    TraceEntry b;
+    while (true) {
+        const bool hasOurs = ours.Next(a);
+        const bool hasReference = reference.Next(b);
+        if (!hasOurs || !hasReference) {
+            if (hasOurs != hasReference) {
+                lengthsDiffer = true;
+                fmt::print("{} ends after {} instructions, {} goes on:\n", hasOurs ? "Reference" : "Trace", instructions,
+                    hasOurs ? "trace" : "reference");
+                PrintEntry(">", hasOurs ? "trace" : "reference", hasOurs ? a : b);
+            }
+            break;
+        }
+        ++instructions;
+
+        if (const uint16_t differing = Compare(a, b, compared)) {
+            ++divergences;
+            fmt::print("Divergence {} at instruction {}: {}\n", divergences, instructions, FormatFields(differing));
+            for (const auto& [previousOurs, previousReference] : history) {
+                PrintPair(" ", previousOurs, previousReference);
+            }
+            PrintPair(">", a, b);
+
+            // Look ahead, then continue comparing from the divergence
+            const TraceReader::Position oursPosition = ours.Tell();
+            const TraceReader::Position referencePosition = reference.Tell();
+            TraceEntry nextOurs;
+            TraceEntry nextReference;
+            for (size_t i = 0; i < context && ours.Next(nextOurs) && reference.Next(nextReference); ++i) {
+                PrintPair(" ", nextOurs, nextReference);
+            }
+            ours.Seek(oursPosition);
+            reference.Seek(referencePosition);
+            fmt::print("\n");
+
+            if (divergences == maxDivergences) {
+                break;
+            }
+        }
+
+        if (context) {
+            if (history.size() == context) {
+                history.pop_front();
+            }
+            history.emplace_back(a, b);
+        }
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double megabytes = static_cast<double>(ours.Tell().offset + reference.Tell().offset) / (1024 * 1024);
+    fmt::print(stderr, "{} instructions compared, {} divergences, {:.1f}MB in {:.2f}s ({:.0f}MB/s)\n",
+        instructions, divergences, megabytes, seconds, seconds > 0 ? megabytes / seconds : 0.0);
+    return divergences || lengthsDiffer ? 1 : 0;
+}